@@ -0,0 +1,134 @@
+#ifndef AUTHSERVICE_H
+#define AUTHSERVICE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "PasswdMgr.h"
+#include "FileWatcher.h"
+
+// Threads hashing passwords. Each Argon2 hash works through 64 MiB, so this also bounds the
+// memory logins can take.
+const unsigned int auth_hash_threads = 4;
+
+// Logins waiting for a hashing thread before new ones are turned away
+const size_t auth_queue_limit = 512;
+
+// How long a session ticket lets a client log back in without its password, and the size of
+// the key tickets are signed with
+const unsigned int ticket_lifetime_secs = 12 * 60 * 60;
+const unsigned int ticket_key_len = 32;
+
+// Told the result of a password check handed to the hashing threads, along with how long it
+// waited for a thread and how long the hash took. Called from a hashing thread, so it should
+// just post the result and return.
+class AuthWaiter {
+public:
+   virtual ~AuthWaiter() {};
+   virtual void passwdChecked(int fd, uint64_t ticket, bool ok, uint64_t wait_us, uint64_t hash_us) = 0;
+};
+
+/******************************************************************************************
+ * AuthService - The server's one copy of the password database, shared by every connection
+ *               on every event loop thread. The file is read once into a hash table keyed by
+ *               username, so looking a user up never touches the disk.
+ *
+ *               A watcher thread uses inotify on the file's directory, so it also sees the
+ *               file being replaced by a rename, and reloads the table when the file changes.
+ *               A new table is built off to the side and swapped in whole, so a lookup sees
+ *               either the old users or the new ones, never a mix. If the new file doesn't
+ *               parse (say it was caught half written) the old table stays in use.
+ *
+ *               Hashing a password takes tens of milliseconds, far too long to do on an event
+ *               loop, so the event loops queue checks for a small pool of hashing threads
+ *               with queuePasswd. Each result goes back to the waiter that queued it, tagged
+ *               with the ticket queuePasswd returned. The queue is bounded; past the limit a
+ *               check is refused rather than left waiting.
+ *
+ *               A client that logs in is given a session ticket: its username and an expiry,
+ *               signed with HMAC-SHA256 under a key only the server knows. Presenting the
+ *               ticket on a later connection logs the client in with one HMAC instead of an
+ *               Argon2 hash, so a whole fleet reconnecting after a restart doesn't queue up
+ *               behind the hashing threads. The key is kept in a file so tickets outlive a
+ *               restart, and the user's stored hash is signed too, so changing the password
+ *               or removing the user voids their tickets.
+ *
+ *    start - loads the file, starts watching it and starts the hashing threads
+ *    stop - stops the watcher and the hashing threads, dropping checks still queued
+ *    checkUser - true if the user is in the database
+ *    checkPasswd - hashes the password with the user's salt and compares, on this thread
+ *    queuePasswd - has a hashing thread run checkPasswd and report to a waiter
+ *    getQueueDepth - checks waiting for a hashing thread
+ *    issueTicket - signs a session ticket for a user
+ *    checkTicket - checks a ticket's signature and expiry and says whose it is
+ *    reload - rereads the file now
+ *
+ *    Exceptions: pwfile_error if the file can't be loaded at startup
+ *
+ ******************************************************************************************/
+
+class AuthService {
+public:
+   AuthService(const char *pwd_file, const char *key_file);
+   ~AuthService();
+
+   void start(unsigned int hash_threads = auth_hash_threads);
+   void stop();
+
+   bool checkUser(const std::string &name);
+   bool checkPasswd(const std::string &name, const char *passwd);
+   uint64_t queuePasswd(const std::string &name, const std::string &passwd, AuthWaiter &waiter, int fd);
+   size_t getQueueDepth();
+
+   bool issueTicket(const std::string &name, std::string &ticket);
+   bool checkTicket(const std::string &ticket, std::string &name);
+
+   bool reload();
+
+private:
+   typedef std::unordered_map<std::string, PasswdEntry> UserTable;
+
+   std::shared_ptr<const UserTable> getTable();
+   bool findUser(const std::string &name, PasswdEntry &entry);
+   void hasherLoop();
+   void loadTicketKey();
+   void signTicket(const std::string &body, const PasswdEntry &entry, std::string &mac);
+
+   std::string _pwd_file;
+   PasswdMgr _pwmgr;        // reads the file and does the hashing
+   FileWatcher _watcher;    // reloads the table when the file changes
+
+   // Signs session tickets. Written once at start and only read after.
+   std::string _key_file;
+   std::vector<uint8_t> _ticket_key;
+
+   // The current table. Readers take a reference under the lock and search it without, so
+   // a reload only holds the lock for the swap.
+   std::shared_ptr<const UserTable> _users;
+   std::mutex _users_lock;
+
+   // A password check waiting for a hashing thread
+   struct PasswdCheck {
+      std::string name;
+      std::string passwd;
+      AuthWaiter *waiter;
+      int fd;
+      uint64_t ticket;
+      std::chrono::steady_clock::time_point queued;
+   };
+   std::deque<PasswdCheck> _checks;
+   std::mutex _check_lock;
+   std::condition_variable _check_ready;
+   std::vector<std::thread> _hashers;
+   bool _hashing = false;
+   uint64_t _next_ticket = 1;
+};
+
+#endif
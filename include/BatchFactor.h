@@ -0,0 +1,55 @@
+#ifndef BATCHFACTOR_H
+#define BATCHFACTOR_H
+
+#include <string>
+#include "FileDesc.h"
+#include "FactorPool.h"
+
+// Size of the blocks we read input in and the point at which buffered output is written
+const unsigned int batch_inbufsize = 65536;
+const unsigned int batch_outbufsize = 65536;
+
+// Jobs queued per worker before we stop reading input and wait for results
+const unsigned int batch_jobs_per_worker = 64;
+
+/******************************************************************************************
+ * BatchFactor - Headless mode for the client. Reads numbers from a file (or stdin), factors
+ *               them on a FactorPool and streams the results out as they finish, with no
+ *               server in the loop.
+ *
+ *               Input is one number per line, optionally preceded by a job id
+ *               ("<jobid> <number>"). Lines without an id are numbered by line. Each result
+ *               is written as "<jobid> <number>: <prime> <prime> ..." in completion order.
+ *
+ *    Exceptions: runtime_error if the input or output can't be opened or read/written
+ *
+ ******************************************************************************************/
+
+class BatchFactor {
+public:
+   BatchFactor(const char *infile, const char *outfile, unsigned int workers,
+               const std::vector<int> &cpus = std::vector<int>(), PrimeCache *cache = NULL);
+   ~BatchFactor();
+
+   void run();
+
+   unsigned long getJobsDone() { return _jobs_done; };
+
+private:
+   bool readJobs(unsigned int max_jobs);
+   void writeResult(FactorResult &result);
+   void flushOutput();
+
+   FileFD _infile;
+   FileFD _outfile;
+   FactorPool _pool;
+
+   std::string _inbuf;
+   std::string _outbuf;
+
+   unsigned long _lineno = 0;
+   unsigned long _jobs_done = 0;
+   bool _eof = false;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef CLIENTCAPS_H
+#define CLIENTCAPS_H
+
+#include <string>
+
+// Operand widths (in bits) that the calibration measures modmul and rho rates at
+const unsigned int caps_num_widths = 3;
+const unsigned int caps_widths[caps_num_widths] = {64, 128, 256};
+
+// How long (ms) each individual calibration test runs for
+const unsigned int caps_test_ms = 50;
+
+// Bounds on the number of jobs we keep queued up on a single client
+const unsigned int min_prefetch = 1;
+const unsigned int max_prefetch = 32;
+
+/******************************************************************************************
+ * ClientCaps - The capabilities of a factoring client. The client fills this in with a short
+ *              calibration run at connect time and advertises it to the server as a single
+ *              "CAPS key=value ..." line. The server parses it back and uses the numbers to
+ *              decide which clients get the harder jobs and how many jobs to queue on each.
+ *
+ *    calibrate - measures modmul and Pollard's rho iteration rates at each width
+ *    toString/fromString - serialize to and from the advertisement line
+ *    getThroughput - estimated rho iterations/sec across all of the client's workers
+ *    getMaxJobBits - the largest number (in bits) the client should finish in target_secs
+ *    getPrefetchDepth - how many jobs of the given size to keep outstanding on the client
+ *    getJobSecs - how long one worker should take on a job of the given size
+ *    getJobIters - about how many rho iterations a job of the given size takes
+ *
+ ******************************************************************************************/
+
+class ClientCaps {
+public:
+   ClientCaps();
+   ~ClientCaps();
+
+   void calibrate(unsigned int workers, unsigned int ms_per_test = caps_test_ms);
+
+   void toString(std::string &buf);
+   bool fromString(std::string &str);
+
+   bool isValid() { return _valid; };
+
+   double getThroughput();
+   unsigned int getMaxJobBits(double target_secs);
+   unsigned int getPrefetchDepth(unsigned int job_bits, double queue_secs = 2.0);
+   double getJobSecs(unsigned int job_bits);
+   static double getJobIters(unsigned int job_bits);
+
+   unsigned int cores = 0;       // Hardware threads on the client
+   unsigned int workers = 0;     // Concurrent factoring jobs the client will run
+   std::string simd = "none";    // Best SIMD extension the CPU supports
+   bool frames = false;          // Takes its jobs in binary frames rather than text lines
+
+   // Operations per second for a single thread at each of caps_widths
+   double modmul_rate[caps_num_widths];
+   double rho_rate[caps_num_widths];
+
+private:
+   int widthIndex(unsigned int bits);
+
+   bool _valid = false;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where the kernel publishes the CPU topology
+const char default_sysfs_cpu[] = "/sys/devices/system/cpu";
+
+// A logical CPU (hardware thread) and the physical core it belongs to
+struct LogicalCpu {
+   int cpu;
+   int package;
+   int core;
+};
+
+/******************************************************************************************
+ * CpuTopology - Reads which logical CPUs share a physical core from sysfs so worker threads
+ *               can be spread one per physical core instead of doubling up on hyperthread
+ *               siblings. Only CPUs in the process's affinity mask are considered, so taskset
+ *               and cgroup limits are respected.
+ *
+ *    load - reads the topology, falling back to one core per logical CPU if sysfs is missing
+ *    getPlacement - the ordered list of CPUs workers should be pinned to
+ *    parseCpuList - parses a kernel-style CPU list such as "0-3,8,10-11"
+ *    pinThread - pins a running thread to a single CPU
+ *
+ ******************************************************************************************/
+
+class CpuTopology {
+public:
+   CpuTopology(const char *sysfs_root = default_sysfs_cpu);
+   ~CpuTopology();
+
+   bool load();
+
+   void getPlacement(std::vector<int> &cpus, bool use_smt, const std::vector<int> *allowed = NULL);
+
+   unsigned int getNumCpus() { return _cpus.size(); };
+   unsigned int getNumCores();
+
+   static bool parseCpuList(const char *list, std::vector<int> &cpus);
+   static bool pinThread(std::thread &th, int cpu);
+
+private:
+   bool readInt(const std::string &path, int &value);
+
+   std::string _sysfs_root;
+
+   // Sorted by package, then core, then cpu so siblings sit next to each other
+   std::vector<LogicalCpu> _cpus;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef DISTPOINTS_H
+#define DISTPOINTS_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "DivFinderServer.h"
+
+// Walks on a split number report a point every 2^dp_bits steps
+const unsigned int dp_bits = 12;
+
+// Points kept per number. Every new point is compared against all of them, so this bounds
+// the work each report costs the checker.
+const unsigned int dp_window = 4096;
+
+// The checker takes one gcd for every this many points it multiplies into a number's product
+const unsigned int dp_gcd_batch = 64;
+
+// Points waiting for the checker. Past this new ones are dropped, which only means a
+// collision is found a little later.
+const unsigned int dp_queue_max = 65536;
+
+/******************************************************************************************
+ * DistPoints - Looks for collisions between the rho walks that different clients run on the
+ *              slices of a split number. Every walk on a number uses the same polynomial, so
+ *              once two walks hit the same value mod a prime p they stay together mod p, and
+ *              the points they report afterward line up whenever their step offsets do.
+ *
+ *              A collision mod p leaves the two values different mod n, so it can't be found
+ *              by looking the value up. Each new point is instead multiplied, as a difference,
+ *              against every point other walks reported within the window, and a gcd of that
+ *              product with n exposes p. The hash table catches exact repeats (a resent
+ *              report, or walks that merged mod n), which carry no information.
+ *
+ *              That is thousands of modular multiplies per point, so none of it happens on
+ *              the thread that reports the point. addPoint only queues it, and a checker
+ *              thread multiplies queued points into a running product per number, taking the
+ *              gcd once per dp_gcd_batch points or once the queue runs dry. Only when a gcd
+ *              comes back nontrivial are that batch's differences gone through one by one,
+ *              to find the pair that collided and a proper divisor. The callback is made from
+ *              the checker thread with no lock held.
+ *
+ *    start/stop - start and stop the checker thread
+ *    addNumber/removeNumber - start and stop tracking a number
+ *    addPoint - queues a walk's point to be checked against the other walks
+ *
+ ******************************************************************************************/
+
+class DistPoints {
+public:
+   DistPoints(std::function<void(unsigned long walk, const LARGEINT &divisor)> collided);
+   ~DistPoints();
+
+   void start();
+   void stop();
+
+   void addNumber(unsigned long numid, LARGEINT n);
+   void removeNumber(unsigned long numid);
+
+   void addPoint(unsigned long numid, unsigned long walk, LARGEINT value);
+
+private:
+   struct Point {
+      LARGEINT value;
+      unsigned long walk;
+   };
+
+   // The points reported for one number. Only the checker thread touches anything but n.
+   struct WalkSet {
+      LARGEINT n;
+      std::unordered_map<LARGEINT, unsigned long, LargeIntHash> seen;   // value -> walk
+      std::deque<Point> window;
+      LARGEINT2X product = 1;      // differences multiplied in since the last gcd, mod n
+      unsigned int batched = 0;    // points at the back of the window that went into it
+   };
+
+   struct QueuedPoint {
+      unsigned long numid;
+      Point point;
+   };
+
+   void checkerLoop();
+   void multiplyIn(WalkSet &set, const Point &point);
+   bool checkBatch(WalkSet &set, unsigned long &walk, LARGEINT &divisor);
+
+   std::function<void(unsigned long walk, const LARGEINT &divisor)> _collided;
+
+   std::unordered_map<unsigned long, std::shared_ptr<WalkSet>> _numbers;
+   std::deque<QueuedPoint> _queue;
+   bool _stop = false;
+   std::mutex _lock;                 // guards _numbers, _queue and _stop
+   std::condition_variable _wake;
+
+   std::thread _checker;
+};
+
+#endif
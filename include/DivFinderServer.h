@@ -1,82 +1,108 @@
-#pragma once
-
-#ifndef DIVFINDERSERVER_H
-#define DIVFINDERSERVER_H
-
-#include <list>
-#include <string>
-#include <thread>
-#include <boost/multiprecision/cpp_int.hpp>
-
-using namespace boost::multiprecision;
-
-const unsigned int primecheck_depth = 10;
-
-/* "Unsigned int type to hold original value and calculations" */
-#define LARGEINT uint128_t
-//#define LARGEINT uint256_t uncomment for 256 bits
-
-/* "Unsigned int twice as large as LARGEINT (bit-wise)" */
-#define LARGEINT2X uint256_t
-
-/* "Signed int made of twice the bits as LARGEINT2X" */
-#define LARGESIGNED2X int512_t
-
-
-class DivFinderServer {
-public:
-    DivFinderServer();
-    DivFinderServer(LARGEINT input_value);
-    ~DivFinderServer();
-
-    // Overload me 
-    //virtual void PolRho() = 0;
-
-    LARGEINT getOrigVal() { return _orig_val; }
-
-    virtual void combinePrimes(std::list<LARGEINT>& dest);
-    LARGEINT calcPollardsRho(LARGEINT n);
- 
-    void setVerbose(int lvl);
-
-    std::list<LARGEINT> primes;
-
-    bool isPrimeBF(LARGEINT n, LARGEINT& divisor);
-
-    void simple();
-
-    void factor();
-
-    void factorSuper();
-
-    void factor(LARGEINT n); 
-    void factorThread(LARGEINT n);
-
-    void setEndProcess(bool inputBool) { this->end_process = inputBool; };
-
-    bool end_process = false;
-
-    LARGEINT getPrimeDivFound() { return this->primeDivFound; };
-
-
-
-
-protected:
-
-    LARGEINT2X modularPow(LARGEINT2X base, int exponent, LARGEINT2X modulus);
-    
-    int verbose = 0;
-
-    LARGEINT primeDivFound = 0;
-
-    // Do not forget, your constructor should call this constructor
-
-private:
-    // Prevent instantiation without calling initialization 
-
-    LARGEINT _orig_val;
-
-    // Stuff to be left alone
-};
-
+#pragma once
+
+#ifndef DIVFINDERSERVER_H
+#define DIVFINDERSERVER_H
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <random>
+#include <string>
+#include <thread>
+#include <boost/multiprecision/cpp_int.hpp>
+
+using namespace boost::multiprecision;
+
+const unsigned int primecheck_depth = 10;
+
+/* "Unsigned int type to hold original value and calculations" */
+#define LARGEINT uint128_t
+//#define LARGEINT uint256_t uncomment for 256 bits
+
+/* "Unsigned int twice as large as LARGEINT (bit-wise)" */
+#define LARGEINT2X uint256_t
+
+/* "Signed int made of twice the bits as LARGEINT2X" */
+#define LARGESIGNED2X int512_t
+
+/* "Hash so LARGEINT can key unordered containers" */
+struct LargeIntHash {
+    size_t operator()(const LARGEINT &n) const;
+};
+
+
+class DivFinderServer {
+public:
+    DivFinderServer();
+    DivFinderServer(LARGEINT input_value);
+    ~DivFinderServer();
+
+    // Overload me 
+    //virtual void PolRho() = 0;
+
+    LARGEINT getOrigVal() { return _orig_val; }
+
+    virtual void combinePrimes(std::list<LARGEINT>& dest);
+    LARGEINT calcPollardsRho(LARGEINT n);
+ 
+    void setVerbose(int lvl);
+
+    // Fixes the starting point and polynomial of the rho walks, so several clients given
+    // different seeds search different walks for the same number
+    void setSeed(uint64_t seed) { _rng.seed(seed); };
+
+    // Makes the first walk on the original number use polynomial constant c and call report
+    // with the walk's value every 2^dp_bits steps, so the server can look for collisions
+    // between walks on different clients that share c
+    void setDistinguished(LARGEINT c, unsigned int dp_bits, std::function<void(LARGEINT)> report);
+
+    std::list<LARGEINT> primes;
+
+    bool isPrimeBF(LARGEINT n, LARGEINT& divisor);
+    static bool isPrimeMR(LARGEINT n);
+
+    void simple();
+
+    void factor();
+
+    void factorSuper();
+
+    void factor(LARGEINT n); 
+    void factorThread(LARGEINT n);
+
+    void setEndProcess(bool inputBool) { this->end_process = inputBool; };
+
+    std::atomic<bool> end_process{false};
+
+    LARGEINT getPrimeDivFound() { return this->primeDivFound; };
+
+
+
+
+protected:
+
+    LARGEINT2X modularPow(LARGEINT2X base, int exponent, LARGEINT2X modulus);
+    
+    int verbose = 0;
+
+    LARGEINT primeDivFound = 0;
+
+    // Do not forget, your constructor should call this constructor
+
+private:
+    // Prevent instantiation without calling initialization 
+
+    LARGEINT _orig_val;
+
+    // Each instance has its own generator so concurrent walks don't share seeds
+    std::mt19937_64 _rng;
+
+    // Distinguished point reporting, off while _dp_c is 0
+    LARGEINT _dp_c = 0;
+    uint64_t _dp_mask = 0;
+    std::function<void(LARGEINT)> _dp_report;
+
+    // Stuff to be left alone
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef FACTORPOOL_H
+#define FACTORPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "DivFinderServer.h"
+#include "PrimeCache.h"
+
+// A number to factor and the id the caller uses to match up the answer. A nonzero seed fixes
+// the rho walk (the server gives each slice of a split number its own). A nonzero dp_c makes
+// the walk use that polynomial constant and report a point every 2^dp_bits steps.
+struct FactorJob {
+   unsigned long jobid;
+   LARGEINT num;
+   uint64_t seed = 0;
+   LARGEINT dp_c = 0;
+   unsigned int dp_bits = 0;
+};
+
+// A distinguished point reported by a running walk
+struct FactorPoint {
+   unsigned long jobid;
+   LARGEINT value;
+};
+
+// Most points held waiting to be collected; older ones are dropped past this
+const unsigned int max_held_points = 4096;
+
+// The outcome of a job. In full mode primes holds the complete factorization, otherwise it
+// holds the single prime divisor that was found
+struct FactorResult {
+   unsigned long jobid;
+   LARGEINT num;
+   std::list<LARGEINT> primes;
+};
+
+/******************************************************************************************
+ * FactorPool - A fixed set of worker threads that factor jobs from a shared queue. Jobs
+ *              complete in whatever order the workers finish them, so results carry the
+ *              job id they were submitted with.
+ *
+ *    submit - queues a job for the next free worker
+ *    getResult - returns a finished job if there is one, optionally waiting for it
+ *    cancel/cancelAll - drops queued jobs and stops running ones; no result is reported
+ *    inFlight - jobs submitted whose results have not been collected yet
+ *    getPoint - returns a distinguished point a walk reported, if there is one
+ *
+ *    If a PrimeCache is set, each job is checked against it before any rho work is done and
+ *    what the job finds is added to it.
+ *
+ *    If a CPU list is given, worker i is pinned to cpus[i % cpus.size()] so the scheduler
+ *    can't migrate it (see CpuTopology::getPlacement).
+ *
+ ******************************************************************************************/
+
+class FactorPool {
+public:
+   FactorPool(unsigned int num_workers, bool full_factor = true,
+              const std::vector<int> &cpus = std::vector<int>());
+   ~FactorPool();
+
+   void submit(unsigned long jobid, LARGEINT num, uint64_t seed = 0);
+   void submit(const FactorJob &job);
+   bool getResult(FactorResult &result, bool wait = false);
+   bool getPoint(FactorPoint &point);
+
+   void setCache(PrimeCache *cache) { _cache = cache; };
+
+   void cancel(unsigned long jobid);
+   void cancelAll();
+
+   unsigned int getNumWorkers() { return _workers.size(); };
+   size_t inFlight();
+
+   void shutdown();
+
+private:
+   void workerLoop(unsigned int worker);
+
+   bool _full_factor;
+   bool _shutdown = false;
+
+   PrimeCache *_cache = NULL;
+
+   std::vector<std::thread> _workers;
+
+   // The job each worker is running (NULL if idle) so cancel can reach it
+   std::vector<DivFinderServer *> _running;
+   std::vector<unsigned long> _running_ids;
+
+   std::deque<FactorJob> _queue;
+   std::deque<FactorResult> _results;
+   std::deque<FactorPoint> _points;
+   size_t _in_flight = 0;
+
+   std::mutex _lock;
+   std::condition_variable _job_ready;
+   std::condition_variable _result_ready;
+};
+
+#endif
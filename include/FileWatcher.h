@@ -0,0 +1,47 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+/******************************************************************************************
+ * FileWatcher - Calls back whenever a file is changed, using inotify on the file's
+ *               directory. Watching the directory rather than the file catches it being
+ *               replaced by a rename or recreated, and only writes that are finished (closed)
+ *               or complete files moved into place count. The callback runs on the watcher's
+ *               own thread, once per batch of events that names the file.
+ *
+ *    watch - starts collecting events. Anything that changes from here on is reported, so
+ *            call this before first reading the file.
+ *    start - starts the thread that calls back
+ *    stop - stops the thread and the watch
+ *
+ ******************************************************************************************/
+
+class FileWatcher {
+public:
+   FileWatcher(const std::string &filename, std::function<void()> changed);
+   ~FileWatcher();
+
+   bool watch();
+   void start();
+   void stop();
+
+private:
+   void watcherLoop();
+
+   std::string _filename;
+   std::string _dirname;    // where the file lives, which is what inotify watches
+   std::string _basename;
+   std::function<void()> _changed;
+
+   int _inotifyfd = -1;
+   int _wakefd = -1;        // eventfd that stop() writes to so the watcher's poll returns
+
+   std::thread _watcher;
+   std::atomic<bool> _running{false};
+};
+
+#endif
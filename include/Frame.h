@@ -0,0 +1,66 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include "DivFinderServer.h"
+
+// Frame types. The high bit is always set, so the first byte of a frame can never be mistaken
+// for the start of a text line and the two can share a connection.
+enum frametype : uint8_t { f_num = 0x81, f_quit = 0x82, f_ping = 0x83, f_pong = 0x84, f_div = 0x85,
+                           f_dp = 0x86 };
+
+// Every frame starts with: type (1 byte), reserved (1), body length (2), job id (8)
+const unsigned int frame_header_len = 12;
+
+// Bodies hold at most two numbers and a few fixed fields; anything longer is garbage
+const unsigned int frame_max_body = 128;
+
+// Numbers go out as 64-bit limbs, so this many hold a LARGEINT
+const unsigned int frame_max_limbs = (std::numeric_limits<LARGEINT>::digits + 63) / 64;
+
+/******************************************************************************************
+ * Frame - One message of the binary job protocol the server and client switch to once the
+ *         client has advertised frames=1 in its CAPS. Every field is little-endian and fixed
+ *         width, and numbers are a limb count followed by that many 64-bit limbs, least
+ *         significant first, so nothing on either end goes through a decimal string.
+ *
+ *            f_num   server -> client  a job: num, then seed (8 bytes), the polynomial
+ *                                      constant dp_c and dp_bits (1 byte). Whole jobs leave
+ *                                      seed and dp_c 0.
+ *            f_quit  server -> client  stop working on jobid, or on everything if it's 0
+ *            f_ping  server -> client  answer with f_pong
+ *            f_pong  client -> server
+ *            f_div   client -> server  num is the divisor found for jobid, 0 if none
+ *            f_dp    client -> server  num is a distinguished point from jobid's walk
+ *
+ *         Frames of a type we don't know are decoded (their length says how far to skip)
+ *         and left to the caller to ignore.
+ *
+ *    isFrameStart - true if a byte starts a frame rather than a text line
+ *    encodeFrame - appends a frame to a buffer
+ *    decodeFrame - decodes the frame at the start of a buffer in place, allocating nothing,
+ *                  and says how much of the buffer it took
+ *
+ ******************************************************************************************/
+
+struct Frame {
+   uint8_t type = 0;
+   uint64_t jobid = 0;
+   LARGEINT num = 0;
+   uint64_t seed = 0;
+   LARGEINT dp_c = 0;
+   unsigned int dp_bits = 0;
+};
+
+inline bool isFrameStart(char byte) { return (static_cast<uint8_t>(byte) & 0x80) != 0; };
+
+void encodeFrame(const Frame &frame, std::string &out);
+
+// Returns the bytes the frame took, 0 if the buffer doesn't hold all of it yet, or -1 if it's
+// malformed and the connection can't be trusted to stay in step
+int decodeFrame(const char *buf, size_t len, Frame &frame);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef IPWHITELIST_H
+#define IPWHITELIST_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FileWatcher.h"
+
+/******************************************************************************************
+ * IPWhitelist - The addresses allowed to connect, read from a file of IPv4 addresses and
+ *               CIDR ranges ("10.1.0.0/16"), separated by whitespace, with # starting a
+ *               comment. The file is compiled once into a binary trie over the 32 bits of the
+ *               address, so checking an address is a walk of at most 32 nodes that stops at
+ *               the first range covering it, with no disk or string work on the accept path.
+ *
+ *               Like the password database, the file is watched and a new trie is built off
+ *               to the side and swapped in whole when it changes. Entries that don't parse
+ *               are skipped with a warning. With no file, no one is allowed.
+ *
+ *    start - loads the file and starts watching it
+ *    stop - stops watching
+ *    isAllowed - true if an address (in network byte order, as SocketFD::getIPAddr gives
+ *                it) is covered by the list
+ *    reload - rereads the file now
+ *
+ ******************************************************************************************/
+
+class IPWhitelist {
+public:
+   IPWhitelist(const char *filename);
+   ~IPWhitelist();
+
+   void start();
+   void stop();
+
+   bool isAllowed(uint32_t ipaddr);
+   bool reload();
+
+private:
+   // A trie node; child 0 means no child, since the root is never anyone's child
+   struct TrieNode {
+      uint32_t child[2] = {0, 0};
+      bool allowed = false;
+   };
+
+   struct Trie {
+      Trie() : nodes(1) {};
+      void insert(uint32_t prefix, unsigned int bits);
+      bool contains(uint32_t addr) const;
+
+      std::vector<TrieNode> nodes;
+      unsigned int num_ranges = 0;
+   };
+
+   bool parse(const std::string &contents, Trie &trie);
+
+   std::string _filename;
+   FileWatcher _watcher;
+
+   // The current trie. Readers take a reference under the lock and walk it without, so a
+   // reload only holds the lock for the swap.
+   std::shared_ptr<const Trie> _trie;
+   std::mutex _trie_lock;
+};
+
+#endif
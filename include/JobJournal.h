@@ -0,0 +1,113 @@
+#ifndef JOBJOURNAL_H
+#define JOBJOURNAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileDesc.h"
+
+// How long the writer waits after the first record of a batch for more to arrive, so a burst
+// of records shares one fsync
+const unsigned int journal_linger_ms = 2;
+
+// Once the journal grows past this it is rewritten as a snapshot of what is still open
+const size_t journal_compact_bytes = 64 << 20;
+
+// How long the writer waits before retrying a batch it failed to write
+const unsigned int journal_retry_ms = 1000;
+
+/******************************************************************************************
+ * JobJournal - An append-only, crash-safe log of the job scheduler's changes, one text record
+ *              per line. The scheduler replays it at startup to pick up where it left off.
+ *
+ *              Appending only copies the record into a buffer. A writer thread takes
+ *              everything buffered in one go, writes it with a single write and fdatasyncs it
+ *              (group commit), so a burst of records costs one sync however many there are
+ *              and the event loops never wait on the disk.
+ *
+ *              Result lines go through the writer as well. They are written and synced to the
+ *              results file before the journal records that go with them, so a number the
+ *              journal says is written out really is. After a crash a result can be written
+ *              twice but is never lost.
+ *
+ *              A batch that fails to write or sync is cut back off the end of its file and
+ *              retried every journal_retry_ms, ahead of anything appended since, so a disk
+ *              hiccup delays records without losing or tearing them. Nothing is thrown at
+ *              the callers, which are the server's event loops.
+ *
+ *              Compaction swaps in a new journal holding a snapshot of the scheduler's open
+ *              work plus whatever was appended after it. The batch it goes out with is
+ *              appended to the old journal first, then the new one is written to a temp file,
+ *              synced and renamed over the old one. Until the rename the old journal is
+ *              complete and stays in use, so a failed swap (or a crash part way through) loses
+ *              nothing and is simply tried again once the journal has grown some more.
+ *
+ *    readRecords - reads every complete record, cutting off a torn one at the end
+ *    open - opens the journal for appending
+ *    start - starts the writer, which also writes to the results file
+ *    append - queues a record, with an optional result line
+ *    compact - replaces everything appended so far with a snapshot
+ *    flush - waits until everything appended so far is on disk, or a write fails
+ *    stop - flushes and stops the writer
+ *
+ *    Exceptions: runtime_error if the journal can't be read or opened
+ *
+ ******************************************************************************************/
+
+class JobJournal {
+public:
+   JobJournal(const char *filename);
+   ~JobJournal();
+
+   bool readRecords(std::vector<std::string> &records);
+   void open();
+   void start(FileFD *results);
+   void stop();
+
+   void append(const std::string &record, const std::string &result = "");
+   void compact(const std::string &snapshot);
+   bool needsCompaction();
+   bool flush();
+
+   unsigned long getNumSyncs();
+
+private:
+   void writerLoop();
+   bool writeAll(FileFD &fd, const std::string &data);
+   bool writeDurably(FileFD &fd, const std::string &data);
+   bool swapIn(const std::string &records);
+
+   std::string _filename;
+   std::unique_ptr<FileFD> _file;
+   FileFD *_results = NULL;
+
+   std::thread _writer;
+   std::mutex _lock;
+   std::condition_variable _wake;      // there is something to write, or we are stopping
+   std::condition_variable _synced;    // a batch made it to disk
+
+   // Records and result lines waiting for the writer
+   std::string _pending;
+   std::string _pending_results;
+
+   // A snapshot waiting to start a new journal, and how much of _pending it covers. The rest
+   // was appended after it and follows it in the new file.
+   std::string _snapshot;
+   size_t _snapshot_at = 0;
+
+   bool _compacting = false;    // a snapshot is queued or being written
+   size_t _compact_at = journal_compact_bytes;   // journal size that triggers the next one
+   bool _stop = false;
+   bool _failed = false;        // the last batch didn't make it to disk and is being retried
+
+   uint64_t _appended = 0;      // appends so far
+   uint64_t _durable = 0;       // appends known to be on disk
+   size_t _bytes = 0;           // size of the current journal file
+   unsigned long _syncs = 0;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DistPoints.h"
+#include "FileDesc.h"
+#include "JobJournal.h"
+
+// Pending jobs are kept in tiers by size, sched_tier_bits wide each, covering every size a
+// client can factor
+const unsigned int sched_tier_bits = 8;
+const unsigned int sched_num_tiers = 16;
+
+// How long we want a client to spend on one job when choosing its size
+const double sched_target_secs = 60.0;
+
+// Results are buffered and written out in blocks of about this size
+const unsigned int sched_outbufsize = 65536;
+
+// Bad results a job can get back before we give up on it
+const unsigned int sched_max_rejects = 3;
+
+// A job is straggling once it has run this many times longer than its client should need,
+// and never before sched_min_straggle_secs. Clients that never sent caps are assumed to need
+// sched_unknown_job_secs. The connection holding a job times it and tells the scheduler.
+const double sched_straggle_factor = 4.0;
+const double sched_min_straggle_secs = 2.0;
+const double sched_unknown_job_secs = 10.0;
+
+// Numbers at least this wide are split into slices that many clients work on at once, each
+// running rho from its own seed, up to sched_max_slices per number
+const unsigned int sched_split_bits = 72;
+const unsigned int sched_max_slices = 64;
+
+// A number handed to a client and the id its answer will come back with, and the submission
+// (number from the job file) it is part of. The number is kept both as text, for the journal
+// and results, and as an integer, for checking answers and sending it in frames. A slice of
+// a split number also carries the seed for its rho walk, the polynomial constant shared by
+// every walk on the number and the id of the number it came from.
+struct ServerJob {
+   unsigned long jobid;
+   std::string num;
+   LARGEINT value = 0;
+   unsigned int bits;
+   unsigned long root = 0;
+   unsigned int rejects = 0;
+   uint64_t seed = 0;
+   uint64_t dp_c = 0;
+   unsigned long parent = 0;
+   unsigned long twin = 0;      // speculative copy racing this job, if any
+   std::chrono::steady_clock::time_point queued;   // when it last went in a queue
+};
+
+// Told to stop a client working on a job that is no longer needed. Called with the
+// scheduler locked and from any thread, so it should just post the request and return.
+class JobCanceller {
+public:
+   virtual ~JobCanceller() {};
+   virtual void cancelJob(int fd, unsigned long jobid) = 0;
+};
+
+// Who a job was handed to: the connection's FD and whoever can cancel work on it
+struct JobOwner {
+   JobCanceller *canceller;
+   int fd;
+};
+
+/******************************************************************************************
+ * JobScheduler - Holds the server's queue of numbers to factor, hands them out to clients and
+ *                collects their answers. One scheduler is shared by every event loop thread in
+ *                the server, so every method locks.
+ *
+ *                Pending jobs sit in tiers by bit size. A client asks for the largest job it
+ *                can finish in about sched_target_secs, and a bitmask of non-empty tiers finds
+ *                it in constant time. If nothing that small is left, it gets the smallest job
+ *                there is.
+ *
+ *                A number sched_split_bits or wider stays at the front of its tier while
+ *                slices of it are handed out, each with a different rho seed so every client
+ *                searches a different walk. The first slice to come back with a divisor wins
+ *                and the rest are cancelled through their owner's JobCanceller. The walks
+ *                also report distinguished points, and a collision between two of them (see
+ *                DistPoints) wins the same way.
+ *
+ *                Every divisor that comes back is checked (it divides the number, and a number
+ *                answered with itself has to pass a primality test). The cofactor and any
+ *                composite divisor go back in the queue ahead of new work, and a number is only
+ *                written out once it is broken down into primes.
+ *
+ *                Connections time the jobs they hold against what their client's caps and
+ *                track record say they should take, and mark the late ones as straggling.
+ *                When a client wants work and none is pending, the oldest straggler gets a
+ *                speculative twin with a different seed. Whichever of the pair answers first
+ *                wins and the other is cancelled.
+ *
+ *                With a journal, every change that matters after a crash is logged as one
+ *                line:
+ *                   S <root> <num> - a number was submitted
+ *                   D <root> <num> <divisor> - a part of submission root was split by divisor
+ *                   G <root> <num> - a part was given up on
+ *                   C <root> - the submission was written to the results file
+ *                and a snapshot of what is still open uses:
+ *                   N <root> <num> - a submission
+ *                   P <root> <prime>, U <root> <num> - its prime and given up parts so far
+ *                   J <root> <num> - an open part of it
+ *                Replaying these through the same code that made them rebuilds the queue.
+ *                Assignments are not logged, since the connections they belong to don't
+ *                survive a restart; every open part is simply queued again.
+ *
+ *    openJournal - replays a journal and logs to it from then on
+ *    loadJobs - queues every number in a file, one per line
+ *    addJob - queues a single number
+ *    setOutput - opens the file results are written to (appending when resuming)
+ *    nextJob - assigns the next job to a client, with a server-wide unique job id
+ *    reportResult - checks a client's answer for a job it was sent and queues any composite
+ *                   part that is left as a new job. A late answer, from a client that has
+ *                   reconnected since the job was requeued, is taken only if it's good.
+ *    requeue - puts an unanswered job back at the front of the queue (client went away)
+ *    markStraggling - flags a job as late so an idle client can be given a twin of it
+ *    flushResults - writes any buffered results out
+ *    stop - stops looking for collisions, after which nothing calls a JobCanceller from off
+ *           the event loops. Must be called before the cancellers go away.
+ *
+ *    Exceptions: runtime_error if the job or results file can't be opened, or the job file
+ *                can't be read. Failed result writes are logged and retried, never thrown,
+ *                since answers are reported from the event loops.
+ *
+ ******************************************************************************************/
+
+class JobScheduler {
+public:
+   JobScheduler();
+   ~JobScheduler();
+
+   unsigned long loadJobs(const char *filename);
+   bool addJob(const std::string &num);
+   void setOutput(const char *filename, bool append = false);
+   bool openJournal(const char *filename);
+
+   bool nextJob(unsigned int max_bits, const JobOwner &owner, ServerJob &job);
+   bool reportResult(unsigned long jobid, const LARGEINT &divisor, bool late = false);
+   bool reportPoint(unsigned long jobid, LARGEINT value);
+   void requeue(unsigned long jobid);
+   void markStraggling(unsigned long jobid);
+
+   bool flushResults();
+   void stop();
+
+   size_t getNumPending();
+   size_t getNumOutstanding();
+
+private:
+   // Slices handed out for a split number
+   struct SplitJob {
+      unsigned int slices_left = sched_max_slices;   // still to be handed out
+      uint64_t dp_c = 0;                               // polynomial constant every walk uses
+      std::vector<unsigned long> slices;
+   };
+
+   // A number from the job file and the parts of it found so far
+   struct Submission {
+      std::string num;
+      std::list<LARGEINT> primes;
+      std::list<LARGEINT> unfactored;   // parts we gave up on
+      unsigned int open_parts = 0;      // jobs for it still queued or out
+   };
+
+   bool queueJob(const std::string &num, unsigned long root = 0);
+   ServerJob &newJob(LARGEINT value, unsigned long root, bool front);
+   bool checkDivisor(const LARGEINT &n, const LARGEINT &d);
+   void completeJob(ServerJob &job, LARGEINT d);
+   void rejectJob(ServerJob &job, const LARGEINT &divisor);
+   void giveUpJob(ServerJob &job);
+   void closePart(unsigned long root);
+   unsigned int getTier(unsigned int bits);
+   void pushPending(ServerJob &job, bool front);
+   void popPending(unsigned int tier);
+   bool finishSlice(ServerJob &slice, bool won);
+   void pointsCollided(unsigned long jobid, const LARGEINT &divisor);
+
+   void replay(const std::vector<std::string> &records);
+   void snapshot(std::string &snap);
+
+   bool unassign(unsigned long jobid, JobOwner *owner = NULL);
+   bool speculate(const JobOwner &owner, ServerJob &job);
+   void dropTwin(ServerJob &job);
+
+   std::mutex _lock;
+
+   unsigned long _next_jobid = 1;
+
+   // Every job not answered yet, pending or assigned, by job id
+   std::unordered_map<unsigned long, ServerJob> _jobs;
+
+   // Numbers from the job file that aren't fully factored yet, by their first job's id
+   std::unordered_map<unsigned long, Submission> _submissions;
+
+   // Who each assigned job went to, and the assigned jobs that are straggling, oldest first.
+   // Straggler ids that were answered or twinned since are skipped when they come up.
+   std::unordered_map<unsigned long, JobOwner> _owners;
+   std::deque<unsigned long> _stragglers;
+
+   // Split numbers by job id, and where their slice seeds come from
+   std::unordered_map<unsigned long, SplitJob> _splits;
+   std::mt19937_64 _rng;
+
+   // Points reported by the walks on split numbers
+   DistPoints _points;
+
+   // Job ids waiting to be assigned, by tier, and a bit per tier that has any. Ids of jobs
+   // answered while still queued are left in place and skipped when they reach the front.
+   std::deque<unsigned long> _tiers[sched_num_tiers];
+   uint32_t _tier_mask = 0;
+   size_t _num_pending = 0;
+
+   // Change log, if there is one, which also writes the results once it is running. Result
+   // lines that come up while replaying wait in _replay_out until we know the journal
+   // didn't already see them written.
+   std::unique_ptr<JobJournal> _journal;
+   bool _replaying = false;
+   std::string *_log_batch = NULL;    // set while a job file's records are being gathered
+   std::unordered_map<unsigned long, std::string> _replay_out;
+
+   // Results formatted but not written yet. Swapped out under _lock, written under _out_lock
+   std::unique_ptr<FileFD> _outfile;
+   std::string _outbuf;
+   std::mutex _out_lock;
+};
+
+#endif
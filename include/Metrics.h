@@ -0,0 +1,145 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JobScheduler.h"
+#include "AuthService.h"
+#include "RateLimiter.h"
+
+// Histograms keep 2^hist_sub_bits buckets per power of two, so a value is reported to within
+// 1/2^hist_sub_bits (about 6%) of what was recorded, from 1 up to 2^64
+const unsigned int hist_sub_bits = 4;
+const unsigned int hist_buckets = (64 - hist_sub_bits + 1) << hist_sub_bits;
+
+// How often the dump file is rewritten and the jobs per second rate is worked out
+const unsigned int default_metrics_secs = 10;
+
+// Counted events
+enum countertype { c_conns_accepted, c_conns_refused, c_conns_limited, c_conns_closed, c_auth_ok,
+                   c_auth_failed, c_auth_busy, c_auth_limited, c_auth_ticket, c_ticket_rejected, c_jobs_sent, c_jobs_answered,
+                   c_jobs_cancelled, c_num_counters };
+
+// Recorded distributions: how long jobs waited in the queue, from being sent to the answer
+// coming back and from accept to login, how long password checks waited for a hashing thread
+// and took to hash, and how fast clients are really iterating
+enum histtype { h_queue_wait_us, h_job_latency_us, h_auth_latency_us, h_auth_wait_us, h_auth_hash_us,
+                h_iter_rate, h_num_hists };
+
+/******************************************************************************************
+ * Histogram - An HDR-style log-linear histogram. Values under 2^hist_sub_bits get their own
+ *             bucket, and every power of two above that is split into 2^hist_sub_bits
+ *             buckets, so recording is a couple of shifts and one add with a fixed relative
+ *             error.
+ *
+ *             Only one thread records into a histogram; readers on other threads may see a
+ *             record half applied (count bumped but not its bucket), which is fine for
+ *             monitoring.
+ *
+ ******************************************************************************************/
+
+class Histogram {
+public:
+   void record(uint64_t value);
+   void mergeInto(std::vector<uint64_t> &buckets, uint64_t &count, uint64_t &sum, uint64_t &max);
+
+   static unsigned int getBucket(uint64_t value);
+   static uint64_t getBucketTop(unsigned int bucket);
+
+private:
+   std::atomic<uint64_t> _buckets[hist_buckets] = {};
+   std::atomic<uint64_t> _count{0};
+   std::atomic<uint64_t> _sum{0};
+   std::atomic<uint64_t> _max{0};
+};
+
+/******************************************************************************************
+ * MetricShard - The counters and histograms one thread records into. Each event loop has its
+ *               own, so recording never shares a cache line with another thread or needs a
+ *               locked instruction; the reporter adds the shards up when it reads them.
+ *
+ ******************************************************************************************/
+
+struct alignas(64) MetricShard {
+   void count(countertype counter, uint64_t amount = 1) {
+      _counters[counter].store(_counters[counter].load(std::memory_order_relaxed) + amount,
+                               std::memory_order_relaxed);
+   };
+   void record(histtype hist, uint64_t value) { _hists[hist].record(value); };
+
+   std::atomic<uint64_t> _counters[c_num_counters] = {};
+   Histogram _hists[h_num_hists];
+};
+
+/******************************************************************************************
+ * Metrics - The server's counters and latency histograms, sharded by thread, and a reporter
+ *           thread that shows them. The report is plain text, one metric per line, and can
+ *           be read by connecting to a local (unix domain) admin socket or from a dump file
+ *           the reporter rewrites every few seconds.
+ *
+ *    addShard - gives a recording thread its own shard
+ *    setScheduler - where to read job queue depths from
+ *    setAuth - where to read the password check queue depth from
+ *    setLimiter - where to read how many hosts are being rate limited from
+ *    start - starts the reporter, listening on admin_path and dumping to dump_path (either
+ *            may be empty to leave it out)
+ *    stop - stops the reporter and removes the admin socket
+ *    report - writes the current report into a string
+ *
+ *    Exceptions: socket_error if the admin socket can't be set up
+ *
+ ******************************************************************************************/
+
+class Metrics {
+public:
+   Metrics();
+   ~Metrics();
+
+   MetricShard &addShard();
+   void setScheduler(JobScheduler *scheduler) { _scheduler = scheduler; };
+   void setAuth(AuthService *auth) { _auth = auth; };
+   void setLimiter(RateLimiter *limiter) { _limiter = limiter; };
+
+   void start(const std::string &admin_path, const std::string &dump_path,
+              unsigned int interval_secs = default_metrics_secs);
+   void stop();
+
+   void report(std::string &out);
+
+private:
+   void reporterLoop();
+   void openAdminSocket();
+   void serveAdmin();
+   void writeDump();
+   void updateRate();
+
+   std::vector<std::unique_ptr<MetricShard>> _shards;
+   std::mutex _shard_lock;
+
+   JobScheduler *_scheduler = NULL;
+   AuthService *_auth = NULL;
+   RateLimiter *_limiter = NULL;
+   std::chrono::steady_clock::time_point _started;
+
+   std::string _admin_path;
+   std::string _dump_path;
+   unsigned int _interval_secs = default_metrics_secs;
+   int _adminfd = -1;
+   int _wakefd = -1;       // eventfd that stop() writes to so the reporter's poll returns
+
+   std::thread _reporter;
+   std::atomic<bool> _running{false};
+
+   // Answered jobs at the start of the current interval, and the rate over the last one
+   uint64_t _rate_base = 0;
+   std::chrono::steady_clock::time_point _rate_time;
+   std::atomic<double> _jobs_per_sec{0.0};
+};
+
+#endif
@@ -1,35 +1,61 @@
-#ifndef PASSWDMGR_H
-#define PASSWDMGR_H
-
-#include <string>
-#include <stdexcept>
-#include "FileDesc.h"
-
-/****************************************************************************************
- * PasswdMgr - Manages user authentication through a file
- *
- ****************************************************************************************/
-
-class PasswdMgr {
-   public:
-      PasswdMgr(const char *pwd_file);
-      ~PasswdMgr();
-
-      bool checkUser(const char *name);
-      bool checkPasswd(const char *name, const char *passwd);
-      bool changePasswd(const char *name, const char *newpassd);
-   
-      void addUser(const char *name, const char *passwd);
-
-      void hashArgon2(std::vector<uint8_t> &ret_hash, std::vector<uint8_t> &ret_salt, const char *passwd, 
-                                                                                 std::vector<uint8_t> *in_salt = NULL);
-
-   private:
-      bool findUser(const char *name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt);
-      bool readUser(FileFD &pwfile, std::string &name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt);
-      int writeUser(FileFD &pwfile, std::string &name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt);
-
-      std::string _pwd_file;
-};
-
-#endif
+#ifndef PASSWDMGR_H
+#define PASSWDMGR_H
+
+#include <string>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "FileDesc.h"
+
+// A user's password hash and salt as stored in the password file
+struct PasswdEntry {
+   std::vector<uint8_t> hash;
+   std::vector<uint8_t> salt;
+};
+
+// The password file's record layout and a mapped view of it, private to PasswdMgr.cpp
+struct PasswdRecord;
+struct PasswdView;
+
+/****************************************************************************************
+ * PasswdMgr - Manages user authentication through a file. The file is a hash table of
+ *             fixed-size records, mapped to look a user up and written in place with pwrite,
+ *             so a lookup is a probe or two and a password change is one write. Files in the
+ *             old line-based format are converted when first opened.
+ *
+ ****************************************************************************************/
+
+class PasswdMgr {
+   public:
+      PasswdMgr(const char *pwd_file);
+      ~PasswdMgr();
+
+      bool checkUser(const char *name);
+      bool checkPasswd(const char *name, const char *passwd);
+      bool changePasswd(const char *name, const char *newpassd);
+   
+      void addUser(const char *name, const char *passwd);
+      unsigned int addUsers(std::vector<std::pair<std::string, std::string>> &accounts, unsigned int num_threads);
+      void readAll(std::unordered_map<std::string, PasswdEntry> &users);
+
+      void hashArgon2(std::vector<uint8_t> &ret_hash, std::vector<uint8_t> &ret_salt, const char *passwd, 
+                                                                                 std::vector<uint8_t> *in_salt = NULL);
+      static bool warmArena();
+
+   private:
+      bool findUser(const char *name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt);
+      int writeUser(FileFD &pwfile, long slot, std::string &name, std::vector<uint8_t> &hash,
+                    std::vector<uint8_t> &salt);
+      void fillRecord(PasswdRecord &record, const std::string &name, const std::vector<uint8_t> &hash,
+                      const std::vector<uint8_t> &salt);
+
+      void openDB(PasswdView &view);
+      void readLegacy(const uint8_t *data, size_t len, std::unordered_map<std::string, PasswdEntry> &users);
+      void writeDB(const std::unordered_map<std::string, PasswdEntry> &users, uint32_t min_capacity = 0);
+      void newSalt(std::vector<uint8_t> &salt);
+
+      std::string _pwd_file;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef PRIMECACHE_H
+#define PRIMECACHE_H
+
+#include <list>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DivFinderServer.h"
+#include "FileDesc.h"
+
+// Default cache file and size cap
+const char default_cachefile[] = "primes.cache";
+const unsigned int default_cache_mb = 64;
+
+// Known primes are multiplied together into products of about this many bits. A gcd of a
+// new number against each product finds every known prime that divides it.
+const unsigned int prod_chunk_bits = 4096;
+
+// Identifies the file format on disk
+const char cache_magic[8] = {'P', 'C', 'A', 'C', 'H', 'E', '0', '1'};
+
+/******************************************************************************************
+ * PrimeCache - A client's local, persistent store of the primes and factorizations it has
+ *              found, so jobs that share factors (and restarts) don't rediscover them.
+ *
+ *              On disk it is a small header followed by fixed-size records of
+ *              (number, prime divisor) pairs, where a prime is stored as (p, p). New records
+ *              are appended as they are found; a torn final record from a crash is ignored.
+ *              The file is mmap'd once at startup to load it.
+ *
+ *    load - maps the cache file and loads every record
+ *    lookup - finds the known prime divisors of n, by exact match or by gcd against the
+ *             products of known primes
+ *    add - records a number's prime divisors and appends them to the file
+ *
+ *    Exceptions: runtime_error if the cache file exists but is not a cache file
+ *
+ ******************************************************************************************/
+
+class PrimeCache {
+public:
+   PrimeCache(const char *filename, unsigned int max_mb = default_cache_mb);
+   ~PrimeCache();
+
+   void load();
+
+   bool lookup(LARGEINT n, std::list<LARGEINT> &divisors);
+   void add(LARGEINT n, const std::list<LARGEINT> &primes);
+
+   size_t getNumRecords();
+
+private:
+   bool insert(LARGEINT n, LARGEINT p);
+   void addToProducts(LARGEINT p);
+
+   void packLargeInt(LARGEINT n, std::vector<uint8_t> &buf);
+   LARGEINT unpackLargeInt(const uint8_t *buf);
+
+   std::string _filename;
+   FileFD _cachefile;
+
+   size_t _max_records;
+   size_t _num_records = 0;
+   size_t _num_bytes;      // bytes per stored number
+   bool _writable = false;
+
+   // Number -> prime divisors we know for it
+   std::unordered_map<LARGEINT, std::vector<LARGEINT>, LargeIntHash> _known;
+
+   // Running products of every known prime, each about prod_chunk_bits wide, and the
+   // primes that went into each one
+   std::vector<cpp_int> _products;
+   std::vector<std::vector<LARGEINT>> _chunk_primes;
+
+   std::shared_timed_mutex _lock;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Source addresses tracked at once (a power of two). The table is never more than 3/4 full;
+// addresses past that are let through untracked rather than slowing every accept down.
+const unsigned int ratelimit_slots = 16384;
+
+// Token buckets per source address: how many can be done at once, and how fast that refills.
+// Connects are generous since a host may run several clients; password attempts each cost an
+// Argon2 hash, so they are held much tighter. Ticket logins don't hash and aren't limited.
+const float conn_burst = 64;
+const float conn_per_sec = 8;
+const float auth_burst = 16;
+const float auth_per_sec = 1;
+
+// How often addresses whose buckets have refilled are dropped from the table
+const unsigned int ratelimit_sweep_secs = 30;
+
+// What is being limited
+enum limittype { l_connect, l_auth, l_num_limits };
+
+/******************************************************************************************
+ * RateLimiter - Per source address token buckets, so one host retrying connections or
+ *               passwords can't tie up the accept path or the hashing threads. Each address
+ *               gets a bucket per kind of limit; every admit takes a token, and tokens refill
+ *               at a steady rate up to the burst size. Buckets only refill when touched, so an
+ *               idle address costs nothing.
+ *
+ *               Addresses live in one flat open-addressing table (linear probing, 24 byte
+ *               slots) rather than a node per address, so a check is a hash and a probe or
+ *               two in memory that was allocated up front. An address whose buckets have
+ *               filled back up is no different from one we've never seen, so a sweep every
+ *               ratelimit_sweep_secs, or sooner if the table fills, rebuilds the table
+ *               without them.
+ *
+ *               Shared by every reactor, since a host's connections can land on any of them.
+ *               A check holds the lock for well under a microsecond.
+ *
+ *    admit - takes a token from the address's bucket, or says it's out of them
+ *    getTracked - how many addresses are in the table
+ *
+ ******************************************************************************************/
+
+class RateLimiter {
+public:
+   RateLimiter(unsigned int slots = ratelimit_slots);
+
+   bool admit(uint32_t ipaddr, limittype kind);
+   size_t getTracked();
+
+private:
+   struct Entry {
+      uint32_t ipaddr;                  // 0 marks an empty slot; no client connects from 0.0.0.0
+      float tokens[l_num_limits];
+      uint64_t touched_ms;              // when the tokens were last brought up to date
+   };
+
+   Entry *findEntry(uint32_t ipaddr, uint64_t now_ms);
+   void refill(Entry &entry, uint64_t now_ms);
+   void sweep(uint64_t now_ms);
+   uint64_t getNowMs();
+
+   std::vector<Entry> _table;
+   uint32_t _mask;
+   size_t _used = 0;
+   uint64_t _last_sweep_ms = 0;
+   uint64_t _idle_ms;                   // time for every bucket to refill from empty
+   std::chrono::steady_clock::time_point _started;
+   std::mutex _lock;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "FileDesc.h"
+#include "JobScheduler.h"
+#include "TCPConn.h"
+#include "TimerWheel.h"
+#include "Metrics.h"
+#include "AuthService.h"
+#include "RateLimiter.h"
+#include "IPWhitelist.h"
+
+// Most events handled per epoll_wait call
+const int max_epoll_events = 256;
+
+// How often idle connections are offered work again, so they can pick up twins of straggling
+// jobs even when nothing else wakes them
+const unsigned int reactor_tick_ms = 1000;
+
+// Timer kind for the reactor's own tick; it has no FD
+const int reactor_timer_tick = -1;
+
+/******************************************************************************************
+ * Reactor - An edge-triggered epoll event loop. It owns the listening socket and every
+ *           connection accepted on it, and only calls handleConnection on connections the
+ *           kernel reports as ready, so a pass costs O(ready) rather than O(connected).
+ *
+ *           The server can run several reactors, one per thread, each with its own
+ *           SO_REUSEPORT listening socket on the same port and its own connections. They
+ *           share the job scheduler.
+ *
+ *           Each reactor has a timer wheel its connections use for login timeouts,
+ *           heartbeats and job deadlines. epoll_wait sleeps until the next timer is due, and
+ *           a fired timer goes back to the connection whose FD it carries.
+ *
+ *           Everything the reactor and its connections count goes in the reactor's own metric
+ *           shard.
+ *
+ *           Connections queue what the socket won't take yet, and the reactor finishes sending
+ *           it when epoll says the socket is writable again.
+ *
+ *    bindListener - creates the listening socket and binds it
+ *    run - listens and loops handling events until stop() is called
+ *    stop - makes run() return after the current pass; safe to call from any thread
+ *    cancelJob - has a connection tell its client to drop a job; safe to call from any thread
+ *    passwdChecked - hands a connection the result of its password check; safe to call from
+ *                    any thread
+ *
+ *    Exceptions: socket_error if epoll or the listening socket fail
+ *
+ ******************************************************************************************/
+
+class Reactor : public JobCanceller, public AuthWaiter {
+public:
+   Reactor(JobScheduler &scheduler, MetricShard &stats, AuthService &auth, RateLimiter &limiter,
+           IPWhitelist &whitelist);
+   ~Reactor();
+
+   void bindListener(const char *ip_addr, unsigned short port, bool reuse_port = false,
+                     int backlog = SOMAXCONN);
+   void run();
+   void stop();
+
+   void cancelJob(int fd, unsigned long jobid);
+   void passwdChecked(int fd, uint64_t ticket, bool ok, uint64_t wait_us, uint64_t hash_us);
+
+   size_t getNumConns() { return _conns.size(); };
+
+private:
+   void addFD(int fd, bool writes = false);
+   void acceptConnections();
+   void handleEvent(int fd, uint32_t events);
+   void wake();
+   void handleWake();
+   void handleTimers();
+   void handleTick();
+   void dropIfDisconnected(std::unordered_map<int, std::unique_ptr<TCPConn>>::iterator conn);
+
+   int _epfd;
+   int _wakefd;      // eventfd that other threads write to so epoll_wait returns
+
+   JobScheduler &_scheduler;
+   MetricShard &_stats;    // This thread's counters and histograms
+   AuthService &_auth;     // Shared by every reactor
+   RateLimiter &_limiter;  // Also shared, since one host's connections can land on any reactor
+   IPWhitelist &_whitelist;
+
+   // Class to manage the server socket
+   SocketFD _listenfd;
+   int _backlog = SOMAXCONN;
+
+   // Connections, keyed by the FD they were registered with
+   std::unordered_map<int, std::unique_ptr<TCPConn>> _conns;
+
+   std::atomic<bool> _online;
+
+   TimerWheel _timers;
+   std::vector<TimerEvent> _fired;
+
+   // Cancellations posted by other threads, as (connection FD, job id), and password checks
+   // the hashing threads have finished
+   struct PasswdResult {
+      int fd;
+      uint64_t ticket;
+      bool ok;
+      uint64_t wait_us;
+      uint64_t hash_us;
+   };
+   std::vector<std::pair<int, unsigned long>> _cancels;
+   std::vector<PasswdResult> _passwd_results;
+   std::mutex _post_lock;
+};
+
+#endif
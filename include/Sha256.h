@@ -0,0 +1,40 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const unsigned int sha256_len = 32;
+const unsigned int sha256_block = 64;
+
+/******************************************************************************************
+ * Sha256 - SHA-256 (FIPS 180-4), fed in pieces with update and read out with finish. Used
+ *          to sign session tickets, where the server only ever hashes a few dozen bytes, so
+ *          this is the plain reference algorithm with nothing clever.
+ *
+ *    update - hashes in len more bytes
+ *    finish - pads out the message and writes the 32 byte digest. The object is spent after.
+ *
+ ******************************************************************************************/
+
+class Sha256 {
+public:
+   Sha256();
+
+   void update(const void *data, size_t len);
+   void finish(uint8_t digest[sha256_len]);
+
+private:
+   void compress(const uint8_t block[sha256_block]);
+
+   uint32_t _state[8];
+   uint8_t _buf[sha256_block];
+   size_t _buflen = 0;
+   uint64_t _total = 0;     // bytes hashed so far, for the length in the padding
+};
+
+// HMAC-SHA256 (RFC 2104) of data under key
+void hmacSha256(const std::vector<uint8_t> &key, const void *data, size_t len, uint8_t mac[sha256_len]);
+
+#endif
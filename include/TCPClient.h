@@ -1,48 +1,101 @@
-#ifndef TCPCLIENT_H
-#define TCPCLIENT_H
-
-#include <string>
-#include "Client.h"
-#include "FileDesc.h"
-#include "DivFinderServer.h"
-
-// The amount to read in before we send a packet
-const unsigned int stdin_bufsize = 50;
-const unsigned int socket_bufsize = 100;
-
-class TCPClient : public Client
-{
-public:
-   TCPClient();
-   ~TCPClient();
-
-   virtual void connectTo(const char *ip_addr, unsigned short port);
-   virtual void handleConnection();
-
-   virtual void closeConn();
-
-   std::string inputNum;
-
-   bool initMessage = true;
-   bool activeThread = false;
-
-   DivFinderServer d;
-
-   std::thread* th;
-
-private:
-   int readStdin();
-
-   // Stores the user's typing
-   std::string _in_buf;
-
-   // Class to manage our client's network connection
-   SocketFD _sockfd;
- 
-   // Manages the stdin FD for user inputs
-   TermFD _stdin;
-
-};
-
-
-#endif
+#ifndef TCPCLIENT_H
+#define TCPCLIENT_H
+
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <list>
+#include "Client.h"
+#include "FileDesc.h"
+#include "DivFinderServer.h"
+#include "FactorPool.h"
+#include "ClientCaps.h"
+#include "Frame.h"
+
+// The amount to read in before we send a packet, and the most we read off the socket at once
+const unsigned int stdin_bufsize = 50;
+const unsigned int socket_bufsize = 4096;
+
+// Reconnect backoff: first retry delay and the default cap (ms)
+const unsigned int min_backoff_ms = 250;
+const unsigned int default_max_backoff_ms = 30000;
+
+class TCPClient : public Client
+{
+public:
+   TCPClient(unsigned int workers = 0, const std::vector<int> &cpus = std::vector<int>(),
+             PrimeCache *cache = NULL);
+   ~TCPClient();
+
+   virtual void connectTo(const char *ip_addr, unsigned short port);
+   virtual void handleConnection();
+
+   virtual void closeConn();
+
+   void setLogin(const char *username, const char *passwd);
+   void setMaxBackoff(unsigned int max_backoff_ms) { _max_backoff_ms = max_backoff_ms; };
+
+private:
+   int readStdin();
+
+   void lostConnection();
+   bool reconnect();
+   void sendMsg(const std::string &msg);
+   void flushResults();
+
+   void handleServerData();
+   bool getServerLine(std::string &line);
+   void handleServerMsg(std::string &msg);
+   void handleServerFrame(const Frame &frame);
+   void sendResults();
+
+   // Stores the user's typing
+   std::string _in_buf;
+
+   // Class to manage our client's network connection
+   SocketFD _sockfd;
+ 
+   // Manages the stdin FD for user inputs
+   TermFD _stdin;
+
+   // Partial server messages waiting on a newline or the rest of their frame
+   std::string _sock_buf;
+
+   // Calibrated capabilities we advertise when the server asks
+   ClientCaps _caps;
+
+   // Works the jobs the server prefetches to us, one per worker thread
+   FactorPool _pool;
+
+   // Where we're connected to and the login we answer the server's prompts with
+   std::string _ip_addr;
+   unsigned short _port = 0;
+   std::string _username;
+   std::string _passwd;
+
+   // Session ticket from our last login, which logs us back in without the password
+   std::string _ticket;
+
+   // _connected is the TCP link, _session is set once the server has logged us in and asked
+   // for our CAPS, which is when it is ready to take results
+   bool _connected = false;
+   bool _session = false;
+
+   // Set once the server has sent us a frame, which means it takes frames back
+   bool _frames = false;
+
+   // Results (as f_div frames) that finished while we had no session, in the order they
+   // finished
+   std::deque<Frame> _unsent;
+
+   // Exponential backoff between reconnect attempts, 0 max means don't reconnect
+   unsigned int _max_backoff_ms = default_max_backoff_ms;
+   unsigned int _backoff_ms = min_backoff_ms;
+   std::chrono::steady_clock::time_point _next_attempt;
+   std::mt19937 _rng;
+
+};
+
+
+#endif
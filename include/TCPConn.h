@@ -1,69 +1,154 @@
-#ifndef TCPCONN_H
-#define TCPCONN_H
-
-#include "FileDesc.h"
-#include "PasswdMgr.h"
-
-
-const int max_attempts = 2;
-
-// Methods and attributes to manage a network connection, including tracking the username
-// and a buffer for user input. Status tracks what "phase" of login the user is currently in
-class TCPConn 
-{
-public:
-   TCPConn(/* LogMgr &server_log*/);
-   ~TCPConn();
-
-   bool accept(SocketFD &server);
-
-   int sendText(const char *msg);
-   int sendText(const char *msg, int size);
-
-   void handleConnection();
-   void startAuthentication();
-   void getUsername();
-   void getPasswd();
-   void sendMenu();
-   void getMenuChoice();
-   void setPassword();
-   void changePassword();
-   
-   bool getUserInput(std::string &cmd);
-
-   void disconnect();
-   bool isConnected();
-
-   unsigned long getIPAddr() { return _connfd.getIPAddr(); };
-   void getIPAddrStr(std::string &buf);
-   const char *getUsernameStr() { return _username.c_str(); };
-
-   bool isNewIPAllowed(std::string inputIP);
-
-   void sendNumber();
-
-   void waitForDivisor();
-
-   int dbNum = 0;
-private:
-   
-
-   enum statustype { s_username, s_changepwd, s_confirmpwd, s_passwd, s_menu, s_sendNumber, s_waitForReply };
-
-   statustype _status = s_username;
-
-   SocketFD _connfd;
- 
-   std::string _username; // The username this connection is associated with
-
-   std::string _inputbuf;
-
-   std::string _newpwd; // Used to store user input for changing passwords
-
-   int _pwd_attempts = 0;
-
-   std::unique_ptr<PasswdMgr> PWMgr;
-};
-
-
-#endif
+#ifndef TCPCONN_H
+#define TCPCONN_H
+
+#include <chrono>
+#include <unordered_map>
+#include "FileDesc.h"
+#include "AuthService.h"
+#include "RateLimiter.h"
+#include "ClientCaps.h"
+#include "JobScheduler.h"
+#include "TimerWheel.h"
+#include "Metrics.h"
+
+
+const int max_attempts = 2;
+
+// Bytes pulled off the socket per read call
+const unsigned int conn_readsize = 4096;
+
+// Most output a client can leave unread before we give up on it. Well above a full prefetch of
+// jobs, so only a client that has stopped reading gets near it.
+const unsigned int conn_max_outbuf = 1 << 20;
+
+// Weight of each answered job in a client's running slowness, and the bounds a single job's
+// ratio is clamped to so one outlier can't swing it
+const double slowness_weight = 0.2;
+const double min_slowness = 0.1;
+const double max_slowness = 100.0;
+
+// Seconds a client gets to log in, and how long a logged in client can stay silent before we
+// ping it. One that doesn't answer the ping within another heartbeat_secs is dropped.
+const unsigned int auth_timeout_secs = 30;
+const unsigned int heartbeat_secs = 30;
+
+// Methods and attributes to manage a network connection, including tracking the username
+// and a buffer for user input. Status tracks what "phase" of login the user is currently in
+class TCPConn 
+{
+public:
+   TCPConn(JobScheduler &scheduler, JobCanceller &canceller, TimerWheel &timers,
+           MetricShard &stats, AuthService &auth, AuthWaiter &auth_waiter,
+           RateLimiter &limiter /*, LogMgr &server_log*/);
+   ~TCPConn();
+
+   bool accept(SocketFD &server);
+
+   int sendText(const char *msg);
+   int sendText(const std::string &msg);
+   int sendText(const char *msg, int size);
+   bool flushOutput();
+
+   void handleConnection();
+   void startAuthentication();
+   void getUsername();
+   void getPasswd();
+   void passwdChecked(uint64_t ticket, bool ok);
+   void sendMenu();
+   void getMenuChoice();
+   void setPassword();
+   void changePassword();
+   
+   bool getUserInput(std::string &cmd);
+
+   void disconnect();
+   bool isConnected();
+
+   int getFD() { return _connfd.getFD(); };
+
+   unsigned long getIPAddr() { return _connfd.getIPAddr(); };
+   void getIPAddrStr(std::string &buf);
+   const char *getUsernameStr() { return _username.c_str(); };
+
+   void getCaps();
+
+   void sendNumber();
+
+   void waitForDivisor();
+   void readFrames();
+   void answerJob(unsigned long jobid, const LARGEINT &divisor);
+
+   void cancelJob(unsigned long jobid);
+   void topUp();
+   void handleTimer(int kind, unsigned long arg);
+
+   ClientCaps &getClientCaps() { return _caps; };
+
+private:
+   bool readInput();
+   void handleStatus();
+   void runStatus();
+   void loggedIn();
+
+   enum statustype { s_username, s_changepwd, s_confirmpwd, s_passwd, s_checkPasswd, s_menu, s_getCaps,
+                    s_sendNumber, s_waitForReply };
+
+   // What a timer set on the reactor's wheel is for; job deadlines carry the job id
+   enum timertype { t_auth, t_heartbeat, t_deadline };
+
+   TimerId setTimer(unsigned int delay_ms, timertype kind, unsigned long arg = 0);
+   void resetHeartbeat();
+   void sendFrame(uint8_t type, unsigned long jobid = 0);
+
+   statustype _status = s_username;
+
+   SocketFD _connfd;
+ 
+   std::string _username; // The username this connection is associated with
+
+   std::string _inputbuf;
+   std::string _outbuf;   // Written but not yet taken by the socket
+
+   std::string _newpwd; // Used to store user input for changing passwords
+
+   int _pwd_attempts = 0;
+
+   AuthService &_auth;         // The server's password database, shared by every connection
+   AuthWaiter &_auth_waiter;   // Where the hashing threads send our password check's result
+   uint64_t _auth_ticket = 0;  // The password check we're waiting on, if any
+   RateLimiter &_limiter;      // Caps how fast one host can have passwords hashed
+
+   ClientCaps _caps;           // What the client advertised about its hardware
+
+   JobScheduler &_scheduler;   // Shared by every connection on the server
+   JobCanceller &_canceller;   // How the scheduler reaches us to cancel a job
+   TimerWheel &_timers;        // The reactor's, which calls handleTimer when one fires
+   MetricShard &_stats;        // The reactor's metrics
+
+   std::chrono::steady_clock::time_point _accepted;
+
+   TimerId _auth_timer = 0;
+   TimerId _heartbeat_timer = 0;
+   bool _ping_sent = false;
+
+   unsigned int _prefetch = min_prefetch;  // Jobs to keep outstanding on this client
+
+   // Jobs sent that have not been answered yet, with when they went out, their size, how long
+   // the client's caps say they should take and the timer that marks them straggling
+   struct SentJob {
+      std::chrono::steady_clock::time_point sent;
+      unsigned int bits;
+      double expected_secs;
+      TimerId deadline;
+   };
+   std::unordered_map<unsigned long, SentJob> _assigned;
+   void recordAnswer(const SentJob &sent);
+
+   // How long this client's jobs really take against what its caps say, smoothed over its
+   // recent answers. Its job deadlines are stretched by this.
+   double _slowness = 1.0;
+   std::chrono::steady_clock::time_point _last_answer;
+};
+
+
+#endif
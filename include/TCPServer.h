@@ -1,32 +1,74 @@
-#ifndef TCPSERVER_H
-#define TCPSERVER_H
-
-#include <list>
-#include <memory>
-#include "Server.h"
-#include "FileDesc.h"
-#include "TCPConn.h"
-
-class TCPServer : public Server 
-{
-public:
-   TCPServer();
-   ~TCPServer();
-
-   void bindSvr(const char *ip_addr, unsigned short port);
-   void listenSvr();
-   void shutdown();
-
-private:
-   // Class to manage the server socket
-   SocketFD _sockfd;
- 
-   // List of TCPConn objects to manage connections
-   std::list<std::unique_ptr<TCPConn>> _connlist;
-
-   
-
-};
-
-
-#endif
+#ifndef TCPSERVER_H
+#define TCPSERVER_H
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Server.h"
+#include "JobScheduler.h"
+#include "Reactor.h"
+#include "Metrics.h"
+#include "AuthService.h"
+#include "RateLimiter.h"
+#include "IPWhitelist.h"
+
+const unsigned int default_server_threads = 1;
+
+// Connections the kernel queues on each listening socket until we accept them. Big enough
+// that a whole fleet of clients reconnecting at once isn't refused; the kernel caps it at
+// net.core.somaxconn.
+const int default_listen_backlog = 4096;
+
+class TCPServer : public Server 
+{
+public:
+   TCPServer();
+   ~TCPServer();
+
+   void bindSvr(const char *ip_addr, unsigned short port);
+   void listenSvr();
+   void shutdown();
+
+   void setNumThreads(unsigned int num_threads);
+   void setBacklog(int backlog);
+   void setMetricsOutput(const std::string &admin_path, const std::string &dump_path);
+
+   JobScheduler &getScheduler() { return _scheduler; };
+
+private:
+   void runReactor(Reactor &reactor);
+
+   unsigned int _num_threads = default_server_threads;
+   int _backlog = default_listen_backlog;
+
+   // Jobs and results, shared by every reactor
+   JobScheduler _scheduler;
+
+   // The password database, loaded once and shared by every connection
+   AuthService _auth;
+
+   // Per source address limits on connects and password attempts, shared by every reactor
+   RateLimiter _limiter;
+
+   // Who may connect at all, compiled from the whitelist file and shared by every reactor
+   IPWhitelist _whitelist;
+
+   // Counters and histograms, one shard per event loop
+   Metrics _metrics;
+   std::string _admin_path;
+   std::string _dump_path;
+
+   // One event loop per thread, each owning its own server socket and the connections
+   // accepted on it
+   std::vector<std::unique_ptr<Reactor>> _reactors;
+
+   // The first error a reactor thread hit, rethrown from listenSvr
+   std::exception_ptr _reactor_error;
+   std::mutex _error_lock;
+
+};
+
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Resolution of the wheel, and its shape: wheel_levels levels of 2^wheel_bits slots each, so
+// delays up to 2^(wheel_bits * wheel_levels) ticks (about 46 hours). Longer ones are clamped.
+const unsigned int wheel_tick_ms = 10;
+const unsigned int wheel_bits = 6;
+const unsigned int wheel_levels = 4;
+
+// Handle for a scheduled timer; 0 is never a valid one
+typedef uint64_t TimerId;
+
+// What a timer carries back when it fires. The owner decides what kind and arg mean.
+struct TimerEvent {
+   int fd;
+   int kind;
+   unsigned long arg;
+};
+
+/******************************************************************************************
+ * TimerWheel - A hashed hierarchical timing wheel, as in the old Linux kernel timers. Each
+ *              level has 64 slots, each slot one tick of the level below's whole span, and a
+ *              timer goes in the lowest level whose span covers its delay. Timers cascade
+ *              down a level whenever the level below wraps around, and fire from level 0.
+ *
+ *              Timers are nodes in one slab with a free list, linked into their slot by
+ *              index, so scheduling and cancelling are O(1) and allocate nothing once the slab
+ *              has grown. A handle carries the node's generation, so cancelling a timer that
+ *              already fired (and whose node was reused) does nothing.
+ *
+ *              Not thread safe; each reactor has its own.
+ *
+ *    schedule - sets a timer to fire after delay_ms
+ *    cancel - stops a timer that has not fired yet
+ *    expire - advances the wheel to now and collects every timer that is due
+ *    getWaitMs - how long an event loop can sleep before expire has work to do
+ *
+ ******************************************************************************************/
+
+class TimerWheel {
+public:
+   TimerWheel();
+   ~TimerWheel();
+
+   TimerId schedule(unsigned int delay_ms, const TimerEvent &event);
+   bool cancel(TimerId id);
+
+   void expire(std::chrono::steady_clock::time_point now, std::vector<TimerEvent> &fired);
+   int getWaitMs(std::chrono::steady_clock::time_point now);
+
+   size_t getNumTimers() { return _num_timers; };
+
+private:
+   static const uint32_t nil = UINT32_MAX;
+   static const unsigned int wheel_slots = 1 << wheel_bits;
+
+   struct Node {
+      uint64_t expires;     // tick it fires on
+      TimerEvent event;
+      uint32_t generation;
+      uint32_t slot;        // index into _slots, or nil if free
+      uint32_t prev;
+      uint32_t next;
+   };
+
+   uint64_t getTick(std::chrono::steady_clock::time_point now);
+   void place(uint32_t idx);
+   void unlink(uint32_t idx);
+   void cascade(unsigned int level);
+
+   std::chrono::steady_clock::time_point _start;
+   uint64_t _cur_tick = 0;     // last tick processed
+
+   std::vector<Node> _nodes;
+   uint32_t _free = nil;       // head of the free list, linked through next
+   size_t _num_timers = 0;
+
+   // Head node of each slot, level by level
+   uint32_t _slots[wheel_levels * wheel_slots];
+};
+
+#endif
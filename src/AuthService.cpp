@@ -0,0 +1,330 @@
+#include <sys/random.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include "AuthService.h"
+#include "Sha256.h"
+#include "exceptions.h"
+
+AuthService::AuthService(const char *pwd_file, const char *key_file):_pwd_file(pwd_file),_pwmgr(pwd_file),
+                                       _watcher(pwd_file, [this]{ reload(); }),_key_file(key_file) {
+
+}
+
+AuthService::~AuthService() {
+   stop();
+}
+
+/******************************************************************************************
+ * start - loads the ticket key and starts watching the password file, then loads it.
+ *         Watching first means a change made while we are loading still triggers a reload.
+ *         Then starts the hashing threads.
+ *
+ *    Params:  hash_threads - how many passwords can be hashed at once
+ *
+ *    Throws: pwfile_error if the file can't be read or parsed, runtime_error if there's no
+ *            randomness for a new ticket key
+ ******************************************************************************************/
+
+void AuthService::start(unsigned int hash_threads) {
+   loadTicketKey();
+   _watcher.watch();
+
+   std::shared_ptr<UserTable> users(new UserTable);
+   _pwmgr.readAll(*users);
+   std::cout << "Loaded " << users->size() << " users from " << _pwd_file << std::endl;
+
+   {
+      std::lock_guard<std::mutex> guard(_users_lock);
+      _users = users;
+   }
+
+   _watcher.start();
+
+   _hashing = true;
+   for (unsigned int i=0; i < std::max(hash_threads, 1U); i++)
+      _hashers.emplace_back(&AuthService::hasherLoop, this);
+}
+
+/******************************************************************************************
+ * stop - wakes the watcher and the hashing threads and waits for them. Checks still queued
+ *        are dropped without an answer.
+ ******************************************************************************************/
+
+void AuthService::stop() {
+   {
+      std::lock_guard<std::mutex> guard(_check_lock);
+      _hashing = false;
+      _checks.clear();
+   }
+   _check_ready.notify_all();
+   for (std::thread &hasher : _hashers)
+      hasher.join();
+   _hashers.clear();
+
+   _watcher.stop();
+}
+
+/******************************************************************************************
+ * checkUser - looks the user up in the in-memory table
+ ******************************************************************************************/
+
+bool AuthService::checkUser(const std::string &name) {
+   PasswdEntry entry;
+   return findUser(name, entry);
+}
+
+/******************************************************************************************
+ * checkPasswd - hashes the password with the user's salt and compares it to their stored
+ *               hash. The hashing is done without holding anything, so logins on different
+ *               threads don't wait on each other.
+ *
+ *    Returns: true if the user exists and the password matches
+ ******************************************************************************************/
+
+bool AuthService::checkPasswd(const std::string &name, const char *passwd) {
+   PasswdEntry entry;
+   if (!findUser(name, entry))
+      return false;
+
+   std::vector<uint8_t> passhash, salt;
+   _pwmgr.hashArgon2(passhash, salt, passwd, &entry.salt);
+   return passhash == entry.hash;
+}
+
+/******************************************************************************************
+ * queuePasswd - queues a password check for the hashing threads. The answer goes to
+ *               waiter->passwdChecked with the fd given here and the ticket returned.
+ *
+ *    Returns: the check's ticket, or 0 if the queue is full (or we're stopped) and the check
+ *             was refused
+ ******************************************************************************************/
+
+uint64_t AuthService::queuePasswd(const std::string &name, const std::string &passwd, AuthWaiter &waiter,
+                                  int fd) {
+   uint64_t ticket;
+   {
+      std::lock_guard<std::mutex> guard(_check_lock);
+      if (!_hashing || (_checks.size() >= auth_queue_limit))
+         return 0;
+
+      ticket = _next_ticket++;
+      _checks.push_back({name, passwd, &waiter, fd, ticket, std::chrono::steady_clock::now()});
+   }
+   _check_ready.notify_one();
+   return ticket;
+}
+
+size_t AuthService::getQueueDepth() {
+   std::lock_guard<std::mutex> guard(_check_lock);
+   return _checks.size();
+}
+
+/******************************************************************************************
+ * hasherLoop - a hashing thread. Sets up its Argon2 arena, then takes checks off the queue
+ *              one at a time and reports each to its waiter, wiping the password once it's
+ *              been hashed. A hash that fails counts as a wrong password.
+ ******************************************************************************************/
+
+void AuthService::hasherLoop() {
+   if (!PasswdMgr::warmArena())
+      std::cout << "Could not set aside memory for password hashing, will try again per login.\n";
+
+   std::unique_lock<std::mutex> guard(_check_lock);
+
+   while (true) {
+      _check_ready.wait(guard, [&]{ return !_hashing || !_checks.empty(); });
+      if (!_hashing)
+         break;
+
+      PasswdCheck check = std::move(_checks.front());
+      _checks.pop_front();
+      guard.unlock();
+
+      auto started = std::chrono::steady_clock::now();
+      bool ok = false;
+      try {
+         ok = checkPasswd(check.name, check.passwd.c_str());
+      } catch (std::runtime_error &e) {
+         std::cout << "Password check for " << check.name << " failed: " << e.what() << std::endl;
+      }
+      auto finished = std::chrono::steady_clock::now();
+      std::fill(check.passwd.begin(), check.passwd.end(), '\0');
+
+      check.waiter->passwdChecked(check.fd, check.ticket, ok,
+            std::chrono::duration_cast<std::chrono::microseconds>(started - check.queued).count(),
+            std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count());
+
+      guard.lock();
+   }
+}
+
+/******************************************************************************************
+ * issueTicket - signs a session ticket for the user, good for ticket_lifetime_secs. The
+ *               ticket is "<expiry>:<mac>:<username>", the expiry in seconds since the epoch
+ *               and the mac in hex. The name goes last since it's the only part that could
+ *               hold a ':'.
+ *
+ *    Params:  name - who the ticket is for
+ *             ticket - populated with the ticket
+ *
+ *    Returns: false if the user isn't in the database
+ ******************************************************************************************/
+
+bool AuthService::issueTicket(const std::string &name, std::string &ticket) {
+   PasswdEntry entry;
+   if (!findUser(name, entry))
+      return false;
+
+   auto expiry = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count() + ticket_lifetime_secs;
+   std::string expirystr = std::to_string(expiry), mac;
+   signTicket(expirystr + ":" + name, entry, mac);
+
+   ticket = expirystr + ":" + mac + ":" + name;
+   return true;
+}
+
+/******************************************************************************************
+ * checkTicket - checks a ticket from issueTicket: it hasn't expired, its user is still in
+ *               the database and the mac matches. The macs are compared without stopping at
+ *               the first difference, so how long a check takes says nothing about how close
+ *               a forged ticket came.
+ *
+ *    Params:  ticket - the ticket the client presented
+ *             name - populated with whose ticket it is
+ *
+ *    Returns: true if the ticket is good
+ ******************************************************************************************/
+
+bool AuthService::checkTicket(const std::string &ticket, std::string &name) {
+   size_t first = ticket.find(':');
+   size_t second = (first == std::string::npos) ? std::string::npos : ticket.find(':', first + 1);
+   if (second == std::string::npos)
+      return false;
+
+   std::string expirystr = ticket.substr(0, first);
+   char *end;
+   long long expiry = strtoll(expirystr.c_str(), &end, 10);
+   long long now = std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::system_clock::now().time_since_epoch()).count();
+   if (expirystr.empty() || (*end != '\0') || (expiry < now))
+      return false;
+
+   name = ticket.substr(second + 1);
+   PasswdEntry entry;
+   if (!findUser(name, entry))
+      return false;
+
+   std::string mac;
+   signTicket(expirystr + ":" + name, entry, mac);
+   if (second - first - 1 != mac.size())
+      return false;
+
+   unsigned char diff = 0;
+   for (size_t i=0; i < mac.size(); i++)
+      diff |= ticket[first + 1 + i] ^ mac[i];
+   return diff == 0;
+}
+
+/******************************************************************************************
+ * signTicket - the hex HMAC of a ticket's expiry and name along with the user's stored hash
+ ******************************************************************************************/
+
+void AuthService::signTicket(const std::string &body, const PasswdEntry &entry, std::string &mac) {
+   std::vector<uint8_t> data(body.begin(), body.end());
+   data.push_back('\0');
+   data.insert(data.end(), entry.hash.begin(), entry.hash.end());
+
+   uint8_t digest[sha256_len];
+   hmacSha256(_ticket_key, data.data(), data.size(), digest);
+
+   static const char hexdigits[] = "0123456789abcdef";
+   mac.clear();
+   for (unsigned int i=0; i < sha256_len; i++) {
+      mac += hexdigits[digest[i] >> 4];
+      mac += hexdigits[digest[i] & 0xf];
+   }
+}
+
+/******************************************************************************************
+ * loadTicketKey - reads the ticket key from its file, or makes a new random one and saves
+ *                 it readable only by us. The new key goes to a temp file renamed into place,
+ *                 so a crash can't leave a short key behind. If it can't be saved the server
+ *                 still runs on the new key, but tickets won't survive a restart.
+ *
+ *    Throws: runtime_error if there's no randomness to make a key from
+ ******************************************************************************************/
+
+void AuthService::loadTicketKey() {
+   _ticket_key.resize(ticket_key_len);
+
+   int fd = open(_key_file.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd != -1) {
+      ssize_t amt = read(fd, _ticket_key.data(), ticket_key_len);
+      close(fd);
+      if (amt == ticket_key_len)
+         return;
+      std::cout << "Ticket key in " << _key_file << " is too short, making a new one.\n";
+   }
+
+   if (getrandom(_ticket_key.data(), ticket_key_len, 0) != ticket_key_len)
+      throw std::runtime_error("Could not get random bytes for the ticket key");
+
+   std::string tmpname = _key_file + ".tmp";
+   fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+   bool ok = (fd != -1) && (write(fd, _ticket_key.data(), ticket_key_len) == ticket_key_len) &&
+             (fsync(fd) == 0);
+   if (fd != -1)
+      close(fd);
+
+   if (!ok || (std::rename(tmpname.c_str(), _key_file.c_str()) != 0)) {
+      unlink(tmpname.c_str());
+      std::cout << "Could not save the ticket key to " << _key_file
+                << ", tickets won't survive a restart.\n";
+   }
+}
+
+/******************************************************************************************
+ * reload - reads the password file into a new table and swaps it in
+ *
+ *    Returns: false (keeping the current table) if the file couldn't be read or parsed
+ ******************************************************************************************/
+
+bool AuthService::reload() {
+   std::shared_ptr<UserTable> users(new UserTable);
+   try {
+      _pwmgr.readAll(*users);
+   } catch (pwfile_error &e) {
+      std::cout << "Password file not reloaded, keeping the old users: " << e.what() << std::endl;
+      return false;
+   }
+
+   {
+      std::lock_guard<std::mutex> guard(_users_lock);
+      _users = users;
+   }
+   std::cout << "Reloaded " << users->size() << " users from " << _pwd_file << std::endl;
+   return true;
+}
+
+std::shared_ptr<const AuthService::UserTable> AuthService::getTable() {
+   std::lock_guard<std::mutex> guard(_users_lock);
+   return _users;
+}
+
+bool AuthService::findUser(const std::string &name, PasswdEntry &entry) {
+   std::shared_ptr<const UserTable> users = getTable();
+   if (!users)
+      return false;
+
+   auto found = users->find(name);
+   if (found == users->end())
+      return false;
+
+   entry = found->second;
+   return true;
+}
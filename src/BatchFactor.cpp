@@ -0,0 +1,172 @@
+#include <stdexcept>
+#include <iostream>
+#include <limits>
+#include "BatchFactor.h"
+#include "strfuncts.h"
+
+/******************************************************************************************
+ * BatchFactor (constructor) - opens the input and output and starts the worker pool
+ *
+ *    Params:  infile - file of numbers to factor, "-" for stdin
+ *             outfile - where to write the results, "-" for stdout
+ *             workers - factoring threads, 0 for one per CPU in cpus
+ *             cpus - CPUs to pin the workers to, empty to leave them unpinned
+ *             cache - known primes to check jobs against, NULL for none
+ *
+ *    Throws: runtime_error if either file fails to open
+ ******************************************************************************************/
+
+BatchFactor::BatchFactor(const char *infile, const char *outfile, unsigned int workers,
+                         const std::vector<int> &cpus, PrimeCache *cache):
+                        _infile(infile), _outfile(outfile), _pool(workers, true, cpus) {
+
+   _pool.setCache(cache);
+
+   if (!_infile.openFile(FileFD::readfd))
+      throw std::runtime_error("Could not open batch input file for reading");
+
+   if (!_outfile.openFile(FileFD::createfd))
+      throw std::runtime_error("Could not open batch output file for writing");
+}
+
+BatchFactor::~BatchFactor() {
+
+}
+
+/******************************************************************************************
+ * run - keeps the pool fed from the input until it runs dry, writing out results as they
+ *       complete. Returns once every job has been written.
+ *
+ *    Throws: runtime_error for read/write failures
+ ******************************************************************************************/
+
+void BatchFactor::run() {
+   unsigned int max_in_flight = _pool.getNumWorkers() * batch_jobs_per_worker;
+
+   while (true) {
+      size_t in_flight = _pool.inFlight();
+      if (!_eof && (in_flight < max_in_flight))
+         readJobs(max_in_flight - in_flight);
+
+      if (_eof && (_pool.inFlight() == 0))
+         break;
+
+      // Only block for results when there is nothing more we can queue up
+      FactorResult result;
+      bool wait = _eof || (_pool.inFlight() >= max_in_flight);
+      while (_pool.getResult(result, wait)) {
+         writeResult(result);
+         wait = false;
+      }
+   }
+
+   flushOutput();
+}
+
+/******************************************************************************************
+ * readJobs - reads a block of input and submits every complete line in it as a job, up to
+ *            max_jobs. Partial lines are held until the next block arrives.
+ *
+ *    Returns: false once the input is exhausted
+ ******************************************************************************************/
+
+bool BatchFactor::readJobs(unsigned int max_jobs) {
+   unsigned int submitted = 0;
+
+   while (submitted < max_jobs) {
+      size_t crpos = _inbuf.find('\n');
+
+      if (crpos == std::string::npos) {
+         if (_eof)
+            break;
+
+         char block[batch_inbufsize];
+         ssize_t amt_read = _infile.readFD(block, batch_inbufsize);
+         if (amt_read < 0)
+            throw std::runtime_error("Read on batch input failed.");
+
+         if (amt_read == 0) {
+            // Treat a final line with no newline as a complete line
+            _eof = true;
+            if (_inbuf.empty())
+               break;
+            _inbuf += '\n';
+         } else {
+            _inbuf.append(block, amt_read);
+         }
+         continue;
+      }
+
+      std::string line = _inbuf.substr(0, crpos);
+      _inbuf.erase(0, crpos + 1);
+      clrNewlines(line);
+      _lineno++;
+
+      if (line.empty() || (line[0] == '#'))
+         continue;
+
+      std::string idstr, numstr;
+      unsigned long jobid = _lineno;
+      if (split(line, idstr, numstr, ' '))
+         jobid = strtoul(idstr.c_str(), NULL, 10);
+      else
+         numstr = line;
+
+      // Parsed wide first, since a LARGEINT would quietly wrap anything too big or negative
+      cpp_int value;
+      bool valid = true;
+      try {
+         value = cpp_int(numstr);
+      } catch (std::exception &e) {
+         valid = false;
+      }
+
+      if (!valid || (value < 2) || (msb(value) >= (unsigned) std::numeric_limits<LARGEINT>::digits)) {
+         std::cerr << "Line " << _lineno << ": skipping invalid number '" << numstr << "'\n";
+         continue;
+      }
+      _pool.submit(jobid, LARGEINT(value));
+      submitted++;
+   }
+
+   return !_eof;
+}
+
+/******************************************************************************************
+ * writeResult - formats one result into the output buffer, flushing it when full
+ ******************************************************************************************/
+
+void BatchFactor::writeResult(FactorResult &result) {
+   _outbuf += std::to_string(result.jobid);
+   _outbuf += ' ';
+   _outbuf += result.num.str();
+   _outbuf += ':';
+
+   result.primes.sort();
+   for (LARGEINT &p : result.primes) {
+      _outbuf += ' ';
+      _outbuf += p.str();
+   }
+   _outbuf += '\n';
+   _jobs_done++;
+
+   if (_outbuf.size() >= batch_outbufsize)
+      flushOutput();
+}
+
+/******************************************************************************************
+ * flushOutput - writes everything buffered so far to the output
+ *
+ *    Throws: runtime_error if the write fails
+ ******************************************************************************************/
+
+void BatchFactor::flushOutput() {
+   size_t written = 0;
+   while (written < _outbuf.size()) {
+      ssize_t results = _outfile.writeFD(_outbuf.c_str() + written, _outbuf.size() - written);
+      if (results < 0)
+         throw std::runtime_error("Write on batch output failed.");
+      written += results;
+   }
+   _outbuf.clear();
+}
@@ -1,10 +1,10 @@
-#include "Client.h"
-
-
-Client::Client() {
-
-}
-
-Client::~Client() {
-}
-
+#include "Client.h"
+
+
+Client::Client() {
+
+}
+
+Client::~Client() {
+}
+
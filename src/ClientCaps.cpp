@@ -0,0 +1,287 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <limits>
+#include <thread>
+#include <boost/multiprecision/cpp_int.hpp>
+#include <boost/integer/common_factor.hpp>
+#include "ClientCaps.h"
+#include "DivFinderServer.h"
+#include "strfuncts.h"
+
+// Rho needs roughly sqrt(pi/2 * p) iterations to find a factor p, and p <= sqrt(n)
+const double rho_iter_scale = 1.25;
+
+ClientCaps::ClientCaps() {
+   for (unsigned int i=0; i < caps_num_widths; i++) {
+      modmul_rate[i] = 0.0;
+      rho_rate[i] = 0.0;
+   }
+}
+
+ClientCaps::~ClientCaps() {
+
+}
+
+/******************************************************************************************
+ * randomOdd - builds a random odd number with exactly the given number of bits, used as the
+ *             modulus for the calibration runs
+ ******************************************************************************************/
+
+template <typename T>
+static T randomOdd(unsigned int bits, std::mt19937_64 &rng) {
+   T val = 0;
+   for (unsigned int i=0; i < bits; i += 64)
+      val = (val << 64) | T(rng());
+
+   val &= (T(1) << bits) - 1;
+   val |= (T(1) << (bits - 1)) | 1;
+   return val;
+}
+
+/******************************************************************************************
+ * timeModMul - counts how many (a * b) % n operations of the given width a single thread can
+ *              do per second. T2 must be twice as wide as the operands, the same way
+ *              DivFinderServer uses LARGEINT2X for LARGEINT math.
+ ******************************************************************************************/
+
+template <typename T2>
+static double timeModMul(unsigned int bits, unsigned int ms, std::mt19937_64 &rng) {
+   T2 n = randomOdd<T2>(bits, rng);
+   T2 a = randomOdd<T2>(bits, rng) % n;
+   T2 b = randomOdd<T2>(bits, rng) % n;
+
+   unsigned long ops = 0;
+   auto start = std::chrono::steady_clock::now();
+   auto stop = start + std::chrono::milliseconds(ms);
+   while (std::chrono::steady_clock::now() < stop) {
+      for (unsigned int i=0; i < 64; i++)
+         a = (a * b) % n;
+      ops += 64;
+   }
+   double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   // Keep the compiler from deciding the loop is dead
+   volatile bool sink = (a == 0);
+   (void) sink;
+   return ops / secs;
+}
+
+/******************************************************************************************
+ * timeRho - counts Pollard's rho iterations per second at the given width. An iteration is
+ *           the same work calcPollardsRho does per loop: one tortoise step, two hare steps
+ *           and a gcd of the difference against n.
+ ******************************************************************************************/
+
+template <typename T2>
+static double timeRho(unsigned int bits, unsigned int ms, std::mt19937_64 &rng) {
+   T2 n = randomOdd<T2>(bits, rng);
+   T2 x = randomOdd<T2>(bits, rng) % n;
+   T2 y = x;
+   T2 c = (T2(rng()) % (n - 1)) + 1;
+   T2 d = 1;
+
+   unsigned long iters = 0;
+   auto start = std::chrono::steady_clock::now();
+   auto stop = start + std::chrono::milliseconds(ms);
+   while (std::chrono::steady_clock::now() < stop) {
+      for (unsigned int i=0; i < 16; i++) {
+         x = (x * x + c) % n;
+         y = (y * y + c) % n;
+         y = (y * y + c) % n;
+         d = boost::math::gcd((x > y) ? (T2)(x - y) : (T2)(y - x), n);
+      }
+      iters += 16;
+   }
+   double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   volatile bool sink = (d == 0);
+   (void) sink;
+   return iters / secs;
+}
+
+/******************************************************************************************
+ * detectSimd - returns the name of the widest SIMD extension this CPU supports
+ ******************************************************************************************/
+
+static std::string detectSimd() {
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f"))
+      return "avx512";
+   if (__builtin_cpu_supports("avx2"))
+      return "avx2";
+   if (__builtin_cpu_supports("avx"))
+      return "avx";
+   if (__builtin_cpu_supports("sse4.2"))
+      return "sse4.2";
+   if (__builtin_cpu_supports("sse2"))
+      return "sse2";
+#elif defined(__ARM_NEON)
+   return "neon";
+#endif
+   return "none";
+}
+
+/******************************************************************************************
+ * calibrate - Runs the built-in calibration, a few hundred milliseconds in total, and fills
+ *             in the capability fields
+ *
+ *    Params:  workers - the number of factoring jobs this client runs at once
+ *             ms_per_test - how long each width's modmul and rho test runs for
+ ******************************************************************************************/
+
+void ClientCaps::calibrate(unsigned int workers, unsigned int ms_per_test) {
+   std::mt19937_64 rng(std::random_device{}());
+
+   this->cores = std::thread::hardware_concurrency();
+   if (this->cores == 0)
+      this->cores = 1;
+   this->workers = (workers == 0) ? 1 : workers;
+   this->simd = detectSimd();
+
+   modmul_rate[0] = timeModMul<uint128_t>(64, ms_per_test, rng);
+   modmul_rate[1] = timeModMul<uint256_t>(128, ms_per_test, rng);
+   modmul_rate[2] = timeModMul<uint512_t>(256, ms_per_test, rng);
+
+   rho_rate[0] = timeRho<uint128_t>(64, ms_per_test, rng);
+   rho_rate[1] = timeRho<uint256_t>(128, ms_per_test, rng);
+   rho_rate[2] = timeRho<uint512_t>(256, ms_per_test, rng);
+
+   _valid = true;
+}
+
+/******************************************************************************************
+ * toString - serializes the capabilities into buf as space-separated key=value pairs
+ ******************************************************************************************/
+
+void ClientCaps::toString(std::string &buf) {
+   std::stringstream ss;
+
+   ss << "cores=" << cores << " workers=" << workers << " simd=" << simd;
+   for (unsigned int i=0; i < caps_num_widths; i++)
+      ss << " mm" << caps_widths[i] << "=" << (unsigned long) modmul_rate[i];
+   for (unsigned int i=0; i < caps_num_widths; i++)
+      ss << " rho" << caps_widths[i] << "=" << (unsigned long) rho_rate[i];
+   if (frames)
+      ss << " frames=1";
+
+   buf = ss.str();
+}
+
+/******************************************************************************************
+ * fromString - parses the key=value pairs written by toString. Unknown keys are ignored so
+ *              newer clients can advertise more than we know about.
+ *
+ *    Returns: true if the line had the fields the server needs, false otherwise
+ ******************************************************************************************/
+
+bool ClientCaps::fromString(std::string &str) {
+   std::stringstream ss(str);
+   std::string token, key, val;
+
+   while (ss >> token) {
+      if (!split(token, key, val, '='))
+         continue;
+
+      if (key == "cores")
+         cores = strtoul(val.c_str(), NULL, 10);
+      else if (key == "workers")
+         workers = strtoul(val.c_str(), NULL, 10);
+      else if (key == "simd")
+         simd = val;
+      else if (key == "frames")
+         frames = (val == "1");
+      else {
+         for (unsigned int i=0; i < caps_num_widths; i++) {
+            std::string width = std::to_string(caps_widths[i]);
+            if (key == "mm" + width)
+               modmul_rate[i] = strtod(val.c_str(), NULL);
+            else if (key == "rho" + width)
+               rho_rate[i] = strtod(val.c_str(), NULL);
+         }
+      }
+   }
+
+   _valid = (workers > 0) && (rho_rate[widthIndex(std::numeric_limits<LARGEINT>::digits)] > 0);
+   return _valid;
+}
+
+/******************************************************************************************
+ * widthIndex - finds the smallest calibrated width that holds a number of the given bits
+ ******************************************************************************************/
+
+int ClientCaps::widthIndex(unsigned int bits) {
+   for (unsigned int i=0; i < caps_num_widths; i++) {
+      if (bits <= caps_widths[i])
+         return i;
+   }
+   return caps_num_widths - 1;
+}
+
+/******************************************************************************************
+ * getThroughput - rho iterations per second the whole client can sustain at LARGEINT width.
+ *                 Returns 0 if the client never advertised its capabilities.
+ ******************************************************************************************/
+
+double ClientCaps::getThroughput() {
+   if (!_valid)
+      return 0.0;
+   return rho_rate[widthIndex(std::numeric_limits<LARGEINT>::digits)] * workers;
+}
+
+/******************************************************************************************
+ * getMaxJobBits - the largest number, in bits, that one of this client's workers should
+ *                 factor within target_secs. Faster clients get a higher ceiling.
+ ******************************************************************************************/
+
+unsigned int ClientCaps::getMaxJobBits(double target_secs) {
+   unsigned int max_bits = std::numeric_limits<LARGEINT>::digits;
+   if (!_valid)
+      return max_bits;
+
+   double iters = rho_rate[widthIndex(max_bits)] * target_secs / rho_iter_scale;
+   if (iters <= 1.0)
+      return 0;
+
+   unsigned int bits = (unsigned int) (4.0 * std::log2(iters));
+   return (bits > max_bits) ? max_bits : bits;
+}
+
+/******************************************************************************************
+ * getPrefetchDepth - how many jobs of job_bits to keep outstanding on this client so that its
+ *                    workers have about queue_secs of work queued. Never less than one job
+ *                    per worker so no worker idles while waiting on the network.
+ ******************************************************************************************/
+
+unsigned int ClientCaps::getPrefetchDepth(unsigned int job_bits, double queue_secs) {
+   if (!_valid)
+      return min_prefetch;
+
+   unsigned int floor_depth = (workers > min_prefetch) ? workers : min_prefetch;
+
+   double depth = std::ceil(workers * queue_secs / getJobSecs(job_bits));
+
+   if (depth < floor_depth)
+      return (floor_depth > max_prefetch) ? max_prefetch : floor_depth;
+   if (depth > max_prefetch)
+      return max_prefetch;
+   return (unsigned int) depth;
+}
+
+/******************************************************************************************
+ * getJobSecs - expected seconds for one worker to find a divisor of a job_bits number, from
+ *              the ~sqrt(p) <= n^(1/4) iterations rho needs. Returns 0 if the client never
+ *              advertised its capabilities.
+ ******************************************************************************************/
+
+double ClientCaps::getJobSecs(unsigned int job_bits) {
+   if (!_valid)
+      return 0.0;
+   return getJobIters(job_bits) / rho_rate[widthIndex(job_bits)];
+}
+
+double ClientCaps::getJobIters(unsigned int job_bits) {
+   return rho_iter_scale * std::pow(2.0, job_bits / 4.0);
+}
@@ -0,0 +1,162 @@
+#include <sched.h>
+#include <pthread.h>
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <utility>
+#include "CpuTopology.h"
+
+CpuTopology::CpuTopology(const char *sysfs_root):_sysfs_root(sysfs_root) {
+
+}
+
+CpuTopology::~CpuTopology() {
+
+}
+
+/******************************************************************************************
+ * readInt - reads a single integer out of a sysfs file
+ *
+ *    Returns: true if the file existed and held a number, false otherwise
+ ******************************************************************************************/
+
+bool CpuTopology::readInt(const std::string &path, int &value) {
+   std::ifstream infile(path);
+   if (!infile)
+      return false;
+
+   return static_cast<bool>(infile >> value);
+}
+
+/******************************************************************************************
+ * load - builds the list of logical CPUs we are allowed to run on and the physical core
+ *        each one belongs to
+ *
+ *    Returns: true if the topology came from sysfs, false if we had to assume every
+ *             logical CPU is its own core
+ ******************************************************************************************/
+
+bool CpuTopology::load() {
+   cpu_set_t mask;
+   CPU_ZERO(&mask);
+   bool have_mask = (sched_getaffinity(0, sizeof(mask), &mask) == 0);
+
+   unsigned int max_cpus = have_mask ? CPU_SETSIZE : std::max(1u, std::thread::hardware_concurrency());
+
+   _cpus.clear();
+   bool from_sysfs = true;
+   for (unsigned int cpu=0; cpu < max_cpus; cpu++) {
+      if (have_mask && !CPU_ISSET(cpu, &mask))
+         continue;
+
+      std::string base = _sysfs_root + "/cpu" + std::to_string(cpu) + "/topology/";
+      LogicalCpu lcpu = {(int) cpu, 0, (int) cpu};
+      if (!readInt(base + "physical_package_id", lcpu.package) || !readInt(base + "core_id", lcpu.core)) {
+         from_sysfs = false;
+         lcpu.package = 0;
+         lcpu.core = cpu;
+      }
+      _cpus.push_back(lcpu);
+   }
+
+   std::sort(_cpus.begin(), _cpus.end(), [](const LogicalCpu &a, const LogicalCpu &b) {
+         if (a.package != b.package)
+            return a.package < b.package;
+         if (a.core != b.core)
+            return a.core < b.core;
+         return a.cpu < b.cpu;
+      });
+
+   return from_sysfs;
+}
+
+/******************************************************************************************
+ * getNumCores - number of physical cores among the CPUs we can run on
+ ******************************************************************************************/
+
+unsigned int CpuTopology::getNumCores() {
+   std::set<std::pair<int, int>> cores;
+   for (LogicalCpu &lcpu : _cpus)
+      cores.insert(std::make_pair(lcpu.package, lcpu.core));
+   return cores.size();
+}
+
+/******************************************************************************************
+ * getPlacement - lists the CPUs to pin workers to, in the order workers should take them.
+ *                The first hardware thread of every physical core comes first. With use_smt
+ *                the remaining siblings follow, so extra workers only double up on a core
+ *                once every core already has one.
+ *
+ *    Params:  cpus - populated with the CPU numbers
+ *             use_smt - include hyperthread siblings after the first thread of each core
+ *             allowed - if not NULL, only these CPUs may be used (keeps co-located services'
+ *                       cores free)
+ ******************************************************************************************/
+
+void CpuTopology::getPlacement(std::vector<int> &cpus, bool use_smt, const std::vector<int> *allowed) {
+   std::vector<int> siblings;
+   std::set<std::pair<int, int>> seen;
+
+   cpus.clear();
+   for (LogicalCpu &lcpu : _cpus) {
+      if ((allowed != NULL) && (std::find(allowed->begin(), allowed->end(), lcpu.cpu) == allowed->end()))
+         continue;
+
+      if (seen.insert(std::make_pair(lcpu.package, lcpu.core)).second)
+         cpus.push_back(lcpu.cpu);
+      else
+         siblings.push_back(lcpu.cpu);
+   }
+
+   if (use_smt)
+      cpus.insert(cpus.end(), siblings.begin(), siblings.end());
+}
+
+/******************************************************************************************
+ * parseCpuList - parses a comma-separated list of CPUs and ranges, e.g. "0-3,8,10-11"
+ *
+ *    Returns: false if the list was malformed
+ ******************************************************************************************/
+
+bool CpuTopology::parseCpuList(const char *list, std::vector<int> &cpus) {
+   std::string str(list);
+   size_t pos = 0;
+
+   cpus.clear();
+   while (pos < str.size()) {
+      size_t comma = str.find(',', pos);
+      if (comma == std::string::npos)
+         comma = str.size();
+      std::string item = str.substr(pos, comma - pos);
+      pos = comma + 1;
+
+      if (item.empty())
+         continue;
+
+      char *end;
+      long first = strtol(item.c_str(), &end, 10);
+      long last = first;
+      if (*end == '-')
+         last = strtol(end + 1, &end, 10);
+
+      if ((*end != '\0') || (first < 0) || (last < first) || (last >= CPU_SETSIZE))
+         return false;
+
+      for (long cpu = first; cpu <= last; cpu++)
+         cpus.push_back(cpu);
+   }
+   return !cpus.empty();
+}
+
+/******************************************************************************************
+ * pinThread - restricts a thread to run only on the given CPU
+ *
+ *    Returns: true if the affinity was set
+ ******************************************************************************************/
+
+bool CpuTopology::pinThread(std::thread &th, int cpu) {
+   cpu_set_t mask;
+   CPU_ZERO(&mask);
+   CPU_SET(cpu, &mask);
+   return pthread_setaffinity_np(th.native_handle(), sizeof(mask), &mask) == 0;
+}
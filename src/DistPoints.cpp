@@ -0,0 +1,213 @@
+#include <boost/integer/common_factor.hpp>
+#include <unordered_set>
+#include <vector>
+#include "DistPoints.h"
+
+DistPoints::DistPoints(std::function<void(unsigned long walk, const LARGEINT &divisor)> collided):
+                                                                         _collided(collided) {
+
+}
+
+DistPoints::~DistPoints() {
+   stop();
+}
+
+void DistPoints::start() {
+   if (!_checker.joinable())
+      _checker = std::thread(&DistPoints::checkerLoop, this);
+}
+
+/******************************************************************************************
+ * stop - stops the checker thread, dropping any points it hasn't got to
+ ******************************************************************************************/
+
+void DistPoints::stop() {
+   if (!_checker.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      _stop = true;
+   }
+   _wake.notify_one();
+   _checker.join();
+}
+
+/******************************************************************************************
+ * addNumber - starts collecting points for a number
+ *
+ *    Params:  numid - the job id of the number the walks are on
+ *             n - the number itself
+ ******************************************************************************************/
+
+void DistPoints::addNumber(unsigned long numid, LARGEINT n) {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   std::shared_ptr<WalkSet> &set = _numbers[numid];
+   if (!set) {
+      set = std::make_shared<WalkSet>();
+      set->n = n;
+   }
+}
+
+void DistPoints::removeNumber(unsigned long numid) {
+   std::lock_guard<std::mutex> guard(_lock);
+   _numbers.erase(numid);
+}
+
+/******************************************************************************************
+ * addPoint - queues a point from one walk for the checker. Cheap enough to call from an
+ *            event loop.
+ *
+ *    Params:  numid - the job id of the number the walk is on
+ *             walk - which walk reported it (its slice's job id)
+ *             value - the walk's value mod n
+ ******************************************************************************************/
+
+void DistPoints::addPoint(unsigned long numid, unsigned long walk, LARGEINT value) {
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      if ((_numbers.count(numid) == 0) || (_queue.size() >= dp_queue_max))
+         return;
+      _queue.push_back({numid, {value, walk}});
+   }
+   _wake.notify_one();
+}
+
+/******************************************************************************************
+ * checkerLoop - the checker thread. Takes everything queued and multiplies each point into
+ *               its number's product, checking a number's batch whenever it fills. Once the
+ *               queue is empty every number left with a partial batch is checked too, so a
+ *               quiet number isn't left waiting on points that may never come.
+ ******************************************************************************************/
+
+void DistPoints::checkerLoop() {
+   std::unique_lock<std::mutex> guard(_lock);
+
+   while (true) {
+      _wake.wait(guard, [&]{ return _stop || !_queue.empty(); });
+      if (_stop)
+         break;
+
+      std::deque<QueuedPoint> points;
+      points.swap(_queue);
+
+      // Look the numbers up now, so the multiplying runs without the lock
+      std::vector<std::pair<std::shared_ptr<WalkSet>, Point>> work;
+      work.reserve(points.size());
+      for (QueuedPoint &queued : points) {
+         auto found = _numbers.find(queued.numid);
+         if (found != _numbers.end())
+            work.emplace_back(found->second, queued.point);
+      }
+      guard.unlock();
+
+      std::unordered_set<WalkSet *> partial;
+      std::vector<std::pair<unsigned long, LARGEINT>> found;
+      for (auto &item : work) {
+         WalkSet &set = *item.first;
+         multiplyIn(set, item.second);
+         if (set.batched == 0)
+            continue;
+
+         if (set.batched < dp_gcd_batch) {
+            partial.insert(&set);
+            continue;
+         }
+         partial.erase(&set);
+
+         unsigned long walk;
+         LARGEINT divisor;
+         if (checkBatch(set, walk, divisor))
+            found.emplace_back(walk, divisor);
+      }
+
+      for (WalkSet *set : partial) {
+         unsigned long walk;
+         LARGEINT divisor;
+         if (checkBatch(*set, walk, divisor))
+            found.emplace_back(walk, divisor);
+      }
+
+      // The sets may be dropped by removeNumber as soon as these are gone
+      work.clear();
+
+      for (auto &collision : found)
+         _collided(collision.first, collision.second);
+
+      guard.lock();
+   }
+}
+
+/******************************************************************************************
+ * multiplyIn - adds a point to its number's window and multiplies its differences from the
+ *              other walks' points into the running product. Repeats are skipped.
+ ******************************************************************************************/
+
+void DistPoints::multiplyIn(WalkSet &set, const Point &point) {
+   const LARGEINT &n = set.n;
+   if ((point.value == 0) || (point.value >= n) || (set.seen.count(point.value) > 0))
+      return;
+
+   LARGEINT2X prod = set.product;
+   for (Point &pt : set.window) {
+      if (pt.walk == point.walk)
+         continue;
+      LARGEINT diff = (point.value > pt.value) ? (point.value - pt.value) : (pt.value - point.value);
+      prod = (prod * diff) % n;
+   }
+   set.product = prod;
+
+   set.window.push_back(point);
+   set.seen[point.value] = point.walk;
+   set.batched++;
+}
+
+/******************************************************************************************
+ * checkBatch - takes the gcd of a number's product with n. If it's 1 the batch is done and the
+ *              window is trimmed back to dp_window. Otherwise each point in the batch is
+ *              checked against the window on its own, which finds a pair giving a proper
+ *              divisor even when several primes collided at once and the product went to 0.
+ *
+ *    Params:  walk - populated with the walk of the batch's point that collided
+ *             divisor - populated with the divisor found
+ *
+ *    Returns: true if a proper divisor of n was found
+ ******************************************************************************************/
+
+bool DistPoints::checkBatch(WalkSet &set, unsigned long &walk, LARGEINT &divisor) {
+   const LARGEINT &n = set.n;
+   LARGEINT g = boost::math::gcd((LARGEINT) set.product, n);
+
+   bool found = false;
+   if (g != 1) {
+      size_t first = set.window.size() - set.batched;
+      for (size_t i = first; (i < set.window.size()) && !found; i++) {
+         const Point &point = set.window[i];
+         for (size_t j = 0; j < i; j++) {
+            const Point &pt = set.window[j];
+            if ((pt.walk == point.walk) || (pt.value == point.value))
+               continue;
+            LARGEINT diff = (point.value > pt.value) ? (point.value - pt.value) : (pt.value - point.value);
+            LARGEINT d = boost::math::gcd(diff, n);
+            if ((d != 1) && (d != n)) {
+               walk = point.walk;
+               divisor = d;
+               found = true;
+               break;
+            }
+         }
+      }
+   }
+
+   set.product = 1;
+   set.batched = 0;
+   while (set.window.size() > dp_window) {
+      Point &oldest = set.window.front();
+      auto seen = set.seen.find(oldest.value);
+      if ((seen != set.seen.end()) && (seen->second == oldest.walk))
+         set.seen.erase(seen);
+      set.window.pop_front();
+   }
+   return found;
+}
@@ -1,6 +1,7 @@
 #include "DivFinderServer.h"
 #include <iostream>
 #include <cstdlib>
+#include <limits>
 #include <thread>
 #include <algorithm>
 #include <boost/multiprecision/cpp_int.hpp>
@@ -8,15 +9,29 @@
 
 
 
-DivFinderServer::DivFinderServer() {
+DivFinderServer::DivFinderServer() :_rng(std::random_device{}()) {
 }
 
-DivFinderServer::DivFinderServer(LARGEINT number) :_orig_val(number) {
+DivFinderServer::DivFinderServer(LARGEINT number) :_orig_val(number), _rng(std::random_device{}()) {
 }
 
 DivFinderServer::~DivFinderServer() {
 }
 
+size_t LargeIntHash::operator()(const LARGEINT &n) const {
+    const LARGEINT mask = std::numeric_limits<uint64_t>::max();
+    uint64_t lo = static_cast<uint64_t>(n & mask);
+    uint64_t hi = static_cast<uint64_t>((n >> 64) & mask);
+    return std::hash<uint64_t>()(lo ^ (hi * 0x9e3779b97f4a7c15ULL));
+}
+
+void DivFinderServer::setDistinguished(LARGEINT c, unsigned int dp_bits,
+                                       std::function<void(LARGEINT)> report) {
+    _dp_c = c;
+    _dp_mask = (dp_bits >= 64) ? ~0ULL : ((1ULL << dp_bits) - 1);
+    _dp_report = report;
+}
+
 
 void DivFinderServer::setVerbose(int lvl) {
     if ((lvl < 0) || (lvl > 3))
@@ -67,16 +82,20 @@ LARGEINT DivFinderServer::calcPollardsRho(LARGEINT n) {
     if (n <= 3)
         return n;
 
-    // Initialize our random number generator
-    srand(time(NULL));
-
     // pick a random number from the range [2, N)
-    LARGEINT2X x = (rand() % (n - 2)) + 2;
+    LARGEINT2X x = (LARGEINT(_rng()) % (n - 2)) + 2;
     LARGEINT2X y = x;    // Per the algorithm
 
 
-    // random number for c = [1, N)
-    LARGEINT2X c = (rand() % (n - 1)) + 1;
+    // random number for c = [1, N), unless we were given the c the server wants every walk
+    // on this number to share. Only the first walk on the original number reports points.
+    LARGEINT2X c = (LARGEINT(_rng()) % (n - 1)) + 1;
+    bool report_points = (_dp_c != 0) && (n == _orig_val);
+    if (report_points) {
+        c = (_dp_c % (n - 1)) + 1;
+        _dp_c = 0;
+    }
+    uint64_t steps = 0;
 
     LARGEINT2X d = 1;
     if (verbose == 3)
@@ -88,6 +107,8 @@ LARGEINT DivFinderServer::calcPollardsRho(LARGEINT n) {
         // f(x) = x^2 + c f
         x = (modularPow(x, 2, n) + c + n) % n;
 
+        if (report_points && ((++steps & _dp_mask) == 0))
+            _dp_report((LARGEINT)x);
 
         // "Hare move" - Update y to f(f(y)) (modulo n)
         y = (modularPow(y, 2, n) + c + n) % n;
@@ -159,6 +180,72 @@ bool DivFinderServer::isPrimeBF(LARGEINT n, LARGEINT& divisor) {
     return true;
 }
 
+/********************************************************************************************
+ * powMod - (base^exponent) % modulus for exponents as wide as LARGEINT
+ ********************************************************************************************/
+static LARGEINT2X powMod(LARGEINT2X base, LARGEINT exponent, LARGEINT2X modulus) {
+    LARGEINT2X result = 1;
+    base = base % modulus;
+
+    while (exponent > 0) {
+        if (exponent & 1)
+            result = (result * base) % modulus;
+        exponent = exponent >> 1;
+        base = (base * base) % modulus;
+    }
+    return result;
+}
+
+/********************************************************************************************
+ * isPrimeMR - Miller-Rabin primality test. The fixed bases make it deterministic below 2^81
+ *             and leave an error chance under 4^-20 above that, at the cost of a few dozen
+ *             modular exponentiations instead of isPrimeBF's sqrt(n) trial divisions.
+ *
+ *    Params:  n - the number to check
+ *
+ *    Returns: true if n is (almost certainly) prime
+ ********************************************************************************************/
+bool DivFinderServer::isPrimeMR(LARGEINT n) {
+    static const unsigned int bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41,
+                                         43, 47, 53, 59, 61, 67, 71};
+
+    if (n < 2)
+        return false;
+
+    for (unsigned int b : bases) {
+        if (n == b)
+            return true;
+        if (n % b == 0)
+            return false;
+    }
+
+    // n - 1 = d * 2^s with d odd
+    LARGEINT d = n - 1;
+    unsigned int s = 0;
+    while ((d & 1) == 0) {
+        d = d >> 1;
+        s++;
+    }
+
+    for (unsigned int b : bases) {
+        LARGEINT2X x = powMod(b, d, n);
+        if ((x == 1) || (x == n - 1))
+            continue;
+
+        bool composite = true;
+        for (unsigned int r = 1; r < s; r++) {
+            x = (x * x) % n;
+            if (x == n - 1) {
+                composite = false;
+                break;
+            }
+        }
+        if (composite)
+            return false;
+    }
+    return true;
+}
+
 /*******************************************************************************
  *
  * factor - Calculates a single prime of the given number and recursively calls
@@ -183,7 +270,8 @@ void DivFinderServer::factor() {
     // Now the 3s
     while (newval % 3 == 0) {
         primes.push_back(3);
-        std::cout << "Prime Found: 3\n";
+        if (verbose >= 2)
+            std::cout << "Prime Found: 3\n";
         newval = newval / 3;
     }
 
@@ -211,6 +299,14 @@ void DivFinderServer::factor(LARGEINT n) {
     if (verbose >= 2)
         std::cout << "Factoring: " << n << std::endl;
 
+    // Rho can never split a prime, so don't spend primecheck_depth walks finding that out
+    if (isPrimeMR(n)) {
+        if (verbose >= 2)
+            std::cout << "Prime found: " << n << std::endl;
+        primes.push_back(n);
+        return;
+    }
+
     bool div_found = false;
     unsigned int iters = 0;
 
@@ -260,7 +356,8 @@ void DivFinderServer::factor(LARGEINT n) {
         // If d == n, then we re-randomize and continue the search up to the prime check depth
     }
     //throw std::runtime_error("Reached end of function--this should not have happened.");
-    std::cout << "process end signal detected" << std::endl;
+    if (verbose >= 1)
+        std::cout << "process end signal detected" << std::endl;
     return;
 }
 
@@ -313,6 +410,13 @@ void DivFinderServer::factorThread(LARGEINT n) {
     if (verbose >= 2)
         std::cout << "Factoring: " << n << std::endl;
 
+    if (isPrimeMR(n)) {
+        if (verbose >= 2)
+            std::cout << "Prime found: " << n << std::endl;
+        this->primeDivFound = n;
+        return;
+    }
+
     bool div_found = false;
     unsigned int iters = 0;
 
@@ -346,7 +450,6 @@ void DivFinderServer::factorThread(LARGEINT n) {
 
         // We try to get a divisor using Pollards Rho
         LARGEINT d = calcPollardsRho(n);
-        std::this_thread::sleep_for(std::chrono::seconds(2));
         if (d == 0) {
             return;
         }
@@ -366,6 +469,7 @@ void DivFinderServer::factorThread(LARGEINT n) {
         // If d == n, then we re-randomize and continue the search up to the prime check depth
     }
     //throw std::runtime_error("Reached end of function--this should not have happened.");
-    std::cout << "process end signal detected" << std::endl;
+    if (verbose >= 1)
+        std::cout << "process end signal detected" << std::endl;
     return;
 }
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <iostream>
+#include "FactorPool.h"
+#include "CpuTopology.h"
+
+/******************************************************************************************
+ * FactorPool (constructor) - starts the worker threads
+ *
+ *             Call setCache before submitting any jobs if a cache is wanted.
+ *
+ *    Params:  num_workers - threads to start, 0 means one per CPU in cpus (or one per
+ *                            hardware thread if cpus is empty)
+ *             full_factor - true to fully factor each job, false to stop at the first
+ *                           prime divisor
+ *             cpus - CPUs to pin the workers to, empty to leave them unpinned
+ ******************************************************************************************/
+
+FactorPool::FactorPool(unsigned int num_workers, bool full_factor, const std::vector<int> &cpus):
+                                                                  _full_factor(full_factor) {
+   if (num_workers == 0)
+      num_workers = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cpus.size();
+
+   _running.assign(num_workers, NULL);
+   _running_ids.assign(num_workers, 0);
+   for (unsigned int i=0; i < num_workers; i++) {
+      _workers.emplace_back(&FactorPool::workerLoop, this, i);
+
+      if (!cpus.empty() && !CpuTopology::pinThread(_workers.back(), cpus[i % cpus.size()]))
+         std::cerr << "Could not pin worker " << i << " to CPU " << cpus[i % cpus.size()] << std::endl;
+   }
+}
+
+FactorPool::~FactorPool() {
+   shutdown();
+}
+
+/******************************************************************************************
+ * submit - queues a number to be factored
+ *
+ *    Params:  seed - seeds the rho walk if nonzero, otherwise it is random
+ ******************************************************************************************/
+
+void FactorPool::submit(unsigned long jobid, LARGEINT num, uint64_t seed) {
+   FactorJob job;
+   job.jobid = jobid;
+   job.num = num;
+   job.seed = seed;
+   submit(job);
+}
+
+void FactorPool::submit(const FactorJob &job) {
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      _queue.push_back(job);
+      _in_flight++;
+   }
+   _job_ready.notify_one();
+}
+
+/******************************************************************************************
+ * getResult - pops the next finished job
+ *
+ *    Params:  result - populated with the finished job
+ *             wait - if true, blocks until a result is ready or nothing is left in flight
+ *
+ *    Returns: true if result was populated, false otherwise
+ ******************************************************************************************/
+
+bool FactorPool::getResult(FactorResult &result, bool wait) {
+   std::unique_lock<std::mutex> guard(_lock);
+
+   if (wait)
+      _result_ready.wait(guard, [this]() { return !_results.empty() || (_in_flight == 0); });
+
+   if (_results.empty())
+      return false;
+
+   result = std::move(_results.front());
+   _results.pop_front();
+   _in_flight--;
+   return true;
+}
+
+/******************************************************************************************
+ * getPoint - pops the oldest distinguished point reported by a walk
+ *
+ *    Returns: true if point was populated, false if there were none
+ ******************************************************************************************/
+
+bool FactorPool::getPoint(FactorPoint &point) {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   if (_points.empty())
+      return false;
+
+   point = _points.front();
+   _points.pop_front();
+   return true;
+}
+
+/******************************************************************************************
+ * cancel - drops the job if it is still queued, or tells its worker to stop if it is running
+ ******************************************************************************************/
+
+void FactorPool::cancel(unsigned long jobid) {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   size_t before = _queue.size();
+   _queue.erase(std::remove_if(_queue.begin(), _queue.end(),
+                     [jobid](FactorJob &job) { return job.jobid == jobid; }), _queue.end());
+   _in_flight -= before - _queue.size();
+
+   for (unsigned int i=0; i < _running.size(); i++) {
+      if ((_running[i] != NULL) && (_running_ids[i] == jobid))
+         _running[i]->setEndProcess(true);
+   }
+   _result_ready.notify_all();
+}
+
+/******************************************************************************************
+ * cancelAll - drops every queued job and stops every running one
+ ******************************************************************************************/
+
+void FactorPool::cancelAll() {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   _in_flight -= _queue.size();
+   _queue.clear();
+
+   for (unsigned int i=0; i < _running.size(); i++) {
+      if (_running[i] != NULL)
+         _running[i]->setEndProcess(true);
+   }
+   _result_ready.notify_all();
+}
+
+size_t FactorPool::inFlight() {
+   std::lock_guard<std::mutex> guard(_lock);
+   return _in_flight;
+}
+
+/******************************************************************************************
+ * shutdown - cancels everything outstanding and joins the worker threads
+ ******************************************************************************************/
+
+void FactorPool::shutdown() {
+   cancelAll();
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      _shutdown = true;
+   }
+   _job_ready.notify_all();
+
+   for (auto &th : _workers) {
+      if (th.joinable())
+         th.join();
+   }
+}
+
+/******************************************************************************************
+ * workerLoop - the body of each worker thread. Pulls jobs until shutdown, runs them outside
+ *              the lock and posts the results. Cancelled jobs are dropped silently.
+ ******************************************************************************************/
+
+void FactorPool::workerLoop(unsigned int worker) {
+   std::unique_lock<std::mutex> guard(_lock);
+
+   while (true) {
+      _job_ready.wait(guard, [this]() { return _shutdown || !_queue.empty(); });
+      if (_shutdown)
+         return;
+
+      FactorJob job = _queue.front();
+      _queue.pop_front();
+
+      DivFinderServer df(job.num);
+      if (job.seed != 0)
+         df.setSeed(job.seed);
+      if (job.dp_c != 0) {
+         unsigned long jobid = job.jobid;
+         df.setDistinguished(job.dp_c, job.dp_bits, [this, jobid](LARGEINT value) {
+               std::lock_guard<std::mutex> guard(_lock);
+               if (_points.size() >= max_held_points)
+                  _points.pop_front();
+               _points.push_back({jobid, value});
+            });
+      }
+      _running[worker] = &df;
+      _running_ids[worker] = job.jobid;
+      guard.unlock();
+
+      FactorResult result;
+      result.jobid = job.jobid;
+      result.num = job.num;
+
+      // Divide out any primes we already know about before starting on rho
+      LARGEINT remaining = job.num;
+      std::list<LARGEINT> known;
+      if ((_cache != NULL) && (job.num >= 2) && _cache->lookup(job.num, known)) {
+         for (LARGEINT &p : known) {
+            while (remaining % p == 0) {
+               result.primes.push_back(p);
+               remaining /= p;
+            }
+         }
+      }
+
+      if (!result.primes.empty() && !_full_factor) {
+         // Any prime divisor will do, and we already have one
+      } else if (remaining < 2) {
+         // Nothing (left) to factor
+      } else if (_full_factor) {
+         if (remaining == job.num)
+            df.factor();
+         else
+            df.factor(remaining);
+         result.primes.splice(result.primes.end(), df.primes);
+      } else {
+         df.factorThread(job.num);
+         if (df.getPrimeDivFound() != 0)
+            result.primes.push_back(df.getPrimeDivFound());
+      }
+
+      if ((_cache != NULL) && !df.end_process && !result.primes.empty())
+         _cache->add(job.num, result.primes);
+
+      guard.lock();
+      _running[worker] = NULL;
+      if (df.end_process) {
+         _in_flight--;
+      } else {
+         _results.push_back(std::move(result));
+      }
+      _result_ready.notify_all();
+   }
+}
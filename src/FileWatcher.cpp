@@ -0,0 +1,109 @@
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <iostream>
+#include "FileWatcher.h"
+
+// Enough for a batch of events, each with a name up to NAME_MAX
+const unsigned int inotify_bufsize = 4096;
+
+FileWatcher::FileWatcher(const std::string &filename, std::function<void()> changed):
+                                                 _filename(filename),_changed(changed) {
+   size_t slash = _filename.rfind('/');
+   _dirname = (slash == std::string::npos) ? "." : _filename.substr(0, slash + 1);
+   _basename = (slash == std::string::npos) ? _filename : _filename.substr(slash + 1);
+}
+
+FileWatcher::~FileWatcher() {
+   stop();
+}
+
+/******************************************************************************************
+ * watch - sets up inotify on the file's directory. Without inotify the server still runs,
+ *         it just won't see changes.
+ *
+ *    Returns: false if the directory couldn't be watched
+ ******************************************************************************************/
+
+bool FileWatcher::watch() {
+   if ((_inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+      std::cout << "Could not start inotify, changes to " << _filename << " won't be picked up.\n";
+      return false;
+   }
+
+   if ((inotify_add_watch(_inotifyfd, _dirname.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) == -1) ||
+       ((_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)) {
+      std::cout << "Could not watch " << _dirname << ", changes to " << _filename << " won't be picked up.\n";
+      close(_inotifyfd);
+      _inotifyfd = -1;
+      return false;
+   }
+   return true;
+}
+
+/******************************************************************************************
+ * start - starts the watcher thread, if watch() succeeded
+ ******************************************************************************************/
+
+void FileWatcher::start() {
+   if ((_inotifyfd == -1) || _running)
+      return;
+
+   _running = true;
+   _watcher = std::thread(&FileWatcher::watcherLoop, this);
+}
+
+/******************************************************************************************
+ * stop - wakes the watcher thread, waits for it and closes the watch
+ ******************************************************************************************/
+
+void FileWatcher::stop() {
+   if (_running) {
+      _running = false;
+      uint64_t one = 1;
+      if (write(_wakefd, &one, sizeof(one)) != sizeof(one))
+         std::cout << "Could not wake watcher for " << _filename << ".\n";
+      _watcher.join();
+   }
+
+   if (_inotifyfd != -1)
+      close(_inotifyfd);
+   if (_wakefd != -1)
+      close(_wakefd);
+   _inotifyfd = _wakefd = -1;
+}
+
+/******************************************************************************************
+ * watcherLoop - waits for inotify events on the directory and calls back once per batch
+ *               that names the file
+ ******************************************************************************************/
+
+void FileWatcher::watcherLoop() {
+   alignas(struct inotify_event) char buf[inotify_bufsize];
+
+   while (_running) {
+      struct pollfd fds[2];
+      fds[0].fd = _wakefd;
+      fds[0].events = POLLIN;
+      fds[1].fd = _inotifyfd;
+      fds[1].events = POLLIN;
+
+      if ((poll(fds, 2, -1) <= 0) || !(fds[1].revents & POLLIN))
+         continue;
+
+      bool changed = false;
+      ssize_t len;
+      while ((len = read(_inotifyfd, buf, sizeof(buf))) > 0) {
+         for (char *ptr = buf; ptr < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+            if ((event->len > 0) && (_basename == event->name))
+               changed = true;
+            ptr += sizeof(struct inotify_event) + event->len;
+         }
+      }
+
+      if (changed)
+         _changed();
+   }
+}
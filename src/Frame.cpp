@@ -0,0 +1,138 @@
+#include "Frame.h"
+
+static void putU64(uint64_t value, std::string &out) {
+   for (unsigned int i=0; i < 8; i++)
+      out += static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+static uint64_t getU64(const uint8_t *in) {
+   uint64_t value = 0;
+   for (unsigned int i=0; i < 8; i++)
+      value |= static_cast<uint64_t>(in[i]) << (8 * i);
+   return value;
+}
+
+/******************************************************************************************
+ * putNumber - appends a number as a limb count and its limbs, least significant first. Zero
+ *             has no limbs.
+ ******************************************************************************************/
+
+static void putNumber(LARGEINT num, std::string &out) {
+   uint64_t limbs[frame_max_limbs];
+   unsigned int count = 0;
+   while ((num != 0) && (count < frame_max_limbs)) {
+      limbs[count++] = static_cast<uint64_t>(num & std::numeric_limits<uint64_t>::max());
+      num >>= 64;
+   }
+
+   out += static_cast<char>(count);
+   for (unsigned int i=0; i < count; i++)
+      putU64(limbs[i], out);
+}
+
+/******************************************************************************************
+ * getNumber - reads a number written by putNumber from body[pos], moving pos past it
+ *
+ *    Returns: false if it runs off the end of the body or is too big for a LARGEINT
+ ******************************************************************************************/
+
+static bool getNumber(const uint8_t *body, size_t len, size_t &pos, LARGEINT &num) {
+   if (pos >= len)
+      return false;
+
+   unsigned int count = body[pos++];
+   if ((count > frame_max_limbs) || (pos + count * 8 > len))
+      return false;
+
+   num = 0;
+   for (unsigned int i=count; i > 0; i--) {
+      num <<= 64;
+      num |= getU64(body + pos + (i - 1) * 8);
+   }
+   pos += count * 8;
+   return true;
+}
+
+/******************************************************************************************
+ * encodeFrame - appends the frame's header and the body its type calls for
+ ******************************************************************************************/
+
+void encodeFrame(const Frame &frame, std::string &out) {
+   size_t start = out.size();
+   out += static_cast<char>(frame.type);
+   out += '\0';
+   out.append(2, '\0');         // body length, filled in below
+   putU64(frame.jobid, out);
+
+   switch (frame.type) {
+      case f_num:
+         putNumber(frame.num, out);
+         putU64(frame.seed, out);
+         putNumber(frame.dp_c, out);
+         out += static_cast<char>(frame.dp_bits);
+         break;
+
+      case f_div:
+      case f_dp:
+         putNumber(frame.num, out);
+         break;
+   }
+
+   size_t body_len = out.size() - start - frame_header_len;
+   out[start + 2] = static_cast<char>(body_len & 0xff);
+   out[start + 3] = static_cast<char>(body_len >> 8);
+}
+
+/******************************************************************************************
+ * decodeFrame - decodes the frame at the start of buf
+ *
+ *    Params:  buf - received bytes, starting at a frame
+ *             len - how many there are
+ *             frame - populated with the frame if it's all there
+ *
+ *    Returns: the frame's length, 0 if more bytes are needed or -1 if it's malformed
+ ******************************************************************************************/
+
+int decodeFrame(const char *buf, size_t len, Frame &frame) {
+   if (len < frame_header_len)
+      return 0;
+
+   const uint8_t *in = reinterpret_cast<const uint8_t *>(buf);
+   if (!isFrameStart(buf[0]))
+      return -1;
+
+   size_t body_len = in[2] | (static_cast<size_t>(in[3]) << 8);
+   if (body_len > frame_max_body)
+      return -1;
+   if (len < frame_header_len + body_len)
+      return 0;
+
+   frame.type = in[0];
+   frame.jobid = getU64(in + 4);
+   frame.num = 0;
+   frame.seed = 0;
+   frame.dp_c = 0;
+   frame.dp_bits = 0;
+
+   const uint8_t *body = in + frame_header_len;
+   size_t pos = 0;
+   switch (frame.type) {
+      case f_num:
+         if (!getNumber(body, body_len, pos, frame.num) || (pos + 8 > body_len))
+            return -1;
+         frame.seed = getU64(body + pos);
+         pos += 8;
+         if (!getNumber(body, body_len, pos, frame.dp_c) || (pos + 1 > body_len))
+            return -1;
+         frame.dp_bits = body[pos++];
+         break;
+
+      case f_div:
+      case f_dp:
+         if (!getNumber(body, body_len, pos, frame.num))
+            return -1;
+         break;
+   }
+
+   return frame_header_len + body_len;
+}
@@ -0,0 +1,177 @@
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <iostream>
+#include "IPWhitelist.h"
+#include "FileDesc.h"
+
+IPWhitelist::IPWhitelist(const char *filename):_filename(filename),
+                                               _watcher(filename, [this]{ reload(); }),
+                                               _trie(new Trie) {
+
+}
+
+IPWhitelist::~IPWhitelist() {
+   stop();
+}
+
+/******************************************************************************************
+ * start - starts watching the file, then loads it, so a change made while we are loading
+ *         still triggers a reload
+ ******************************************************************************************/
+
+void IPWhitelist::start() {
+   _watcher.watch();
+   reload();
+   _watcher.start();
+}
+
+void IPWhitelist::stop() {
+   _watcher.stop();
+}
+
+/******************************************************************************************
+ * isAllowed - checks an address against the current trie
+ *
+ *    Params:  ipaddr - the address in network byte order
+ ******************************************************************************************/
+
+bool IPWhitelist::isAllowed(uint32_t ipaddr) {
+   std::shared_ptr<const Trie> trie;
+   {
+      std::lock_guard<std::mutex> guard(_trie_lock);
+      trie = _trie;
+   }
+   return trie->contains(ntohl(ipaddr));
+}
+
+/******************************************************************************************
+ * reload - reads the file, compiles it into a new trie and swaps it in. A missing file
+ *          leaves an empty list, same as when the file was read on every connection.
+ *
+ *    Returns: false if the file couldn't be read
+ ******************************************************************************************/
+
+bool IPWhitelist::reload() {
+   std::shared_ptr<Trie> trie(new Trie);
+   bool ok = true;
+
+   FileFD infile(_filename.c_str());
+   if (!infile.openFile(FileFD::readfd)) {
+      std::cout << "whitelist file not found, no one will be allowed to connect" << std::endl;
+      ok = false;
+   } else {
+      std::string contents, block;
+      ssize_t amt_read;
+      while ((amt_read = infile.readFD(block)) > 0)
+         contents += block;
+      infile.closeFD();
+
+      if (amt_read < 0) {
+         std::cout << "Could not read " << _filename << ", keeping the old whitelist" << std::endl;
+         return false;
+      }
+      parse(contents, *trie);
+   }
+
+   {
+      std::lock_guard<std::mutex> guard(_trie_lock);
+      _trie = trie;
+   }
+   std::cout << "Loaded " << trie->num_ranges << " whitelist entries (" << trie->nodes.size()
+             << " trie nodes) from " << _filename << std::endl;
+   return ok;
+}
+
+/******************************************************************************************
+ * parse - adds every address and range in the file's contents to the trie. Host bits set
+ *         below a range's prefix are ignored.
+ *
+ *    Returns: false if any entry was skipped
+ ******************************************************************************************/
+
+bool IPWhitelist::parse(const std::string &contents, Trie &trie) {
+   bool ok = true;
+   size_t pos = 0;
+   while (pos < contents.size()) {
+      size_t start = contents.find_first_not_of(" \t\r\n", pos);
+      if (start == std::string::npos)
+         break;
+
+      if (contents[start] == '#') {
+         pos = contents.find('\n', start);
+         continue;
+      }
+
+      size_t end = contents.find_first_of(" \t\r\n#", start);
+      std::string entry = contents.substr(start, end - start);
+      pos = end;
+
+      std::string addrstr = entry;
+      unsigned long bits = 32;
+      size_t slash = entry.find('/');
+      if (slash != std::string::npos) {
+         addrstr = entry.substr(0, slash);
+         char *bits_end;
+         bits = strtoul(entry.c_str() + slash + 1, &bits_end, 10);
+         if ((slash + 1 == entry.size()) || (*bits_end != '\0'))
+            bits = 33;
+      }
+
+      struct in_addr addr;
+      if ((bits > 32) || (inet_pton(AF_INET, addrstr.c_str(), &addr) != 1)) {
+         std::cout << "Skipping bad whitelist entry: " << entry << std::endl;
+         ok = false;
+         continue;
+      }
+      trie.insert(ntohl(addr.s_addr), bits);
+   }
+   return ok;
+}
+
+/******************************************************************************************
+ * Trie::insert - walks the prefix's top bits down from the root, adding nodes as needed, and
+ *                marks where it ends. A prefix inside a range that's already allowed adds
+ *                nothing.
+ *
+ *    Params:  prefix - the address in host byte order
+ *             bits - how many of its top bits make up the range
+ ******************************************************************************************/
+
+void IPWhitelist::Trie::insert(uint32_t prefix, unsigned int bits) {
+   num_ranges++;
+
+   uint32_t node = 0;
+   for (unsigned int i=0; i < bits; i++) {
+      if (nodes[node].allowed)
+         return;
+
+      unsigned int bit = (prefix >> (31 - i)) & 1;
+      if (nodes[node].child[bit] == 0) {
+         nodes[node].child[bit] = nodes.size();
+         nodes.emplace_back();
+      }
+      node = nodes[node].child[bit];
+   }
+   nodes[node].allowed = true;
+}
+
+/******************************************************************************************
+ * Trie::contains - follows the address's bits from the root until a node marks a range that
+ *                  covers it or the path runs out
+ *
+ *    Params:  addr - the address in host byte order
+ ******************************************************************************************/
+
+bool IPWhitelist::Trie::contains(uint32_t addr) const {
+   uint32_t node = 0;
+   for (unsigned int i=0; ; i++) {
+      if (nodes[node].allowed)
+         return true;
+      if (i == 32)
+         return false;
+
+      node = nodes[node].child[(addr >> (31 - i)) & 1];
+      if (node == 0)
+         return false;
+   }
+}
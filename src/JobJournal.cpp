@@ -0,0 +1,336 @@
+#include <sys/stat.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include "JobJournal.h"
+
+JobJournal::JobJournal(const char *filename):_filename(filename) {
+
+}
+
+JobJournal::~JobJournal() {
+   stop();
+
+   if (_file)
+      _file->closeFD();
+}
+
+/******************************************************************************************
+ * readRecords - reads the journal into a list of records, one per line. A last line with no
+ *               newline is a write torn by a crash, so it is dropped and cut off the file
+ *               before anything new is appended. A temp file left by a compaction that
+ *               never finished is removed.
+ *
+ *    Params:  records - populated with the records, without their newlines
+ *
+ *    Returns: false if there is no journal yet
+ *
+ *    Throws: runtime_error if the journal can't be read
+ ******************************************************************************************/
+
+bool JobJournal::readRecords(std::vector<std::string> &records) {
+   records.clear();
+   std::remove((_filename + ".tmp").c_str());
+
+   FileFD infile(_filename.c_str());
+   if (!infile.openFile(FileFD::readfd))
+      return false;
+
+   std::string contents, block;
+   ssize_t amt_read;
+   while ((amt_read = infile.readFD(block)) > 0)
+      contents += block;
+   infile.closeFD();
+
+   if (amt_read < 0)
+      throw std::runtime_error("Read on job journal failed");
+
+   size_t pos = 0;
+   while (pos < contents.size()) {
+      size_t crpos = contents.find('\n', pos);
+      if (crpos == std::string::npos)
+         break;
+
+      if (crpos > pos)
+         records.push_back(contents.substr(pos, crpos - pos));
+      pos = crpos + 1;
+   }
+
+   if (pos < contents.size()) {
+      std::cerr << "Job journal ends in a partial record, dropping it\n";
+      if (truncate(_filename.c_str(), pos) != 0)
+         throw std::runtime_error("Could not trim partial record from job journal");
+   }
+   return true;
+}
+
+/******************************************************************************************
+ * open - opens the journal for appending, creating it if there isn't one
+ *
+ *    Throws: runtime_error if it can't be opened
+ ******************************************************************************************/
+
+void JobJournal::open() {
+   std::unique_ptr<FileFD> file(new FileFD(_filename.c_str()));
+   if (!file->openFile(FileFD::logfd))
+      throw std::runtime_error("Could not open job journal for writing");
+
+   struct stat st;
+   _bytes = (fstat(file->getFD(), &st) == 0) ? st.st_size : 0;
+   _file = std::move(file);
+}
+
+/******************************************************************************************
+ * start - starts the writer thread. Anything appended before this is written on its first
+ *         pass.
+ *
+ *    Params:  results - where result lines go, or NULL to drop them
+ ******************************************************************************************/
+
+void JobJournal::start(FileFD *results) {
+   _results = results;
+   _writer = std::thread(&JobJournal::writerLoop, this);
+}
+
+/******************************************************************************************
+ * stop - has the writer finish everything queued and waits for it
+ ******************************************************************************************/
+
+void JobJournal::stop() {
+   if (!_writer.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      _stop = true;
+   }
+   _wake.notify_one();
+   _writer.join();
+}
+
+/******************************************************************************************
+ * append - queues a record for the writer. Never touches the disk, so it is safe to call
+ *          with the scheduler locked.
+ *
+ *    Params:  record - one or more newline-terminated records
+ *             result - a line for the results file, written out before the record
+ ******************************************************************************************/
+
+void JobJournal::append(const std::string &record, const std::string &result) {
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      _pending += record;
+      _pending_results += result;
+      _appended++;
+   }
+   _wake.notify_one();
+}
+
+/******************************************************************************************
+ * compact - queues a snapshot to start a new journal with. The snapshot has to capture
+ *           everything appended so far; records still waiting go to the old journal as usual,
+ *           in case the new one can't be swapped in.
+ ******************************************************************************************/
+
+void JobJournal::compact(const std::string &snapshot) {
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      _snapshot = snapshot;
+      _snapshot_at = _pending.size();
+      _compacting = true;
+      _appended++;
+   }
+   _wake.notify_one();
+}
+
+/******************************************************************************************
+ * needsCompaction - true once the journal has grown past journal_compact_bytes (or as much
+ *                   again since a compaction that failed) and no compaction is already under
+ *                   way
+ ******************************************************************************************/
+
+bool JobJournal::needsCompaction() {
+   std::lock_guard<std::mutex> guard(_lock);
+   return !_compacting && (_bytes + _pending.size() > _compact_at);
+}
+
+/******************************************************************************************
+ * flush - waits until everything appended so far is on disk, or the writer fails a batch
+ *
+ *    Returns: false if the writer couldn't get it all out; it keeps retrying in the background
+ ******************************************************************************************/
+
+bool JobJournal::flush() {
+   std::unique_lock<std::mutex> guard(_lock);
+   if (!_writer.joinable())
+      return true;
+
+   uint64_t target = _appended;
+   _synced.wait(guard, [&]{ return (_durable >= target) || _failed; });
+   return _durable >= target;
+}
+
+unsigned long JobJournal::getNumSyncs() {
+   std::lock_guard<std::mutex> guard(_lock);
+   return _syncs;
+}
+
+/******************************************************************************************
+ * writerLoop - the writer thread. Waits for records, lingers briefly so a burst can pile up,
+ *              then takes the whole buffer and writes it: result lines to the results file
+ *              and synced first, then the records to the journal and synced, then any
+ *              snapshot to a new journal. Whatever fails goes back on the front of the buffer
+ *              to be retried after journal_retry_ms. When stopping, a batch that still fails
+ *              is given up on.
+ ******************************************************************************************/
+
+void JobJournal::writerLoop() {
+   std::unique_lock<std::mutex> guard(_lock);
+
+   while (true) {
+      _wake.wait(guard, [&]{ return _stop || !_pending.empty() || !_pending_results.empty() ||
+                                    !_snapshot.empty(); });
+      if (_pending.empty() && _pending_results.empty() && _snapshot.empty())
+         break;
+
+      if (!_stop) {
+         unsigned int wait_ms = _failed ? journal_retry_ms : journal_linger_ms;
+         _wake.wait_for(guard, std::chrono::milliseconds(wait_ms), [&]{ return _stop; });
+      }
+
+      std::string records, results, snapshot;
+      records.swap(_pending);
+      results.swap(_pending_results);
+      snapshot.swap(_snapshot);
+      size_t snapshot_at = _snapshot_at;
+      uint64_t batch_end = _appended;
+      guard.unlock();
+
+      bool results_ok = results.empty() || (_results == NULL) || writeDurably(*_results, results);
+      bool records_ok = results_ok && (records.empty() || writeDurably(*_file, records));
+      bool swapped = records_ok && !snapshot.empty() && swapIn(snapshot + records.substr(snapshot_at));
+
+      guard.lock();
+      if (!records_ok) {
+         // Back ahead of anything appended since, so records still follow their results
+         _pending.insert(0, records);
+         if (!results_ok)
+            _pending_results.insert(0, results);
+         if (!snapshot.empty()) {
+            _snapshot.swap(snapshot);
+            _snapshot_at = snapshot_at;
+         } else if (!_snapshot.empty()) {
+            // A snapshot queued while this batch was out was placed relative to what was
+            // pending then, which now comes after the batch
+            _snapshot_at += records.size();
+         }
+
+         if (!_failed)
+            std::cerr << "Job journal write failed, retrying every " << journal_retry_ms << " ms\n";
+         _failed = true;
+         _synced.notify_all();
+
+         if (_stop) {
+            std::cerr << "Job journal still failing, its last " << _pending.size() << " bytes of records "
+                      << "and " << _pending_results.size() << " bytes of results are lost\n";
+            break;
+         }
+         continue;
+      }
+
+      if (_failed)
+         std::cerr << "Job journal writes are working again\n";
+      _failed = false;
+
+      if (!snapshot.empty()) {
+         _compacting = false;
+         if (!swapped) {
+            std::cerr << "Job journal compaction failed, keeping the old journal\n";
+            _compact_at = _bytes + records.size() + journal_compact_bytes;
+         } else {
+            _compact_at = journal_compact_bytes;
+         }
+      }
+      if (!swapped)
+         _bytes += records.size();
+      _syncs++;
+      _durable = batch_end;
+      _synced.notify_all();
+   }
+}
+
+bool JobJournal::writeAll(FileFD &fd, const std::string &data) {
+   size_t written = 0;
+   while (written < data.size()) {
+      ssize_t results = fd.writeFD(data.c_str() + written, data.size() - written);
+      if (results < 0)
+         return false;
+      written += results;
+   }
+   return true;
+}
+
+/******************************************************************************************
+ * writeDurably - writes data to the end of a file and syncs it. If that fails, whatever part
+ *                did get written is cut back off, so retrying the batch can't leave a torn
+ *                record in the middle of the file.
+ *
+ *    Returns: false if the write or sync failed
+ ******************************************************************************************/
+
+bool JobJournal::writeDurably(FileFD &fd, const std::string &data) {
+   off_t start = fd.seekEndFD();
+   if (writeAll(fd, data) && fd.syncFD(true))
+      return true;
+
+   if ((start >= 0) && !fd.truncateFD(start))
+      std::cerr << "Could not cut a failed write back off " << _filename << " or its results\n";
+   return false;
+}
+
+/******************************************************************************************
+ * swapIn - writes a snapshot (and the records after it) to a temp file, syncs it and renames
+ *          it over the journal, then syncs the directory so the rename sticks. Called from
+ *          the writer thread without the lock.
+ *
+ *    Returns: false if any step failed, leaving the old journal in use
+ ******************************************************************************************/
+
+bool JobJournal::swapIn(const std::string &records) {
+   std::string tmpname = _filename + ".tmp";
+   FileFD tmpfile(tmpname.c_str());
+   if (!tmpfile.openFile(FileFD::createfd))
+      return false;
+
+   bool ok = writeAll(tmpfile, records) && tmpfile.syncFD();
+   tmpfile.closeFD();
+
+   // Opened for appending before the rename, so once it has the journal's name we already
+   // hold it and there is nothing left to fail
+   std::unique_ptr<FileFD> file(new FileFD(tmpname.c_str()));
+   if (!ok || !file->openFile(FileFD::appendfd)) {
+      std::remove(tmpname.c_str());
+      return false;
+   }
+   if (std::rename(tmpname.c_str(), _filename.c_str()) != 0) {
+      file->closeFD();
+      std::remove(tmpname.c_str());
+      return false;
+   }
+
+   size_t slash = _filename.rfind('/');
+   std::string dirname = (slash == std::string::npos) ? "." : _filename.substr(0, slash + 1);
+   FileFD dir(dirname.c_str());
+   if (dir.openFile(FileFD::readfd)) {
+      dir.syncFD();
+      dir.closeFD();
+   }
+
+   _file->closeFD();
+   _file = std::move(file);
+
+   std::lock_guard<std::mutex> guard(_lock);
+   _bytes = records.size();
+   return true;
+}
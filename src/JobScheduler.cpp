@@ -0,0 +1,920 @@
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include "JobScheduler.h"
+#include "DivFinderServer.h"
+#include "strfuncts.h"
+
+JobScheduler::JobScheduler():_rng(std::random_device{}()),
+                              _points([this](unsigned long walk, const LARGEINT &divisor) {
+                                 pointsCollided(walk, divisor);
+                              }) {
+   _points.start();
+}
+
+JobScheduler::~JobScheduler() {
+   // The checker calls back into us, so it goes before anything it could touch
+   stop();
+
+   if (!flushResults())
+      std::cerr << "Could not write final results" << std::endl;
+
+   // Stops the journal's writer, which may still be writing to the results file
+   _journal.reset();
+
+   if (_outfile)
+      _outfile->closeFD();
+}
+
+/******************************************************************************************
+ * stop - stops the DistPoints checker thread. A collision it finds cancels the losing walks
+ *        through their owners, so the reactors holding them have to outlive it.
+ ******************************************************************************************/
+
+void JobScheduler::stop() {
+   _points.stop();
+}
+
+/******************************************************************************************
+ * loadJobs - reads a file of numbers, one per line, and queues each one. Blank lines and
+ *            lines starting with # are skipped, as are numbers that aren't valid.
+ *
+ *    Params:  filename - file to load, "-" for stdin
+ *
+ *    Returns: the number of jobs queued
+ *
+ *    Throws: runtime_error if the file can't be opened or read
+ ******************************************************************************************/
+
+unsigned long JobScheduler::loadJobs(const char *filename) {
+   FileFD infile(filename);
+   if (!infile.openFile(FileFD::readfd))
+      throw std::runtime_error("Could not open job file for reading");
+
+   std::string contents, block;
+   ssize_t amt_read;
+   while ((amt_read = infile.readFD(block)) > 0)
+      contents += block;
+   infile.closeFD();
+
+   if (amt_read < 0)
+      throw std::runtime_error("Read on job file failed");
+
+   std::lock_guard<std::mutex> guard(_lock);
+   _jobs.reserve(_jobs.size() + std::count(contents.begin(), contents.end(), '\n') + 1);
+
+   // The whole file goes to the journal as one append
+   std::string records;
+   _log_batch = &records;
+
+   unsigned long queued = 0, lineno = 0;
+   size_t pos = 0;
+   while (pos < contents.size()) {
+      size_t crpos = contents.find('\n', pos);
+      if (crpos == std::string::npos)
+         crpos = contents.size();
+
+      std::string line = contents.substr(pos, crpos - pos);
+      pos = crpos + 1;
+      lineno++;
+
+      clrNewlines(line);
+      if (line.empty() || (line[0] == '#'))
+         continue;
+
+      if (queueJob(line))
+         queued++;
+      else
+         std::cerr << "Job file line " << lineno << ": skipping invalid number '" << line << "'\n";
+   }
+
+   _log_batch = NULL;
+   if (_journal && !records.empty())
+      _journal->append(records);
+   return queued;
+}
+
+/******************************************************************************************
+ * addJob - queues a single number
+ *
+ *    Returns: false if it wasn't a number a client can factor
+ ******************************************************************************************/
+
+bool JobScheduler::addJob(const std::string &num) {
+   std::lock_guard<std::mutex> guard(_lock);
+   return queueJob(num);
+}
+
+/******************************************************************************************
+ * setOutput - opens (truncating) the file that results are written to. Each number is
+ *             written once it is fully factored, as "<jobid> <number>: <prime> <prime> ...",
+ *             in the order they finish. A part no client could factor is written in
+ *             parentheses after the primes. With a journal open, its writer is started here
+ *             and writes the results from then on.
+ *
+ *    Params:  append - add to the file instead, when resuming from a journal
+ *
+ *    Throws: runtime_error if the file can't be opened
+ ******************************************************************************************/
+
+void JobScheduler::setOutput(const char *filename, bool append) {
+   std::lock_guard<std::mutex> guard(_out_lock);
+
+   std::unique_ptr<FileFD> outfile(new FileFD(filename));
+   if (!outfile->openFile(append ? FileFD::logfd : FileFD::createfd))
+      throw std::runtime_error("Could not open results file for writing");
+
+   _outfile = std::move(outfile);
+   if (_journal)
+      _journal->start(_outfile.get());
+}
+
+/******************************************************************************************
+ * openJournal - replays the journal, if there is one, to rebuild the submissions and jobs
+ *               that were open when the server stopped, then keeps logging to it. Numbers the
+ *               journal finished but never saw written out are queued to be written again.
+ *               Call before setOutput, which starts the journal's writer.
+ *
+ *    Returns: true if there was a journal to resume from
+ *
+ *    Throws: runtime_error if the journal can't be read or opened
+ ******************************************************************************************/
+
+bool JobScheduler::openJournal(const char *filename) {
+   std::unique_ptr<JobJournal> journal(new JobJournal(filename));
+
+   std::vector<std::string> records;
+   bool resumed = journal->readRecords(records) && !records.empty();
+   journal->open();
+
+   std::lock_guard<std::mutex> guard(_lock);
+   if (resumed)
+      replay(records);
+
+   for (auto &out : _replay_out)
+      journal->append("C " + std::to_string(out.first) + "\n", out.second);
+   _replay_out.clear();
+
+   _journal = std::move(journal);
+   return resumed;
+}
+
+/******************************************************************************************
+ * nextJob - assigns the next job to a client. It gets the largest job in the largest
+ *           non-empty tier that fits max_bits, or the smallest job left if none fit. If that
+ *           is a number big enough to split, the client gets a new slice of it instead. With
+ *           nothing pending, the client may get a twin of a straggling job.
+ *
+ *    Params:  max_bits - the largest number the client should be given
+ *             owner - the client's connection, in case the job has to be cancelled
+ *             job - populated with the job
+ *
+ *    Returns: true if there was a job to hand out
+ ******************************************************************************************/
+
+bool JobScheduler::nextJob(unsigned int max_bits, const JobOwner &owner, ServerJob &job) {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   unsigned int max_tier = getTier(max_bits);
+   while (_tier_mask != 0) {
+      uint32_t fits = _tier_mask & (uint32_t) ((2ULL << max_tier) - 1);
+
+      unsigned int tier;
+      if (fits != 0)
+         tier = 31 - __builtin_clz(fits);
+      else
+         tier = __builtin_ctz(_tier_mask);
+
+      auto found = _jobs.find(_tiers[tier].front());
+      if (found == _jobs.end()) {
+         // Answered while it was still queued
+         popPending(tier);
+         continue;
+      }
+
+      ServerJob &queued = found->second;
+      unsigned long jobid = queued.jobid;
+      if ((queued.parent == 0) && (queued.bits >= sched_split_bits)) {
+         SplitJob &split = _splits[queued.jobid];
+         if (split.dp_c == 0) {
+            split.dp_c = _rng() | 1;
+            _points.addNumber(queued.jobid, queued.value);
+         }
+
+         ServerJob &slice = _jobs[_next_jobid];
+         slice.jobid = _next_jobid++;
+         slice.num = queued.num;
+         slice.value = queued.value;
+         slice.bits = queued.bits;
+         slice.seed = _rng() | 1;
+         slice.dp_c = split.dp_c;
+         slice.parent = queued.jobid;
+         slice.queued = queued.queued;
+         split.slices.push_back(slice.jobid);
+         jobid = slice.jobid;
+
+         // The number stays at the front of its tier until every slice is out
+         if (--split.slices_left == 0) {
+            popPending(tier);
+            _num_pending--;
+         }
+      } else {
+         popPending(tier);
+         _num_pending--;
+      }
+
+      _owners[jobid] = owner;
+      job = _jobs[jobid];
+      return true;
+   }
+
+   return speculate(owner, job);
+}
+
+/******************************************************************************************
+ * reportResult - checks the divisor a client found for a job and, if it holds up, splits the
+ *                job's number into its prime parts and new jobs for any composite parts. A
+ *                bad divisor is rejected and the job goes back out. For a slice, a good
+ *                divisor finishes the whole number and cancels the other slices; a slice that
+ *                comes back with nothing (or something bad) just retires, unless it was the
+ *                number's last hope.
+ *
+ *    Params:  late - the answer is from a client that reconnected since the job was sent, so
+ *                    the job was requeued when its old connection went and may be waiting or
+ *                    out with another client. A good answer still finishes it, cancelling it
+ *                    wherever it is now; a bad one is dropped and the job carries on.
+ *
+ *    Returns: true if the job was outstanding, false if it was unknown or already answered
+ *             (or a late answer that didn't hold up)
+ ******************************************************************************************/
+
+bool JobScheduler::reportResult(unsigned long jobid, const LARGEINT &divisor, bool late) {
+   bool flush = false;
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+
+      // A split number's own id never goes to a client, only its slices' do
+      auto found = _jobs.find(jobid);
+      if ((found == _jobs.end()) || (_splits.count(jobid) > 0))
+         return false;
+
+      JobOwner holder;
+      bool assigned = unassign(jobid, &holder);
+      bool valid = checkDivisor(found->second.value, divisor);
+
+      if (late) {
+         if (!valid) {
+            if (assigned)
+               _owners[jobid] = holder;
+            return false;
+         }
+         if (assigned)
+            holder.canceller->cancelJob(holder.fd, jobid);
+      }
+
+      // Still waiting in its tier; the id is skipped once it reaches the front
+      if (!assigned)
+         _num_pending--;
+
+      // A twin still racing gets the job to itself if this answer is bad, and is cancelled if
+      // it's good
+      ServerJob *answered = &found->second;
+      if ((answered->twin != 0) && (_jobs.count(answered->twin) > 0)) {
+         if (!valid) {
+            _jobs[answered->twin].twin = 0;
+            _jobs.erase(found);
+            return true;
+         }
+         dropTwin(*answered);
+      }
+
+      if (answered->parent != 0) {
+         unsigned long parent = answered->parent;
+         if (!finishSlice(*answered, valid))
+            return true;
+         answered = &_jobs[parent];
+      }
+
+      if (valid)
+         completeJob(*answered, divisor);
+      else
+         rejectJob(*answered, divisor);
+
+      if (_journal && _journal->needsCompaction()) {
+         std::string snap;
+         snapshot(snap);
+         _journal->compact(snap);
+      }
+
+      flush = (_outbuf.size() >= sched_outbufsize) || _submissions.empty();
+      if (_submissions.empty())
+         std::cout << "All jobs complete." << std::endl;
+   }
+
+   if (flush)
+      flushResults();
+   return true;
+}
+
+/******************************************************************************************
+ * reportPoint - hands a distinguished point from the walk on a slice to DistPoints, whose
+ *               checker thread compares it against the other walks. Nothing slow happens
+ *               here, since this is called from the event loops.
+ *
+ *    Returns: true if the point was for a live slice
+ ******************************************************************************************/
+
+bool JobScheduler::reportPoint(unsigned long jobid, LARGEINT value) {
+   unsigned long parent;
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+
+      auto found = _jobs.find(jobid);
+      if ((found == _jobs.end()) || (found->second.parent == 0))
+         return false;
+      parent = found->second.parent;
+   }
+
+   _points.addPoint(parent, jobid, value);
+   return true;
+}
+
+/******************************************************************************************
+ * pointsCollided - called from the DistPoints checker when a point from a slice's walk
+ *                  collided with another walk. The divisor it exposed is reported as that
+ *                  slice's result, and the slice is cancelled along with its siblings since
+ *                  its walk is still going. The slice may have finished since it sent the
+ *                  point, in which case there is nothing left to do.
+ ******************************************************************************************/
+
+void JobScheduler::pointsCollided(unsigned long jobid, const LARGEINT &divisor) {
+   std::cout << "Walks collided on job " << jobid << ", found: " << divisor << std::endl;
+
+   JobOwner owner = {NULL, -1};
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      auto found = _owners.find(jobid);
+      if (found != _owners.end())
+         owner = found->second;
+   }
+
+   if (reportResult(jobid, divisor) && (owner.canceller != NULL))
+      owner.canceller->cancelJob(owner.fd, jobid);
+}
+
+/******************************************************************************************
+ * requeue - puts an assigned job back at the front of its tier so it goes out next. Used
+ *           when the client it was sent to disconnects without answering. A job with a twin
+ *           still running is dropped instead and the twin carries on alone.
+ ******************************************************************************************/
+
+void JobScheduler::requeue(unsigned long jobid) {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   if (!unassign(jobid))
+      return;
+
+   auto found = _jobs.find(jobid);
+   if (found == _jobs.end())
+      return;
+
+   auto twin = _jobs.find(found->second.twin);
+   if ((found->second.twin != 0) && (twin != _jobs.end())) {
+      twin->second.twin = 0;
+      _jobs.erase(found);
+      return;
+   }
+
+   found->second.twin = 0;
+   pushPending(found->second, true);
+}
+
+/******************************************************************************************
+ * flushResults - writes everything buffered so far to the results file, or with a journal,
+ *                waits for its writer to get everything so far on disk. This runs on the event
+ *                loops, so a failed write is only reported: without a journal whatever didn't
+ *                get written goes back in the buffer for the next flush, and the journal keeps
+ *                retrying on its own.
+ *
+ *    Returns: false if not everything could be written
+ ******************************************************************************************/
+
+bool JobScheduler::flushResults() {
+   if (_journal) {
+      if (_journal->flush())
+         return true;
+      std::cerr << "Results are waiting on the job journal, which is failing to write" << std::endl;
+      return false;
+   }
+
+   std::string outbuf;
+   {
+      std::lock_guard<std::mutex> guard(_lock);
+      outbuf.swap(_outbuf);
+   }
+
+   std::lock_guard<std::mutex> guard(_out_lock);
+   if (!_outfile || outbuf.empty())
+      return true;
+
+   size_t written = 0;
+   while (written < outbuf.size()) {
+      ssize_t results = _outfile->writeFD(outbuf.c_str() + written, outbuf.size() - written);
+      if (results < 0) {
+         std::cerr << "Write on results file failed, keeping " << outbuf.size() - written
+                   << " bytes of results to try again" << std::endl;
+         std::lock_guard<std::mutex> buf_guard(_lock);
+         _outbuf.insert(0, outbuf, written, std::string::npos);
+         return false;
+      }
+      written += results;
+   }
+   return true;
+}
+
+size_t JobScheduler::getNumPending() {
+   std::lock_guard<std::mutex> guard(_lock);
+   return _num_pending;
+}
+
+size_t JobScheduler::getNumOutstanding() {
+   std::lock_guard<std::mutex> guard(_lock);
+   return _owners.size();
+}
+
+/******************************************************************************************
+ * queueJob - validates a number and adds it as a new submission with a single pending job.
+ *            The caller holds the lock.
+ *
+ *    Params:  root - the submission's id when replaying; new ones take their job's id
+ *
+ *    Returns: false if it isn't a number, or is too large for a client to factor
+ ******************************************************************************************/
+
+bool JobScheduler::queueJob(const std::string &num, unsigned long root) {
+   cpp_int value;
+   try {
+      value = cpp_int(num);
+   } catch (std::exception &e) {
+      return false;
+   }
+
+   if ((value < 2) || (msb(value) >= (unsigned) std::numeric_limits<LARGEINT>::digits))
+      return false;
+
+   ServerJob &job = newJob(LARGEINT(value), 0, false);
+   job.root = (root != 0) ? root : job.jobid;
+
+   Submission &sub = _submissions[job.root];
+   sub.num = job.num;
+   sub.open_parts = 1;
+
+   if (_journal && !_replaying) {
+      std::string record = "S " + std::to_string(job.root) + " " + job.num + "\n";
+      if (_log_batch != NULL)
+         *_log_batch += record;
+      else
+         _journal->append(record);
+   }
+   return true;
+}
+
+/******************************************************************************************
+ * newJob - creates a pending job for part of a submission. The caller holds the lock.
+ *
+ *    Params:  value - the number to factor
+ *             root - the submission it is part of (0 if it starts one)
+ *             front - put it ahead of everything else in its tier
+ ******************************************************************************************/
+
+ServerJob &JobScheduler::newJob(LARGEINT value, unsigned long root, bool front) {
+   ServerJob &job = _jobs[_next_jobid];
+   job.jobid = _next_jobid++;
+   job.num = value.str();
+   job.value = value;
+   job.bits = msb(value) + 1;
+   job.root = root;
+
+   pushPending(job, front);
+   return job;
+}
+
+/******************************************************************************************
+ * checkDivisor - checks a client's answer for a number: it has to be a proper divisor, or
+ *                the number itself if the number is prime. The caller holds the lock.
+ *
+ *    Params:  n - the number the job was for
+ *             d - what the client sent back
+ *
+ *    Returns: true if the divisor is good
+ ******************************************************************************************/
+
+bool JobScheduler::checkDivisor(const LARGEINT &n, const LARGEINT &d) {
+   if ((d < 2) || (d > n) || (n % d != 0))
+      return false;
+
+   return (d != n) || DivFinderServer::isPrimeMR(n);
+}
+
+/******************************************************************************************
+ * completeJob - takes a job's checked divisor and splits its number into d and n/d. Prime
+ *               parts go on the submission; composite ones become new jobs at the front of
+ *               their tier so submissions already underway finish first. Writes the
+ *               submission out once no parts are left open. The caller holds the lock.
+ ******************************************************************************************/
+
+void JobScheduler::completeJob(ServerJob &job, LARGEINT d) {
+   LARGEINT n(job.num);
+   unsigned long root = job.root;
+   Submission &sub = _submissions[root];
+
+   if (_journal && !_replaying)
+      _journal->append("D " + std::to_string(root) + " " + job.num + " " + d.str() + "\n");
+
+   LARGEINT parts[2] = {d, n / d};
+   for (LARGEINT &part : parts) {
+      if (part < 2)
+         continue;
+
+      if (DivFinderServer::isPrimeMR(part)) {
+         sub.primes.push_back(part);
+      } else {
+         newJob(part, root, true);
+         sub.open_parts++;
+      }
+   }
+
+   _jobs.erase(job.jobid);
+   closePart(root);
+}
+
+/******************************************************************************************
+ * rejectJob - a job came back with a bad divisor (or none), so it goes back to the front of
+ *             the queue. After sched_max_rejects tries the part is given up on and recorded
+ *             as unfactored. The caller holds the lock.
+ ******************************************************************************************/
+
+void JobScheduler::rejectJob(ServerJob &job, const LARGEINT &divisor) {
+   std::cout << "Job " << job.jobid << " (" << job.num << ") rejected result: " << divisor << std::endl;
+
+   if (++job.rejects < sched_max_rejects) {
+      pushPending(job, true);
+      return;
+   }
+
+   std::cout << "Giving up on " << job.num << std::endl;
+   giveUpJob(job);
+}
+
+/******************************************************************************************
+ * giveUpJob - records a job's number as a part of its submission nobody could factor. The
+ *             caller holds the lock.
+ ******************************************************************************************/
+
+void JobScheduler::giveUpJob(ServerJob &job) {
+   unsigned long root = job.root;
+   if (_journal && !_replaying)
+      _journal->append("G " + std::to_string(root) + " " + job.num + "\n");
+
+   _submissions[root].unfactored.push_back(job.value);
+   _jobs.erase(job.jobid);
+   closePart(root);
+}
+
+/******************************************************************************************
+ * closePart - one part of a submission is done. When it was the last one, the submission's
+ *             factorization is written out: buffered, handed to the journal along with its
+ *             C record, or held while replaying. The caller holds the lock.
+ ******************************************************************************************/
+
+void JobScheduler::closePart(unsigned long root) {
+   auto found = _submissions.find(root);
+   if (found == _submissions.end())
+      return;
+
+   Submission &sub = found->second;
+   if (--sub.open_parts > 0)
+      return;
+
+   sub.primes.sort();
+   std::string line = std::to_string(root);
+   line += ' ';
+   line += sub.num;
+   line += ':';
+   for (LARGEINT &p : sub.primes) {
+      line += ' ';
+      line += p.str();
+   }
+   for (LARGEINT &c : sub.unfactored) {
+      line += " (";
+      line += c.str();
+      line += ')';
+   }
+   line += '\n';
+
+   if (_replaying)
+      _replay_out[root] = line;
+   else if (_journal)
+      _journal->append("C " + std::to_string(root) + "\n", line);
+   else
+      _outbuf += line;
+
+   _submissions.erase(found);
+}
+
+unsigned int JobScheduler::getTier(unsigned int bits) {
+   unsigned int tier = (bits > 0) ? (bits - 1) / sched_tier_bits : 0;
+   return (tier < sched_num_tiers) ? tier : sched_num_tiers - 1;
+}
+
+/******************************************************************************************
+ * pushPending - puts a job in its tier's queue. The caller holds the lock.
+ *
+ *    Params:  front - put it at the front so it goes out before the jobs already waiting
+ ******************************************************************************************/
+
+void JobScheduler::pushPending(ServerJob &job, bool front) {
+   unsigned int tier = getTier(job.bits);
+   job.queued = std::chrono::steady_clock::now();
+
+   if (front)
+      _tiers[tier].push_front(job.jobid);
+   else
+      _tiers[tier].push_back(job.jobid);
+
+   _tier_mask |= (1U << tier);
+   _num_pending++;
+}
+
+/******************************************************************************************
+ * popPending - drops the id at the front of a tier, clearing the tier's bit if it empties.
+ *              The caller holds the lock and adjusts _num_pending if the id was live.
+ ******************************************************************************************/
+
+void JobScheduler::popPending(unsigned int tier) {
+   _tiers[tier].pop_front();
+   if (_tiers[tier].empty())
+      _tier_mask &= ~(1U << tier);
+}
+
+/******************************************************************************************
+ * finishSlice - retires a slice that has come back. If it won, every other slice of the
+ *               number is cancelled and the number is done. If it didn't, the number is only
+ *               done once no slices are left to hand out or waiting on an answer. The caller
+ *               holds the lock.
+ *
+ *    Params:  slice - the slice that came back (erased by this call)
+ *             won - true if it found a good divisor
+ *
+ *    Returns: true if the number is done and the caller should complete or reject it
+ ******************************************************************************************/
+
+bool JobScheduler::finishSlice(ServerJob &slice, bool won) {
+   unsigned long parent = slice.parent;
+   _jobs.erase(slice.jobid);
+
+   auto split = _splits.find(parent);
+   if (split == _splits.end())
+      return false;
+
+   if (!won) {
+      if (split->second.slices_left > 0)
+         return false;
+
+      for (unsigned long sliceid : split->second.slices) {
+         if (_jobs.count(sliceid) > 0)
+            return false;
+      }
+   }
+
+   for (unsigned long sliceid : split->second.slices) {
+      if (_jobs.count(sliceid) == 0)
+         continue;
+
+      JobOwner owner;
+      if (unassign(sliceid, &owner)) {
+         owner.canceller->cancelJob(owner.fd, sliceid);
+      } else {
+         // Requeued after its client left and still waiting
+         _num_pending--;
+      }
+      _jobs.erase(sliceid);
+   }
+
+   // The number itself is still at the front of its tier if not every slice went out
+   if (split->second.slices_left > 0)
+      _num_pending--;
+
+   _splits.erase(split);
+   _points.removeNumber(parent);
+   return true;
+}
+
+/******************************************************************************************
+ * markStraggling - flags an assigned job as taking too long, so the next client with
+ *                  nothing to do gets a twin of it. Slices already race each other and a job
+ *                  only ever gets one twin, so those are left alone.
+ ******************************************************************************************/
+
+void JobScheduler::markStraggling(unsigned long jobid) {
+   std::lock_guard<std::mutex> guard(_lock);
+
+   auto found = _jobs.find(jobid);
+   if ((found == _jobs.end()) || (_owners.count(jobid) == 0) || (found->second.parent != 0) ||
+       (found->second.twin != 0))
+      return;
+
+   _stragglers.push_back(jobid);
+}
+
+/******************************************************************************************
+ * unassign - forgets who a job went to. The caller holds the lock.
+ *
+ *    Params:  owner - if not NULL, populated with who had it
+ *
+ *    Returns: true if the job was assigned
+ ******************************************************************************************/
+
+bool JobScheduler::unassign(unsigned long jobid, JobOwner *owner) {
+   auto found = _owners.find(jobid);
+   if (found == _owners.end())
+      return false;
+
+   if (owner != NULL)
+      *owner = found->second;
+   _owners.erase(found);
+   return true;
+}
+
+/******************************************************************************************
+ * speculate - takes the oldest straggling job that some other client has and assigns this
+ *             client a twin of it, with its own rho seed. The caller holds the lock.
+ *
+ *    Returns: true if job was populated with a twin
+ ******************************************************************************************/
+
+bool JobScheduler::speculate(const JobOwner &owner, ServerJob &job) {
+   for (auto late = _stragglers.begin(); late != _stragglers.end(); ) {
+      unsigned long jobid = *late;
+      auto holder = _owners.find(jobid);
+      auto found = _jobs.find(jobid);
+      if ((holder == _owners.end()) || (found == _jobs.end()) || (found->second.twin != 0)) {
+         late = _stragglers.erase(late);
+         continue;
+      }
+      if ((holder->second.canceller == owner.canceller) && (holder->second.fd == owner.fd)) {
+         late++;
+         continue;
+      }
+      _stragglers.erase(late);
+
+      ServerJob &straggler = found->second;
+      ServerJob &twin = _jobs[_next_jobid];
+      twin = straggler;
+      twin.jobid = _next_jobid++;
+      twin.rejects = 0;
+      twin.seed = _rng() | 1;
+      twin.twin = jobid;
+      twin.queued = std::chrono::steady_clock::now();
+      straggler.twin = twin.jobid;
+
+      std::cout << "Job " << jobid << " (" << straggler.num << ") is straggling, racing it with job "
+                << twin.jobid << std::endl;
+
+      _owners[twin.jobid] = owner;
+      job = twin;
+      return true;
+   }
+   return false;
+}
+
+/******************************************************************************************
+ * dropTwin - cancels the twin racing a job that just got its answer. The caller holds the
+ *            lock.
+ ******************************************************************************************/
+
+void JobScheduler::dropTwin(ServerJob &job) {
+   auto twin = _jobs.find(job.twin);
+   job.twin = 0;
+   if (twin == _jobs.end())
+      return;
+
+   JobOwner owner;
+   if (unassign(twin->first, &owner)) {
+      owner.canceller->cancelJob(owner.fd, twin->first);
+   } else {
+      // Requeued after its client left and still waiting
+      _num_pending--;
+   }
+   _jobs.erase(twin);
+}
+
+/******************************************************************************************
+ * replay - rebuilds the scheduler from journal records by running each one back through the
+ *          code that logged it. Parts are matched to the jobs rebuilt for them by submission
+ *          and number, since job ids aren't logged. Job ids and new submissions start above
+ *          every submission id seen. The caller holds the lock.
+ ******************************************************************************************/
+
+void JobScheduler::replay(const std::vector<std::string> &records) {
+   _replaying = true;
+
+   // Open jobs by "<root> <num>", and a helper to add the ones created since an id
+   std::unordered_map<std::string, std::vector<unsigned long>> open;
+   auto track = [&](unsigned long from) {
+      for (unsigned long jobid = from; jobid < _next_jobid; jobid++) {
+         auto found = _jobs.find(jobid);
+         if (found != _jobs.end())
+            open[std::to_string(found->second.root) + " " + found->second.num].push_back(jobid);
+      }
+   };
+
+   unsigned long max_root = 0, bad = 0;
+   for (const std::string &record : records) {
+      std::istringstream fields(record);
+      std::string type, num, divisor;
+      unsigned long root = 0;
+      fields >> type >> root >> num >> divisor;
+      max_root = std::max(max_root, root);
+      unsigned long from = _next_jobid;
+
+      try {
+         if ((type == "S") && (root != 0) && queueJob(num, root)) {
+            track(from);
+
+         } else if ((type == "N") && !num.empty()) {
+            _submissions[root].num = num;
+
+         } else if ((type == "P") && (_submissions.count(root) > 0)) {
+            _submissions[root].primes.push_back(LARGEINT(num));
+
+         } else if ((type == "U") && (_submissions.count(root) > 0)) {
+            _submissions[root].unfactored.push_back(LARGEINT(num));
+
+         } else if ((type == "J") && (_submissions.count(root) > 0)) {
+            newJob(LARGEINT(num), root, false);
+            _submissions[root].open_parts++;
+            track(from);
+
+         } else if ((type == "D") || (type == "G")) {
+            std::vector<unsigned long> &ids = open[std::to_string(root) + " " + num];
+            if (ids.empty()) {
+               bad++;
+               continue;
+            }
+            ServerJob &job = _jobs[ids.back()];
+            ids.pop_back();
+
+            // Still in its tier's queue, where it will be skipped
+            _num_pending--;
+            if (type == "D")
+               completeJob(job, LARGEINT(divisor));
+            else
+               giveUpJob(job);
+            track(from);
+
+         } else if (type == "C") {
+            _replay_out.erase(root);
+
+         } else {
+            bad++;
+         }
+      } catch (std::exception &e) {
+         bad++;
+      }
+   }
+
+   if (bad > 0)
+      std::cerr << "Skipped " << bad << " job journal records that didn't fit\n";
+
+   _next_jobid = std::max(_next_jobid, max_root + 1);
+   _replaying = false;
+}
+
+/******************************************************************************************
+ * snapshot - writes out what is still open as journal records: every submission with the
+ *            parts found so far, then its open parts. Slices aren't parts (their number is)
+ *            and only one of a pair of twins is. The caller holds the lock.
+ ******************************************************************************************/
+
+void JobScheduler::snapshot(std::string &snap) {
+   snap.clear();
+
+   for (auto &entry : _submissions) {
+      std::string root = std::to_string(entry.first);
+      snap += "N " + root + " " + entry.second.num + "\n";
+      for (LARGEINT &p : entry.second.primes)
+         snap += "P " + root + " " + p.str() + "\n";
+      for (LARGEINT &u : entry.second.unfactored)
+         snap += "U " + root + " " + u.str() + "\n";
+   }
+
+   for (auto &entry : _jobs) {
+      ServerJob &job = entry.second;
+      if ((job.parent != 0) || ((job.twin != 0) && (job.twin < job.jobid) && (_jobs.count(job.twin) > 0)))
+         continue;
+      snap += "J " + std::to_string(job.root) + " " + job.num + "\n";
+   }
+}
@@ -0,0 +1,350 @@
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "Metrics.h"
+#include "FileDesc.h"
+
+// Names the counters and histograms are reported under, in enum order
+static const char *counter_names[c_num_counters] = {
+   "conns_accepted", "conns_refused", "conns_limited", "conns_closed", "auth_ok", "auth_failed",
+   "auth_busy", "auth_limited", "auth_ticket", "ticket_rejected", "jobs_sent", "jobs_answered", "jobs_cancelled"
+};
+static const char *hist_names[h_num_hists] = {
+   "queue_wait_us", "job_latency_us", "auth_latency_us", "auth_wait_us", "auth_hash_us",
+   "client_iter_per_sec"
+};
+
+/******************************************************************************************
+ * record - adds a value to the histogram. Only the owning thread calls this, so plain
+ *          relaxed load/store pairs are enough.
+ ******************************************************************************************/
+
+void Histogram::record(uint64_t value) {
+   std::atomic<uint64_t> &bucket = _buckets[getBucket(value)];
+   bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+   _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+   _sum.store(_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+   if (value > _max.load(std::memory_order_relaxed))
+      _max.store(value, std::memory_order_relaxed);
+}
+
+/******************************************************************************************
+ * mergeInto - adds this histogram's buckets and totals to running ones
+ ******************************************************************************************/
+
+void Histogram::mergeInto(std::vector<uint64_t> &buckets, uint64_t &count, uint64_t &sum, uint64_t &max) {
+   buckets.resize(hist_buckets, 0);
+   for (unsigned int i=0; i < hist_buckets; i++)
+      buckets[i] += _buckets[i].load(std::memory_order_relaxed);
+
+   count += _count.load(std::memory_order_relaxed);
+   sum += _sum.load(std::memory_order_relaxed);
+   max = std::max(max, _max.load(std::memory_order_relaxed));
+}
+
+/******************************************************************************************
+ * getBucket - small values map to themselves; larger ones to their power of two and the
+ *             hist_sub_bits bits below the top bit
+ ******************************************************************************************/
+
+unsigned int Histogram::getBucket(uint64_t value) {
+   if (value < (1ULL << hist_sub_bits))
+      return value;
+
+   unsigned int top = 63 - __builtin_clzll(value);
+   unsigned int sub = (value >> (top - hist_sub_bits)) & ((1U << hist_sub_bits) - 1);
+   return ((top - hist_sub_bits + 1) << hist_sub_bits) + sub;
+}
+
+/******************************************************************************************
+ * getBucketTop - the largest value that lands in a bucket
+ ******************************************************************************************/
+
+uint64_t Histogram::getBucketTop(unsigned int bucket) {
+   if (bucket < (1U << hist_sub_bits))
+      return bucket;
+
+   unsigned int top = (bucket >> hist_sub_bits) + hist_sub_bits - 1;
+   uint64_t sub = bucket & ((1U << hist_sub_bits) - 1);
+   uint64_t low = ((1ULL << hist_sub_bits) + sub) << (top - hist_sub_bits);
+   return low + (1ULL << (top - hist_sub_bits)) - 1;
+}
+
+Metrics::Metrics():_started(std::chrono::steady_clock::now()),_rate_time(_started) {
+
+}
+
+Metrics::~Metrics() {
+   stop();
+}
+
+/******************************************************************************************
+ * addShard - creates a shard for a thread to record into. The shard lives as long as the
+ *            Metrics object.
+ ******************************************************************************************/
+
+MetricShard &Metrics::addShard() {
+   std::lock_guard<std::mutex> guard(_shard_lock);
+   _shards.emplace_back(new MetricShard());
+   return *_shards.back();
+}
+
+/******************************************************************************************
+ * start - opens the admin socket if there is one and starts the reporter thread
+ *
+ *    Params:  admin_path - unix socket to serve reports on; an old one is replaced
+ *             dump_path - file to rewrite with the report every interval_secs
+ *
+ *    Throws: socket_error if the admin socket can't be created, bound or listened on
+ ******************************************************************************************/
+
+void Metrics::start(const std::string &admin_path, const std::string &dump_path, unsigned int interval_secs) {
+   _admin_path = admin_path;
+   _dump_path = dump_path;
+   _interval_secs = (interval_secs > 0) ? interval_secs : default_metrics_secs;
+
+   if ((_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+      throw socket_error("Could not create eventfd for metrics.");
+
+   if (!_admin_path.empty())
+      openAdminSocket();
+
+   _running = true;
+   _reporter = std::thread(&Metrics::reporterLoop, this);
+}
+
+/******************************************************************************************
+ * stop - wakes the reporter and waits for it, writing a last dump on its way out
+ ******************************************************************************************/
+
+void Metrics::stop() {
+   if (!_running)
+      return;
+
+   _running = false;
+   uint64_t one = 1;
+   if (write(_wakefd, &one, sizeof(one)) != sizeof(one))
+      std::cout << "Could not wake metrics reporter.\n";
+   _reporter.join();
+
+   if (_adminfd != -1) {
+      close(_adminfd);
+      unlink(_admin_path.c_str());
+      _adminfd = -1;
+   }
+   close(_wakefd);
+   _wakefd = -1;
+}
+
+/******************************************************************************************
+ * report - sums the shards and writes one line per metric: counters, a few gauges, the job
+ *          rate over the last interval, then each histogram as its count, mean, tail
+ *          percentiles and max
+ ******************************************************************************************/
+
+void Metrics::report(std::string &out) {
+   auto now = std::chrono::steady_clock::now();
+   uint64_t counters[c_num_counters] = {};
+   std::vector<uint64_t> buckets[h_num_hists];
+   uint64_t count[h_num_hists] = {}, sum[h_num_hists] = {}, max[h_num_hists] = {};
+
+   {
+      std::lock_guard<std::mutex> guard(_shard_lock);
+      for (std::unique_ptr<MetricShard> &shard : _shards) {
+         for (unsigned int i=0; i < c_num_counters; i++)
+            counters[i] += shard->_counters[i].load(std::memory_order_relaxed);
+         for (unsigned int i=0; i < h_num_hists; i++)
+            shard->_hists[i].mergeInto(buckets[i], count[i], sum[i], max[i]);
+      }
+   }
+
+   char line[256];
+   out.clear();
+   snprintf(line, sizeof(line), "uptime_secs %.1f\n", std::chrono::duration<double>(now - _started).count());
+   out += line;
+
+   for (unsigned int i=0; i < c_num_counters; i++) {
+      snprintf(line, sizeof(line), "%s %llu\n", counter_names[i], (unsigned long long) counters[i]);
+      out += line;
+   }
+
+   uint64_t closed = std::min(counters[c_conns_closed], counters[c_conns_accepted]);
+   snprintf(line, sizeof(line), "conns_open %llu\n", (unsigned long long) (counters[c_conns_accepted] - closed));
+   out += line;
+
+   if (_scheduler != NULL) {
+      snprintf(line, sizeof(line), "jobs_pending %zu\njobs_outstanding %zu\n", _scheduler->getNumPending(),
+               _scheduler->getNumOutstanding());
+      out += line;
+   }
+
+   if (_auth != NULL) {
+      snprintf(line, sizeof(line), "auth_queue_depth %zu\n", _auth->getQueueDepth());
+      out += line;
+   }
+
+   if (_limiter != NULL) {
+      snprintf(line, sizeof(line), "ratelimit_hosts %zu\n", _limiter->getTracked());
+      out += line;
+   }
+
+   snprintf(line, sizeof(line), "jobs_per_sec %.2f\n", _jobs_per_sec.load());
+   out += line;
+
+   const double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+   for (unsigned int i=0; i < h_num_hists; i++) {
+      snprintf(line, sizeof(line), "%s count %llu mean %llu", hist_names[i], (unsigned long long) count[i],
+               (unsigned long long) ((count[i] > 0) ? sum[i] / count[i] : 0));
+      out += line;
+
+      // Walk the buckets once, reporting each percentile as the top of the bucket it lands in
+      uint64_t seen = 0;
+      unsigned int bucket = 0;
+      for (double pct : percentiles) {
+         uint64_t rank = (uint64_t) (pct / 100.0 * count[i] + 0.5);
+         while ((bucket < buckets[i].size()) && (seen + buckets[i][bucket] < rank))
+            seen += buckets[i][bucket++];
+         uint64_t value = (count[i] > 0) ? std::min(Histogram::getBucketTop(bucket), max[i]) : 0;
+         snprintf(line, sizeof(line), " p%g %llu", pct, (unsigned long long) value);
+         out += line;
+      }
+
+      snprintf(line, sizeof(line), " max %llu\n", (unsigned long long) max[i]);
+      out += line;
+   }
+}
+
+/******************************************************************************************
+ * reporterLoop - waits on the admin socket and the wake eventfd, answering admin connections
+ *                as they come and rewriting the dump every interval
+ ******************************************************************************************/
+
+void Metrics::reporterLoop() {
+   auto next_tick = std::chrono::steady_clock::now() + std::chrono::seconds(_interval_secs);
+
+   while (_running) {
+      struct pollfd fds[2];
+      fds[0].fd = _wakefd;
+      fds[0].events = POLLIN;
+      fds[1].fd = _adminfd;
+      fds[1].events = POLLIN;
+
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - std::chrono::steady_clock::now());
+      int n = poll(fds, (_adminfd != -1) ? 2 : 1, std::max(0, (int) wait.count()));
+
+      if ((n > 0) && (fds[1].revents & POLLIN))
+         serveAdmin();
+
+      if (std::chrono::steady_clock::now() >= next_tick) {
+         next_tick += std::chrono::seconds(_interval_secs);
+         updateRate();
+         writeDump();
+      }
+   }
+
+   writeDump();
+}
+
+/******************************************************************************************
+ * openAdminSocket - creates the unix socket admin reports are served on, replacing any left
+ *                   over from an earlier run
+ *
+ *    Throws: socket_error if it can't be set up
+ ******************************************************************************************/
+
+void Metrics::openAdminSocket() {
+   struct sockaddr_un addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (_admin_path.size() >= sizeof(addr.sun_path))
+      throw socket_error("Admin socket path is too long.");
+   strcpy(addr.sun_path, _admin_path.c_str());
+
+   if ((_adminfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+      throw socket_error("Could not create admin socket.");
+
+   unlink(_admin_path.c_str());
+   if ((bind(_adminfd, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen(_adminfd, 16) != 0)) {
+      close(_adminfd);
+      _adminfd = -1;
+      throw socket_error("Could not bind admin socket.");
+   }
+}
+
+/******************************************************************************************
+ * serveAdmin - sends the report to everyone waiting on the admin socket and hangs up
+ ******************************************************************************************/
+
+void Metrics::serveAdmin() {
+   std::string out;
+   int connfd;
+   while ((connfd = accept4(_adminfd, NULL, NULL, SOCK_CLOEXEC)) != -1) {
+      if (out.empty())
+         report(out);
+
+      // A reader too slow to take a few KB doesn't get to hold up the reporter
+      struct timeval timeout = {1, 0};
+      setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+      size_t written = 0;
+      while (written < out.size()) {
+         ssize_t results = send(connfd, out.c_str() + written, out.size() - written, MSG_NOSIGNAL);
+         if (results <= 0)
+            break;
+         written += results;
+      }
+      close(connfd);
+   }
+}
+
+/******************************************************************************************
+ * writeDump - rewrites the dump file with the current report. It's written to a temp file
+ *             and renamed over the old one, so a reader never sees half a report.
+ ******************************************************************************************/
+
+void Metrics::writeDump() {
+   if (_dump_path.empty())
+      return;
+
+   std::string out;
+   report(out);
+
+   std::string tmpname = _dump_path + ".tmp";
+   FileFD dumpfile(tmpname.c_str());
+   if (!dumpfile.openFile(FileFD::createfd)) {
+      std::cerr << "Could not write metrics dump " << tmpname << "\n";
+      return;
+   }
+
+   bool ok = (dumpfile.writeFD(out.c_str(), out.size()) == (ssize_t) out.size());
+   dumpfile.closeFD();
+   if (!ok || (std::rename(tmpname.c_str(), _dump_path.c_str()) != 0))
+      std::cerr << "Could not write metrics dump " << _dump_path << "\n";
+}
+
+/******************************************************************************************
+ * updateRate - works out jobs answered per second over the interval just ended
+ ******************************************************************************************/
+
+void Metrics::updateRate() {
+   uint64_t answered = 0;
+   {
+      std::lock_guard<std::mutex> guard(_shard_lock);
+      for (std::unique_ptr<MetricShard> &shard : _shards)
+         answered += shard->_counters[c_jobs_answered].load(std::memory_order_relaxed);
+   }
+
+   auto now = std::chrono::steady_clock::now();
+   double secs = std::chrono::duration<double>(now - _rate_time).count();
+   if (secs > 0.0)
+      _jobs_per_sec = (answered - _rate_base) / secs;
+
+   _rate_base = answered;
+   _rate_time = now;
+}
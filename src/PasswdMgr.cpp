@@ -1,293 +1,721 @@
-#include <argon2.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <iostream>
-#include <algorithm>
-#include <cstring>
-#include <list>
-#include "PasswdMgr.h"
-#include "FileDesc.h"
-#include "strfuncts.h"
-
-const int hashlen = 32;
-const int saltlen = 16;
-
-PasswdMgr::PasswdMgr(const char *pwd_file):_pwd_file(pwd_file) {
-
-}
-
-
-PasswdMgr::~PasswdMgr() {
-
-}
-
-/*******************************************************************************************
- * checkUser - Checks the password file to see if the given user is listed
- *
- *    Throws: pwfile_error if there were unanticipated problems opening the password file for
- *            reading
- *******************************************************************************************/
-
-bool PasswdMgr::checkUser(const char *name) {
-   std::vector<uint8_t> passwd, salt;
-
-   bool result = findUser(name, passwd, salt);
-
-   return result;
-     
-}
-
-/*******************************************************************************************
- * checkPasswd - Checks the password for a given user to see if it matches the password
- *               in the passwd file
- *
- *    Params:  name - username string to check (case insensitive)
- *             passwd - password string to hash and compare (case sensitive)
- *    
- *    Returns: true if correct password was given, false otherwise
- *
- *    Throws: pwfile_error if there were unanticipated problems opening the password file for
- *            reading
- *******************************************************************************************/
-
-bool PasswdMgr::checkPasswd(const char *name, const char *passwd) {
-   std::vector<uint8_t> userhash; // hash from the password file
-   std::vector<uint8_t> passhash; // hash derived from the parameter passwd
-   std::vector<uint8_t> salt;
-
-   // Check if the user exists and get the passwd string
-   if (!findUser(name, userhash, salt))
-      return false;
-
-   hashArgon2(passhash, salt, passwd, &salt);
-
-   if (userhash == passhash)
-      return true;
-
-   return false;
-}
-
-/*******************************************************************************************
- * changePasswd - Changes the password for the given user to the password string given
- *
- *    Params:  name - username string to change (case insensitive)
- *             passwd - the new password (case sensitive)
- *
- *    Returns: true if successful, false if the user was not found
- *
- *    Throws: pwfile_error if there were unanticipated problems opening the password file for
- *            writing
- *
- *******************************************************************************************/
-
-bool PasswdMgr::changePasswd(const char *name, const char *passwd) {
-
-   // Insert your insane code here
-
-   return true;
-}
-
-/*****************************************************************************************************
- * readUser - Taking in an opened File Descriptor of the password file, reads in a user entry and
- *            loads the passed in variables
- *
- *    Params:  pwfile - FileDesc of password file already opened for reading
- *             name - std string to store the name read in
- *             hash, salt - vectors to store the read-in hash and salt respectively
- *
- *    Returns: true if a new entry was read, false if eof reached 
- * 
- *    Throws: pwfile_error exception if the file appeared corrupted
- *
- *****************************************************************************************************/
-
-bool PasswdMgr::readUser(FileFD &pwfile, std::string &name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt)
-{
-
-   // Insert your perfect code here!
-   //pwfile.readFD(name);
-   if (pwfile.readStr(name) == 0){
-      return false;
-   }   
-   
-   std::string tempString;
-
-   pwfile.readBytes(hash, 32);
-   pwfile.readBytes(salt, 16);
-   pwfile.readStr(tempString);
-   //std::cout << "in readUser " << std::endl;
-   return true;
-}
-
-/*****************************************************************************************************
- * writeUser - Taking in an opened File Descriptor of the password file, writes a user entry to disk
- *
- *    Params:  pwfile - FileDesc of password file already opened for writing
- *             name - std string of the name 
- *             hash, salt - vectors of the hash and salt to write to disk
- *
- *    Returns: bytes written
- *
- *    Throws: pwfile_error exception if the writes fail
- *
- *****************************************************************************************************/
-
-int PasswdMgr::writeUser(FileFD &pwfile, std::string &name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt)
-{
-   int results = 0;
-
-   // Insert your wild code here!
-
-   return results; 
-}
-
-/*****************************************************************************************************
- * findUser - Reads in the password file, finding the user (if they exist) and populating the two
- *            passed in vectors with their hash and salt
- *
- *    Params:  name - the username to search for
- *             hash - vector to store the user's password hash
- *             salt - vector to store the user's salt string
- *
- *    Returns: true if found, false if not
- *
- *    Throws: pwfile_error exception if the pwfile could not be opened for reading
- *
- *****************************************************************************************************/
-
-bool PasswdMgr::findUser(const char *name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt) {
-
-   FileFD pwfile(_pwd_file.c_str());
-
-   // You may need to change this code for your specific implementation
-
-   if (!pwfile.openFile(FileFD::readfd))
-      throw pwfile_error("Could not open passwd file for reading");
-
-   // Password file should be in the format username\n{32 byte hash}{16 byte salt}\n
-   bool eof = false;
-   while (!eof) {
-      std::string uname;
-
-      if (!readUser(pwfile, uname, hash, salt)) {
-         eof = true;
-         continue;
-      }
-
-      if (!uname.compare(name)) {
-         pwfile.closeFD();
-         return true;
-      }
-   }
-
-   hash.clear();
-   salt.clear();
-   pwfile.closeFD();
-   return false;
-}
-
-
-/*****************************************************************************************************
- * hashArgon2 - Performs a hash on the password using the Argon2 library. Implementation algorithm
- *              taken from the http://github.com/P-H-C/phc-winner-argon2 example. 
- *
- *    Params:  dest - the std string object to store the hash
- *             passwd - the password to be hashed
- *
- *    Throws: runtime_error if the salt passed in is not the right size
- *****************************************************************************************************/
-void PasswdMgr::hashArgon2(std::vector<uint8_t> &ret_hash, std::vector<uint8_t> &ret_salt, 
-                           const char *in_passwd, std::vector<uint8_t> *in_salt) {
-   // Hash those passwords!!!!
-   int HASHLEN = 32;
-   int SALTLEN = 16;
-
-   uint8_t hash1[HASHLEN];
-
-   uint8_t salt[SALTLEN];
-   memset( salt, 0x00, SALTLEN );
-
-   //not needed
-   uint8_t *pwd = (uint8_t *)strdup(in_passwd);
-   uint32_t pwdlen = strlen((char *)pwd);
-
-   uint32_t t_cost = 2;            // 1-pass computation
-   uint32_t m_cost = (1<<16);      // 64 mebibytes memory usage
-   uint32_t parallelism = 1;       // number of threads and lanes
-
-    // high-level API
-   argon2i_hash_raw(t_cost, m_cost, parallelism, pwd, pwdlen, in_salt, SALTLEN, hash1, HASHLEN);
-
-   for (int i = 0; i < 32; i++){
-      ret_hash.push_back(hash1[i]);
-   }
-
-   //delete
-
-}
-
-/****************************************************************************************************
- * addUser - First, confirms the user doesn't exist. If not found, then adds the new user with a new
- *           password and salt
- *
- *    Throws: pwfile_error if issues editing the password file
- ****************************************************************************************************/
-
-void PasswdMgr::addUser(const char *name, const char *passwd) {
-   // Add those users!
-   
-   std::vector<uint8_t> ret_hash;
-   ret_hash.clear();
-   std::vector<uint8_t> ret_salt;
-   std::vector<uint8_t> in_salt{1,7,7,5,7,1,3,6,1,5,4,5,7,5,4,9};
-
-   /*
-   for (int i = 0; i < 16; i++){
-      int randomNum = rand() % 9;
-      in_salt.push_back(randomNum);
-   }
-   */
-
-   hashArgon2(ret_hash, ret_salt, passwd, &in_salt);
-
-   std::cout << "hash: ";
-   std::string hashStr;
-
-   for( int i=0; i< ret_hash.size(); i++ ) 
-   {
-      printf("%02x", ret_hash.at(i));
-      //std::cout << static_cast<unsigned int>(ret_hash.at(i));
-   } 
-   std::cout << "\n";
-
-   
-
-   std::cout << "salt: ";
-   for( int i=0; i< in_salt.size(); i++ ) 
-   {
-      printf( "%02x", in_salt.at(i) );
-   }
-   std::cout << "\n";
-
-   
-   
-   //adding username, passwd, and salt to file
-   FileFD pwfile(_pwd_file.c_str());
-
-   // You may need to change this code for your specific implementation
-
-   if (!pwfile.openFile(FileFD::writefd))
-      throw pwfile_error("Could not open passwd file for reading");
-
-   // Password file should be in the format username\n{32 byte hash}{16 byte salt}\n
-
-   pwfile.writeFD(name);
-   pwfile.writeFD("\n");
-   pwfile.writeBytes(ret_hash);
-   pwfile.writeBytes(in_salt);
-   pwfile.writeFD("\n");
-
-   pwfile.closeFD();
-   
-}
-
+#include <argon2.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstddef>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <thread>
+#include "PasswdMgr.h"
+#include "FileDesc.h"
+#include "strfuncts.h"
+
+const int hashlen = 32;
+const int saltlen = 16;
+
+// Argon2 cost settings: passes over memory, memory in KiB and lanes
+const uint32_t argon2_t_cost = 2;
+const uint32_t argon2_m_cost = (1<<16);      // 64 mebibytes memory usage
+const uint32_t argon2_lanes = 1;
+
+// Arenas are aligned to this so transparent huge pages can back all of them
+const size_t huge_page_size = 2 << 20;
+
+/*******************************************************************************************
+ * HashArena - Argon2's working memory for one thread. The first hash on a thread maps the
+ *             block, asks for huge pages and touches every page, and every later hash on
+ *             that thread reuses it, so hashing never maps, faults or zeroes memory. The
+ *             block is unmapped when the thread exits. With a fixed pool of hashing threads
+ *             this caps Argon2's memory at threads x m_cost.
+ *******************************************************************************************/
+
+struct HashArena {
+   ~HashArena() {
+      if (base != NULL)
+         munmap(base, mapped);
+   }
+
+   bool reserve(size_t bytes);
+
+   uint8_t *base = NULL;      // what mmap returned
+   uint8_t *block = NULL;     // base rounded up to a huge page
+   size_t mapped = 0;
+   size_t size = 0;
+};
+
+static thread_local HashArena hash_arena;
+
+bool HashArena::reserve(size_t bytes) {
+   if (bytes <= size)
+      return true;
+
+   if (base != NULL)
+      munmap(base, mapped);
+   base = block = NULL;
+   mapped = size = 0;
+
+   size_t len = bytes + huge_page_size;
+   void *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (mem == MAP_FAILED)
+      return false;
+
+   base = (uint8_t *) mem;
+   mapped = len;
+   block = (uint8_t *) (((uintptr_t) base + huge_page_size - 1) & ~(uintptr_t) (huge_page_size - 1));
+   size = bytes;
+
+   // Huge pages are only a hint; without them we still get the block, just in small pages
+   madvise(block, size, MADV_HUGEPAGE);
+   for (size_t i=0; i < size; i += 4096)
+      ((volatile uint8_t *) block)[i] = 0;
+   return true;
+}
+
+// Argon2 calls these instead of malloc and free
+static int allocArena(uint8_t **memory, size_t bytes) {
+   if (!hash_arena.reserve(bytes))
+      return ARGON2_MEMORY_ALLOCATION_ERROR;
+   *memory = hash_arena.block;
+   return ARGON2_OK;
+}
+
+static void freeArena(uint8_t *, size_t) {
+   // Kept for the thread's next hash
+}
+
+/*******************************************************************************************
+ * The password file format. A 64 byte header is followed by a hash table of fixed-size
+ * records, one slot per record. A user lives in the slot their name hashes to (FNV-1a, masked
+ * to the capacity) or the first free slot after it, so finding one is a probe or two into the
+ * mapped file. The table is kept at most half full and rebuilt at twice the size when it
+ * would pass that. Numbers are stored in host byte order.
+ *
+ * The old format, "username\n{32 byte hash}{16 byte salt}\n" per user, is converted the
+ * first time it is opened.
+ *******************************************************************************************/
+
+const char pwdb_magic[4] = {'P', 'W', 'D', 'B'};
+const uint32_t pwdb_version = 2;
+const uint32_t pwdb_min_capacity = 64;
+
+// Usernames up to this long fit in a record, leaving room for the terminating NUL
+const size_t pwdb_name_len = 48;
+
+struct PasswdHeader {
+   char magic[4];
+   uint32_t version;
+   uint32_t record_size;
+   uint32_t capacity;      // slots, a power of two
+   uint32_t count;         // slots in use
+   uint8_t reserved[44];
+};
+
+struct PasswdRecord {
+   char name[pwdb_name_len];     // NUL padded; empty for a free slot
+   uint8_t hash[hashlen];
+   uint8_t salt[saltlen];
+};
+
+static_assert(sizeof(PasswdHeader) == 64, "password file header must be 64 bytes");
+static_assert(sizeof(PasswdRecord) == 96, "password file records must be 96 bytes");
+
+static uint64_t hashName(const char *name) {
+   uint64_t hash = 14695981039346656037ULL;
+   for (const char *c = name; *c != '\0'; c++)
+      hash = (hash ^ (uint8_t) *c) * 1099511628211ULL;
+   return hash;
+}
+
+/*******************************************************************************************
+ * findSlot - probes a table for a user
+ *
+ *    Returns: the user's slot, or the free slot they would go in, with found set to say which.
+ *             -1 if the table is full and they aren't in it.
+ *******************************************************************************************/
+
+static long findSlot(const PasswdRecord *records, uint32_t capacity, const char *name, bool &found) {
+   found = false;
+   size_t slot = hashName(name) & (capacity - 1);
+   for (uint32_t i=0; i < capacity; i++, slot = (slot + 1) & (capacity - 1)) {
+      if (records[slot].name[0] == '\0')
+         return slot;
+      if (strncmp(records[slot].name, name, pwdb_name_len) == 0) {
+         found = true;
+         return slot;
+      }
+   }
+   return -1;
+}
+
+/*******************************************************************************************
+ * PasswdView - the password file mapped read-only, unmapped when it goes out of scope
+ *******************************************************************************************/
+
+struct PasswdView {
+   ~PasswdView() { unmap(); }
+
+   bool map(const std::string &filename);
+   void unmap();
+   bool isDB() { return (len >= sizeof(PasswdHeader)) && (memcmp(data, pwdb_magic, sizeof(pwdb_magic)) == 0); }
+
+   const PasswdHeader *header() { return (const PasswdHeader *) data; }
+   const PasswdRecord *records() { return (const PasswdRecord *) (data + sizeof(PasswdHeader)); }
+
+   uint8_t *data = NULL;
+   size_t len = 0;
+};
+
+bool PasswdView::map(const std::string &filename) {
+   unmap();
+
+   FileFD pwfile(filename.c_str());
+   if (!pwfile.openFile(FileFD::readfd))
+      return false;
+
+   struct stat st;
+   if (fstat(pwfile.getFD(), &st) != 0) {
+      pwfile.closeFD();
+      return false;
+   }
+
+   // An empty file is an old-format file with no users; there's nothing to map
+   if (st.st_size > 0) {
+      void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, pwfile.getFD(), 0);
+      if (mem == MAP_FAILED) {
+         pwfile.closeFD();
+         return false;
+      }
+      data = (uint8_t *) mem;
+      len = st.st_size;
+   }
+   pwfile.closeFD();
+   return true;
+}
+
+void PasswdView::unmap() {
+   if (data != NULL)
+      munmap(data, len);
+   data = NULL;
+   len = 0;
+}
+
+PasswdMgr::PasswdMgr(const char *pwd_file):_pwd_file(pwd_file) {
+
+}
+
+
+PasswdMgr::~PasswdMgr() {
+
+}
+
+/*******************************************************************************************
+ * checkUser - Checks the password file to see if the given user is listed
+ *
+ *    Throws: pwfile_error if there were unanticipated problems opening the password file for
+ *            reading
+ *******************************************************************************************/
+
+bool PasswdMgr::checkUser(const char *name) {
+   std::vector<uint8_t> passwd, salt;
+
+   bool result = findUser(name, passwd, salt);
+
+   return result;
+     
+}
+
+/*******************************************************************************************
+ * checkPasswd - Checks the password for a given user to see if it matches the password
+ *               in the passwd file
+ *
+ *    Params:  name - username string to check (case insensitive)
+ *             passwd - password string to hash and compare (case sensitive)
+ *    
+ *    Returns: true if correct password was given, false otherwise
+ *
+ *    Throws: pwfile_error if there were unanticipated problems opening the password file for
+ *            reading
+ *******************************************************************************************/
+
+bool PasswdMgr::checkPasswd(const char *name, const char *passwd) {
+   std::vector<uint8_t> userhash; // hash from the password file
+   std::vector<uint8_t> passhash; // hash derived from the parameter passwd
+   std::vector<uint8_t> salt;
+
+   // Check if the user exists and get the passwd string
+   if (!findUser(name, userhash, salt))
+      return false;
+
+   hashArgon2(passhash, salt, passwd, &salt);
+
+   if (userhash == passhash)
+      return true;
+
+   return false;
+}
+
+/*******************************************************************************************
+ * changePasswd - Changes the password for the given user to the password string given. The
+ *                new hash and salt overwrite the old ones in the user's record with a single
+ *                pwrite.
+ *
+ *    Params:  name - username string to change (case insensitive)
+ *             passwd - the new password (case sensitive)
+ *
+ *    Returns: true if successful, false if the user was not found
+ *
+ *    Throws: pwfile_error if there were unanticipated problems opening the password file for
+ *            writing
+ *
+ *******************************************************************************************/
+
+bool PasswdMgr::changePasswd(const char *name, const char *passwd) {
+   PasswdView view;
+   openDB(view);
+
+   bool found;
+   long slot = findSlot(view.records(), view.header()->capacity, name, found);
+   if (!found)
+      return false;
+
+   std::vector<uint8_t> hash, salt;
+   newSalt(salt);
+   hashArgon2(hash, salt, passwd, &salt);
+
+   std::vector<uint8_t> hashsalt(hash);
+   hashsalt.insert(hashsalt.end(), salt.begin(), salt.end());
+
+   FileFD pwfile(_pwd_file.c_str());
+   if (!pwfile.openFile(FileFD::updatefd))
+      throw pwfile_error("Could not open passwd file for writing");
+
+   off_t offset = sizeof(PasswdHeader) + slot * sizeof(PasswdRecord) + offsetof(PasswdRecord, hash);
+   bool ok = (pwfile.pwriteFD(hashsalt.data(), hashsalt.size(), offset) == (ssize_t) hashsalt.size()) &&
+             pwfile.syncFD(true);
+   pwfile.closeFD();
+
+   if (!ok)
+      throw pwfile_error("Write to passwd file failed");
+   return true;
+}
+
+/*****************************************************************************************************
+ * writeUser - Taking in an opened File Descriptor of the password file, writes a user's whole
+ *             record into its slot with one pwrite
+ *
+ *    Params:  pwfile - FileDesc of password file already opened for update
+ *             slot - the record to write
+ *             name - std string of the name 
+ *             hash, salt - vectors of the hash and salt to write to disk
+ *
+ *    Returns: bytes written, or -1 if the write failed
+ *
+ *****************************************************************************************************/
+
+int PasswdMgr::writeUser(FileFD &pwfile, long slot, std::string &name, std::vector<uint8_t> &hash,
+                         std::vector<uint8_t> &salt)
+{
+   PasswdRecord record;
+   fillRecord(record, name, hash, salt);
+
+   return pwfile.pwriteFD(&record, sizeof(record), sizeof(PasswdHeader) + slot * sizeof(PasswdRecord));
+}
+
+void PasswdMgr::fillRecord(PasswdRecord &record, const std::string &name, const std::vector<uint8_t> &hash,
+                           const std::vector<uint8_t> &salt) {
+   memset(&record, 0, sizeof(record));
+   memcpy(record.name, name.c_str(), std::min(name.size(), pwdb_name_len - 1));
+   memcpy(record.hash, hash.data(), std::min(hash.size(), (size_t) hashlen));
+   memcpy(record.salt, salt.data(), std::min(salt.size(), (size_t) saltlen));
+}
+
+/*****************************************************************************************************
+ * findUser - Looks the user up in the mapped password file, populating the two passed in vectors
+ *            with their hash and salt
+ *
+ *    Params:  name - the username to search for
+ *             hash - vector to store the user's password hash
+ *             salt - vector to store the user's salt string
+ *
+ *    Returns: true if found, false if not
+ *
+ *    Throws: pwfile_error exception if the pwfile could not be opened for reading
+ *
+ *****************************************************************************************************/
+
+bool PasswdMgr::findUser(const char *name, std::vector<uint8_t> &hash, std::vector<uint8_t> &salt) {
+   hash.clear();
+   salt.clear();
+
+   PasswdView view;
+   openDB(view);
+
+   bool found;
+   long slot = findSlot(view.records(), view.header()->capacity, name, found);
+   if (!found)
+      return false;
+
+   const PasswdRecord &record = view.records()[slot];
+   hash.assign(record.hash, record.hash + hashlen);
+   salt.assign(record.salt, record.salt + saltlen);
+   return true;
+}
+
+/*****************************************************************************************************
+ * readAll - Reads every user out of the password file, for callers that keep the users in memory
+ *           rather than looking each one up in the file
+ *
+ *    Params:  users - populated with every user's hash and salt, keyed by username
+ *
+ *    Throws: pwfile_error if the file can't be read or isn't a valid password file
+ *****************************************************************************************************/
+
+void PasswdMgr::readAll(std::unordered_map<std::string, PasswdEntry> &users) {
+   users.clear();
+
+   PasswdView view;
+   openDB(view);
+
+   const PasswdRecord *records = view.records();
+   for (uint32_t i=0; i < view.header()->capacity; i++) {
+      if (records[i].name[0] == '\0')
+         continue;
+
+      PasswdEntry &entry = users[std::string(records[i].name, strnlen(records[i].name, pwdb_name_len))];
+      entry.hash.assign(records[i].hash, records[i].hash + hashlen);
+      entry.salt.assign(records[i].salt, records[i].salt + saltlen);
+   }
+}
+
+/*****************************************************************************************************
+ * openDB - maps the password file and checks its header. A file still in the old format is
+ *          converted first.
+ *
+ *    Params:  view - where the file is mapped
+ *
+ *    Throws: pwfile_error if the file can't be opened or converted, or its header doesn't match
+ *            its size
+ *****************************************************************************************************/
+
+void PasswdMgr::openDB(PasswdView &view) {
+   if (!view.map(_pwd_file))
+      throw pwfile_error("Could not open passwd file for reading");
+
+   if (!view.isDB()) {
+      std::unordered_map<std::string, PasswdEntry> users;
+      readLegacy(view.data, view.len, users);
+      view.unmap();
+
+      writeDB(users);
+      std::cout << "Converted " << _pwd_file << " to the indexed format (" << users.size() << " users)\n";
+
+      if (!view.map(_pwd_file) || !view.isDB())
+         throw pwfile_error("Could not reopen converted passwd file");
+   }
+
+   const PasswdHeader *header = view.header();
+   if ((header->version != pwdb_version) || (header->record_size != sizeof(PasswdRecord)) ||
+       (header->capacity == 0) || ((header->capacity & (header->capacity - 1)) != 0) ||
+       (view.len < sizeof(PasswdHeader) + (size_t) header->capacity * sizeof(PasswdRecord)))
+      throw pwfile_error("Passwd file header is corrupt or from an unknown version");
+}
+
+/*****************************************************************************************************
+ * readLegacy - parses a password file in the old format, "username\n{32 byte hash}{16 byte salt}\n"
+ *              per user
+ *
+ *    Throws: pwfile_error if an entry is cut short
+ *****************************************************************************************************/
+
+void PasswdMgr::readLegacy(const uint8_t *data, size_t len, std::unordered_map<std::string, PasswdEntry> &users) {
+   const char *contents = (const char *) data;
+   size_t pos = 0;
+   while (pos < len) {
+      const char *cr = (const char *) memchr(contents + pos, '\n', len - pos);
+      size_t crpos = (cr == NULL) ? len : cr - contents;
+      if ((crpos + hashlen + saltlen + 1 >= len) || (contents[crpos + hashlen + saltlen + 1] != '\n'))
+         throw pwfile_error("Passwd file has a partial or corrupt entry");
+
+      const uint8_t *entrydata = data + crpos + 1;
+      PasswdEntry &entry = users[std::string(contents + pos, crpos - pos)];
+      entry.hash.assign(entrydata, entrydata + hashlen);
+      entry.salt.assign(entrydata + hashlen, entrydata + hashlen + saltlen);
+
+      pos = crpos + hashlen + saltlen + 2;
+   }
+}
+
+/*****************************************************************************************************
+ * writeDB - writes a whole new password file holding the given users, in a table at least
+ *           min_capacity slots big. It's written to a temp file, synced and renamed over the old
+ *           one, so a crash leaves one file or the other, never half of one. The file holds
+ *           every hash and salt, so only we get to read it.
+ *
+ *    Throws: pwfile_error if any step fails, leaving the old file alone
+ *****************************************************************************************************/
+
+void PasswdMgr::writeDB(const std::unordered_map<std::string, PasswdEntry> &users, uint32_t min_capacity) {
+   uint32_t capacity = std::max(min_capacity, pwdb_min_capacity);
+   while (capacity < users.size() * 2)
+      capacity *= 2;
+
+   std::vector<uint8_t> buf(sizeof(PasswdHeader) + (size_t) capacity * sizeof(PasswdRecord), 0);
+   PasswdHeader *header = (PasswdHeader *) buf.data();
+   PasswdRecord *records = (PasswdRecord *) (buf.data() + sizeof(PasswdHeader));
+
+   memcpy(header->magic, pwdb_magic, sizeof(pwdb_magic));
+   header->version = pwdb_version;
+   header->record_size = sizeof(PasswdRecord);
+   header->capacity = capacity;
+
+   for (auto &user : users) {
+      if (user.first.empty() || (user.first.size() >= pwdb_name_len)) {
+         std::cout << "Skipping user with a bad name length: " << user.first << std::endl;
+         continue;
+      }
+
+      bool found;
+      long slot = findSlot(records, capacity, user.first.c_str(), found);
+      fillRecord(records[slot], user.first, user.second.hash, user.second.salt);
+      header->count++;
+   }
+
+   std::string tmpname = _pwd_file + ".tmp";
+   FileFD tmpfile(tmpname.c_str());
+   remove(tmpname.c_str());      // a leftover would keep its own permissions
+   if (!tmpfile.openFile(FileFD::createfd, 0600))
+      throw pwfile_error("Could not create temp passwd file");
+
+   size_t written = 0;
+   bool ok = true;
+   while (ok && (written < buf.size())) {
+      ssize_t results = tmpfile.writeFD((const char *) buf.data() + written, buf.size() - written);
+      ok = (results > 0);
+      written += (results > 0) ? results : 0;
+   }
+   ok = ok && tmpfile.syncFD();
+   tmpfile.closeFD();
+
+   if (!ok || (rename(tmpname.c_str(), _pwd_file.c_str()) != 0)) {
+      remove(tmpname.c_str());
+      throw pwfile_error("Could not write new passwd file");
+   }
+
+   // Sync the directory so the rename survives a crash
+   size_t slash = _pwd_file.rfind('/');
+   std::string dirname = (slash == std::string::npos) ? "." : _pwd_file.substr(0, slash + 1);
+   FileFD dir(dirname.c_str());
+   if (dir.openFile(FileFD::readfd)) {
+      dir.syncFD();
+      dir.closeFD();
+   }
+}
+
+/*****************************************************************************************************
+ * newSalt - fills salt with random bytes from the kernel
+ *
+ *    Throws: runtime_error if there's no randomness to be had
+ *****************************************************************************************************/
+
+void PasswdMgr::newSalt(std::vector<uint8_t> &salt) {
+   salt.resize(saltlen);
+   if (getrandom(salt.data(), saltlen, 0) != saltlen)
+      throw std::runtime_error("Could not get random bytes for a salt");
+}
+
+/*****************************************************************************************************
+ * hashArgon2 - Performs a hash on the password using the Argon2 library. Implementation algorithm
+ *              taken from the http://github.com/P-H-C/phc-winner-argon2 example. Argon2's memory
+ *              comes from this thread's arena rather than a fresh allocation per hash.
+ *
+ *    Params:  dest - the std string object to store the hash
+ *             passwd - the password to be hashed
+ *
+ *    Throws: runtime_error if Argon2 fails, such as when it can't get its memory
+ *****************************************************************************************************/
+void PasswdMgr::hashArgon2(std::vector<uint8_t> &ret_hash, std::vector<uint8_t> &ret_salt, 
+                           const char *in_passwd, std::vector<uint8_t> *in_salt) {
+   // Hash those passwords!!!!
+   uint8_t hash1[hashlen];
+
+   uint8_t salt[saltlen];
+   memset( salt, 0x00, saltlen );
+
+   if (in_salt != NULL)
+      memcpy(salt, in_salt->data(), std::min((size_t) saltlen, in_salt->size()));
+
+   // Same parameters and version as argon2i_hash_raw, so existing hashes still match
+   argon2_context context;
+   memset(&context, 0, sizeof(context));
+   context.out = hash1;
+   context.outlen = hashlen;
+   context.pwd = (uint8_t *) in_passwd;
+   context.pwdlen = strlen(in_passwd);
+   context.salt = salt;
+   context.saltlen = saltlen;
+   context.t_cost = argon2_t_cost;
+   context.m_cost = argon2_m_cost;
+   context.lanes = argon2_lanes;
+   context.threads = argon2_lanes;
+   context.version = ARGON2_VERSION_NUMBER;
+   context.allocate_cbk = allocArena;
+   context.free_cbk = freeArena;
+   context.flags = ARGON2_DEFAULT_FLAGS;
+
+   int results = argon2i_ctx(&context);
+   if (results != ARGON2_OK)
+      throw std::runtime_error(std::string("Argon2 hash failed: ") + argon2_error_message(results));
+
+   ret_hash.assign(hash1, hash1 + hashlen);
+   ret_salt.assign(salt, salt + saltlen);
+
+}
+
+/*****************************************************************************************************
+ * warmArena - sets up this thread's Argon2 arena ahead of its first hash, so that hash doesn't
+ *             pay for mapping and faulting it
+ *
+ *    Returns: false if the memory couldn't be mapped
+ *****************************************************************************************************/
+
+bool PasswdMgr::warmArena() {
+   return hash_arena.reserve((size_t) argon2_m_cost * 1024);
+}
+
+/****************************************************************************************************
+ * addUser - First, confirms the user doesn't exist. If not found, then adds the new user with a new
+ *           password and random salt. The record goes into its free slot with one pwrite; if that
+ *           would leave the table more than half full, the whole file is rewritten at twice the
+ *           size instead. A missing password file is created.
+ *
+ *    Throws: pwfile_error if issues editing the password file, or the user already exists or their
+ *            name is too long to fit in a record
+ ****************************************************************************************************/
+
+void PasswdMgr::addUser(const char *name, const char *passwd) {
+   // Add those users!
+   std::string username(name);
+   if (username.empty() || (username.size() >= pwdb_name_len))
+      throw pwfile_error("Username must be 1 to " + std::to_string(pwdb_name_len - 1) + " characters");
+
+   std::vector<uint8_t> ret_hash;
+   std::vector<uint8_t> in_salt;
+   newSalt(in_salt);
+   hashArgon2(ret_hash, in_salt, passwd, &in_salt);
+
+   if (access(_pwd_file.c_str(), F_OK) != 0)
+      writeDB(std::unordered_map<std::string, PasswdEntry>());
+
+   PasswdView view;
+   openDB(view);
+   uint32_t capacity = view.header()->capacity;
+   uint32_t count = view.header()->count;
+
+   bool found;
+   long slot = findSlot(view.records(), capacity, name, found);
+   if (found)
+      throw pwfile_error("User already exists");
+
+   // Too full to take another in place, so grow the table
+   if ((slot < 0) || ((count + 1) * 2 > capacity)) {
+      std::unordered_map<std::string, PasswdEntry> users;
+      readAll(users);
+      users[username] = {ret_hash, in_salt};
+      writeDB(users, capacity * 2);
+      return;
+   }
+
+   FileFD pwfile(_pwd_file.c_str());
+   if (!pwfile.openFile(FileFD::updatefd))
+      throw pwfile_error("Could not open passwd file for writing");
+
+   count++;
+   bool ok = (writeUser(pwfile, slot, username, ret_hash, in_salt) == sizeof(PasswdRecord)) &&
+             (pwfile.pwriteFD(&count, sizeof(count), offsetof(PasswdHeader, count)) == sizeof(count)) &&
+             pwfile.syncFD(true);
+   pwfile.closeFD();
+
+   if (!ok)
+      throw pwfile_error("Write to passwd file failed");
+}
+
+/****************************************************************************************************
+ * addUsers - Adds a batch of users in one go. Names that are bad, already in the file or repeated
+ *            in the batch are skipped with a message. The rest are hashed, each with its own random
+ *            salt, on num_threads threads at once (each with its own 64 MiB Argon2 arena), then the
+ *            whole file is rewritten once with the old and new users together.
+ *
+ *    Params:  accounts - (username, password) pairs; the passwords are wiped once hashed
+ *             num_threads - how many passwords to hash at once
+ *
+ *    Returns: how many users were added
+ *
+ *    Throws: pwfile_error if the password file can't be read or written, runtime_error if a hash
+ *            fails. Nothing is written in either case.
+ ****************************************************************************************************/
+
+unsigned int PasswdMgr::addUsers(std::vector<std::pair<std::string, std::string>> &accounts,
+                                 unsigned int num_threads) {
+   std::unordered_map<std::string, PasswdEntry> users;
+   if (access(_pwd_file.c_str(), F_OK) == 0)
+      readAll(users);
+
+   // Weed out the ones we can't add before spending any time hashing
+   std::vector<size_t> todo;
+   std::unordered_map<std::string, size_t> batch;
+   for (size_t i=0; i < accounts.size(); i++) {
+      const std::string &name = accounts[i].first;
+      if (name.empty() || (name.size() >= pwdb_name_len))
+         std::cout << "Skipping " << name << ": names must be 1 to " << pwdb_name_len - 1 << " characters\n";
+      else if (users.count(name) > 0)
+         std::cout << "Skipping " << name << ": already has an account\n";
+      else if (!batch.emplace(name, i).second)
+         std::cout << "Skipping " << name << ": listed more than once\n";
+      else
+         todo.push_back(i);
+   }
+
+   // Each thread takes the next account until they're all done
+   std::vector<PasswdEntry> entries(todo.size());
+   std::atomic<size_t> next(0);
+   std::atomic<bool> failed(false);
+   auto hasher = [&]() {
+      size_t job;
+      while (!failed && ((job = next++) < todo.size())) {
+         std::string &passwd = accounts[todo[job]].second;
+         try {
+            newSalt(entries[job].salt);
+            hashArgon2(entries[job].hash, entries[job].salt, passwd.c_str(), &entries[job].salt);
+         } catch (std::runtime_error &e) {
+            std::cout << "Hashing failed for " << accounts[todo[job]].first << ": " << e.what() << std::endl;
+            failed = true;
+         }
+         std::fill(passwd.begin(), passwd.end(), '\0');
+      }
+   };
+
+   num_threads = std::max(1U, std::min(num_threads, (unsigned int) todo.size()));
+   std::vector<std::thread> threads;
+   for (unsigned int i=1; i < num_threads; i++)
+      threads.emplace_back(hasher);
+   hasher();
+   for (std::thread &th : threads)
+      th.join();
+
+   if (failed)
+      throw std::runtime_error("Could not hash every password, no users added");
+   if (todo.empty())
+      return 0;
+
+   for (size_t i=0; i < todo.size(); i++)
+      users[accounts[todo[i]].first] = std::move(entries[i]);
+   writeDB(users);
+
+   return todo.size();
+}
@@ -0,0 +1,229 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <boost/integer/common_factor.hpp>
+#include "PrimeCache.h"
+
+// Header is the magic string, the bytes per stored number and four reserved bytes
+const unsigned int cache_hdrsize = 16;
+
+/******************************************************************************************
+ * PrimeCache (constructor) - sets up the cache, but does not touch the file until load()
+ *
+ *    Params:  filename - the cache file, created if it doesn't exist
+ *             max_mb - the most the file is allowed to grow to; records past this are kept
+ *                      out of the cache
+ ******************************************************************************************/
+
+PrimeCache::PrimeCache(const char *filename, unsigned int max_mb):_filename(filename),
+                                                                  _cachefile(filename) {
+   _num_bytes = std::numeric_limits<LARGEINT>::digits / 8;
+   _max_records = ((size_t) max_mb << 20) / (2 * _num_bytes);
+}
+
+PrimeCache::~PrimeCache() {
+   if (_writable)
+      _cachefile.closeFD();
+}
+
+/******************************************************************************************
+ * load - maps the cache file in and loads every complete record. A new file is created with
+ *        just the header if there isn't one. A partial record at the end (a write torn by a
+ *        crash) is cut off so new records stay aligned.
+ *
+ *    Throws: runtime_error if the file is not a cache file or holds a different number width
+ ******************************************************************************************/
+
+void PrimeCache::load() {
+   std::unique_lock<std::shared_timed_mutex> guard(_lock);
+   size_t recsize = 2 * _num_bytes;
+
+   FileFD readfile(_filename.c_str());
+   if (readfile.openFile(FileFD::readfd)) {
+      struct stat st;
+      if (fstat(readfile.getFD(), &st) != 0) {
+         readfile.closeFD();
+         throw std::runtime_error("Could not stat prime cache file");
+      }
+
+      size_t filesize = st.st_size;
+      if (filesize > 0) {
+         void *map = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, readfile.getFD(), 0);
+         if (map == MAP_FAILED) {
+            readfile.closeFD();
+            throw std::runtime_error("Could not mmap prime cache file");
+         }
+         const uint8_t *data = (const uint8_t *) map;
+
+         uint32_t stored_bytes = 0;
+         if (filesize >= cache_hdrsize)
+            memcpy(&stored_bytes, data + sizeof(cache_magic), sizeof(stored_bytes));
+
+         if ((filesize < cache_hdrsize) || (memcmp(data, cache_magic, sizeof(cache_magic)) != 0) ||
+             (stored_bytes != _num_bytes)) {
+            munmap(map, filesize);
+            readfile.closeFD();
+            throw std::runtime_error("Prime cache file is corrupt or from a different build");
+         }
+
+         size_t records = (filesize - cache_hdrsize) / recsize;
+         madvise(map, filesize, MADV_SEQUENTIAL);
+         for (size_t i=0; i < records; i++) {
+            const uint8_t *rec = data + cache_hdrsize + i * recsize;
+            insert(unpackLargeInt(rec), unpackLargeInt(rec + _num_bytes));
+         }
+         munmap(map, filesize);
+
+         if (filesize != cache_hdrsize + records * recsize)
+            truncate(_filename.c_str(), cache_hdrsize + records * recsize);
+      }
+      readfile.closeFD();
+
+      if (filesize > 0) {
+         _writable = _cachefile.openFile(FileFD::appendfd);
+         return;
+      }
+   }
+
+   // No cache yet (or an empty file), start one
+   if (!_cachefile.openFile(FileFD::createfd))
+      return;
+
+   uint8_t header[cache_hdrsize];
+   memset(header, 0, cache_hdrsize);
+   memcpy(header, cache_magic, sizeof(cache_magic));
+   uint32_t num_bytes = _num_bytes;
+   memcpy(header + sizeof(cache_magic), &num_bytes, sizeof(num_bytes));
+
+   _writable = (_cachefile.writeFD((const char *) header, cache_hdrsize) == cache_hdrsize);
+}
+
+/******************************************************************************************
+ * lookup - finds the prime divisors of n that we already know about. First checks for n
+ *          itself, then takes the gcd of n against each running product of known primes and
+ *          trial-divides by the primes in any product that shares a factor with n.
+ *
+ *    Params:  n - the number about to be factored
+ *             divisors - populated with the known prime divisors of n (without repeats)
+ *
+ *    Returns: true if any known prime divides n
+ ******************************************************************************************/
+
+bool PrimeCache::lookup(LARGEINT n, std::list<LARGEINT> &divisors) {
+   std::shared_lock<std::shared_timed_mutex> guard(_lock);
+
+   divisors.clear();
+   if (n < 2)
+      return false;
+
+   auto found = _known.find(n);
+   if (found != _known.end()) {
+      divisors.assign(found->second.begin(), found->second.end());
+      return true;
+   }
+
+   cpp_int bign = n;
+   for (size_t i=0; i < _products.size(); i++) {
+      if (boost::math::gcd(cpp_int(_products[i] % bign), bign) == 1)
+         continue;
+
+      // Only a few dozen primes went into each product, so just try them all
+      for (LARGEINT &p : _chunk_primes[i]) {
+         if (n % p == 0)
+            divisors.push_back(p);
+      }
+   }
+
+   return !divisors.empty();
+}
+
+/******************************************************************************************
+ * add - records the prime divisors found for n and appends the new records to the cache
+ *       file in one write
+ *
+ *    Params:  n - the number that was factored
+ *             primes - prime divisors found for n (repeats are fine)
+ ******************************************************************************************/
+
+void PrimeCache::add(LARGEINT n, const std::list<LARGEINT> &primes) {
+   std::unique_lock<std::shared_timed_mutex> guard(_lock);
+   std::vector<uint8_t> newrecs;
+
+   for (const LARGEINT &p : primes) {
+      if (insert(p, p)) {
+         packLargeInt(p, newrecs);
+         packLargeInt(p, newrecs);
+      }
+      if ((n != p) && insert(n, p)) {
+         packLargeInt(n, newrecs);
+         packLargeInt(p, newrecs);
+      }
+   }
+
+   if (_writable && !newrecs.empty())
+      _cachefile.writeBytes(newrecs);
+}
+
+size_t PrimeCache::getNumRecords() {
+   std::shared_lock<std::shared_timed_mutex> guard(_lock);
+   return _num_records;
+}
+
+/******************************************************************************************
+ * insert - adds a (number, prime divisor) pair to the in-memory index. The caller holds the
+ *          lock.
+ *
+ *    Returns: true if it was new and there was room for it
+ ******************************************************************************************/
+
+bool PrimeCache::insert(LARGEINT n, LARGEINT p) {
+   if (_num_records >= _max_records)
+      return false;
+
+   std::vector<LARGEINT> &divs = _known[n];
+   for (LARGEINT &d : divs) {
+      if (d == p)
+         return false;
+   }
+   divs.push_back(p);
+   _num_records++;
+
+   if (n == p)
+      addToProducts(p);
+   return true;
+}
+
+/******************************************************************************************
+ * addToProducts - multiplies a newly learned prime into the current running product,
+ *                 starting a new product once the current one is prod_chunk_bits wide
+ ******************************************************************************************/
+
+void PrimeCache::addToProducts(LARGEINT p) {
+   if (_products.empty() || (msb(_products.back()) + msb(p) + 2 > prod_chunk_bits)) {
+      _products.push_back(1);
+      _chunk_primes.emplace_back();
+   }
+   _products.back() *= p;
+   _chunk_primes.back().push_back(p);
+}
+
+/******************************************************************************************
+ * packLargeInt/unpackLargeInt - convert between LARGEINT and _num_bytes little-endian bytes
+ ******************************************************************************************/
+
+void PrimeCache::packLargeInt(LARGEINT n, std::vector<uint8_t> &buf) {
+   for (size_t i=0; i < _num_bytes; i++) {
+      buf.push_back(static_cast<uint8_t>(n & 0xff));
+      n >>= 8;
+   }
+}
+
+LARGEINT PrimeCache::unpackLargeInt(const uint8_t *buf) {
+   LARGEINT n = 0;
+   for (size_t i=_num_bytes; i > 0; i--)
+      n = (n << 8) | buf[i - 1];
+   return n;
+}
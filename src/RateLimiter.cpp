@@ -0,0 +1,116 @@
+#include <algorithm>
+#include "RateLimiter.h"
+
+static const float limit_burst[l_num_limits] = { conn_burst, auth_burst };
+static const float limit_per_sec[l_num_limits] = { conn_per_sec, auth_per_sec };
+
+RateLimiter::RateLimiter(unsigned int slots):_table(slots),_mask(slots - 1),
+                                             _started(std::chrono::steady_clock::now()) {
+   _idle_ms = 0;
+   for (unsigned int i=0; i < l_num_limits; i++)
+      _idle_ms = std::max(_idle_ms, (uint64_t) (1000 * limit_burst[i] / limit_per_sec[i]));
+}
+
+/******************************************************************************************
+ * admit - brings the address's buckets up to date and takes a token from the one for kind
+ *
+ *    Params:  ipaddr - the source address, as SocketFD::getIPAddr gives it
+ *             kind - which limit to charge
+ *
+ *    Returns: false if the bucket is empty and the work should be turned away
+ ******************************************************************************************/
+
+bool RateLimiter::admit(uint32_t ipaddr, limittype kind) {
+   if (ipaddr == 0)
+      return true;
+
+   std::lock_guard<std::mutex> guard(_lock);
+   uint64_t now_ms = getNowMs();
+   if (now_ms - _last_sweep_ms >= ratelimit_sweep_secs * 1000)
+      sweep(now_ms);
+
+   Entry *entry = findEntry(ipaddr, now_ms);
+   if (entry == NULL)
+      return true;
+
+   refill(*entry, now_ms);
+   if (entry->tokens[kind] < 1)
+      return false;
+   entry->tokens[kind] -= 1;
+   return true;
+}
+
+size_t RateLimiter::getTracked() {
+   std::lock_guard<std::mutex> guard(_lock);
+   return _used;
+}
+
+/******************************************************************************************
+ * findEntry - finds the address's slot, adding it with full buckets if it's new. A full table
+ *             is swept first, but at most once a second, so a table full of busy addresses
+ *             doesn't turn every accept into a sweep.
+ *
+ *    Returns: the entry, or NULL if there's no room for a new address
+ ******************************************************************************************/
+
+RateLimiter::Entry *RateLimiter::findEntry(uint32_t ipaddr, uint64_t now_ms) {
+   uint32_t slot = (ipaddr * 2654435761U) & _mask;
+   while (_table[slot].ipaddr != 0) {
+      if (_table[slot].ipaddr == ipaddr)
+         return &_table[slot];
+      slot = (slot + 1) & _mask;
+   }
+
+   if ((_used + 1) * 4 > _table.size() * 3) {
+      if (now_ms - _last_sweep_ms < 1000)
+         return NULL;
+      sweep(now_ms);
+      if ((_used + 1) * 4 > _table.size() * 3)
+         return NULL;
+      return findEntry(ipaddr, now_ms);
+   }
+
+   Entry &entry = _table[slot];
+   entry.ipaddr = ipaddr;
+   for (unsigned int i=0; i < l_num_limits; i++)
+      entry.tokens[i] = limit_burst[i];
+   entry.touched_ms = now_ms;
+   _used++;
+   return &entry;
+}
+
+void RateLimiter::refill(Entry &entry, uint64_t now_ms) {
+   float elapsed = (now_ms - entry.touched_ms) / 1000.0f;
+   for (unsigned int i=0; i < l_num_limits; i++)
+      entry.tokens[i] = std::min(limit_burst[i], entry.tokens[i] + elapsed * limit_per_sec[i]);
+   entry.touched_ms = now_ms;
+}
+
+/******************************************************************************************
+ * sweep - rebuilds the table with only the addresses that still have a bucket refilling.
+ *         Rebuilding rather than deleting in place keeps the probe chains intact without
+ *         tombstones.
+ ******************************************************************************************/
+
+void RateLimiter::sweep(uint64_t now_ms) {
+   std::vector<Entry> live;
+   for (Entry &entry : _table) {
+      if ((entry.ipaddr != 0) && (now_ms - entry.touched_ms < _idle_ms))
+         live.push_back(entry);
+      entry.ipaddr = 0;
+   }
+
+   for (Entry &entry : live) {
+      uint32_t slot = (entry.ipaddr * 2654435761U) & _mask;
+      while (_table[slot].ipaddr != 0)
+         slot = (slot + 1) & _mask;
+      _table[slot] = entry;
+   }
+   _used = live.size();
+   _last_sweep_ms = now_ms;
+}
+
+uint64_t RateLimiter::getNowMs() {
+   return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - _started).count();
+}
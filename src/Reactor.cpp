@@ -0,0 +1,333 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <iterator>
+#include "Reactor.h"
+
+/******************************************************************************************
+ * Reactor (constructor) - creates the epoll instance and the eventfd used to wake it
+ *
+ *    Params:  scheduler - hands out jobs to this reactor's connections
+ *             stats - where this reactor's thread records its metrics
+ *             auth - checks logins for this reactor's connections
+ *
+ *    Throws: socket_error if epoll could not be created
+ ******************************************************************************************/
+
+Reactor::Reactor(JobScheduler &scheduler, MetricShard &stats, AuthService &auth, RateLimiter &limiter,
+                 IPWhitelist &whitelist):_scheduler(scheduler),_stats(stats),_auth(auth),_limiter(limiter),
+                                         _whitelist(whitelist),_online(true) {
+   if ((_epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+      throw socket_error("Could not create epoll instance.");
+
+   if ((_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+      close(_epfd);
+      throw socket_error("Could not create eventfd.");
+   }
+}
+
+Reactor::~Reactor() {
+   close(_wakefd);
+   close(_epfd);
+}
+
+/******************************************************************************************
+ * bindListener - sets the listening socket nonblocking (we drain it on every edge) and
+ *                binds it to the ip address and port
+ *
+ *    Params:  reuse_port - share the port with the other reactors' listening sockets
+ *             backlog - how many connections the kernel queues for us to accept
+ *
+ *    Throws: socket_error for issues binding the socket
+ ******************************************************************************************/
+
+void Reactor::bindListener(const char *ip_addr, unsigned short port, bool reuse_port, int backlog) {
+   _backlog = backlog;
+   _listenfd.setNonBlocking();
+   _listenfd.bindFD(ip_addr, port, reuse_port);
+}
+
+/******************************************************************************************
+ * stop - flags the loop to finish and wakes it up in case it is blocked in epoll_wait
+ ******************************************************************************************/
+
+void Reactor::stop() {
+   _online = false;
+   wake();
+}
+
+/******************************************************************************************
+ * cancelJob - queues a job cancellation for one of our connections and wakes the loop to
+ *             send it. The scheduler calls this with its lock held, from whichever thread
+ *             handled the winning result, so it must not touch the connection directly.
+ ******************************************************************************************/
+
+void Reactor::cancelJob(int fd, unsigned long jobid) {
+   {
+      std::lock_guard<std::mutex> guard(_post_lock);
+      _cancels.emplace_back(fd, jobid);
+   }
+   wake();
+}
+
+/******************************************************************************************
+ * passwdChecked - queues the result of a connection's password check and wakes the loop to
+ *                 deliver it. Called from a hashing thread.
+ ******************************************************************************************/
+
+void Reactor::passwdChecked(int fd, uint64_t ticket, bool ok, uint64_t wait_us, uint64_t hash_us) {
+   {
+      std::lock_guard<std::mutex> guard(_post_lock);
+      _passwd_results.push_back({fd, ticket, ok, wait_us, hash_us});
+   }
+   wake();
+}
+
+void Reactor::wake() {
+   uint64_t one = 1;
+   if (write(_wakefd, &one, sizeof(one)) != sizeof(one))
+      std::cout << "Could not wake reactor.\n";
+}
+
+/******************************************************************************************
+ * handleWake - clears the eventfd and passes any posted cancellations and password check
+ *              results to their connections. A connection only acts on a job id or ticket it
+ *              still holds, so an FD that was closed and reused in the meantime ignores it.
+ ******************************************************************************************/
+
+void Reactor::handleWake() {
+   uint64_t count;
+   if (read(_wakefd, &count, sizeof(count)) < 0)
+      count = 0;
+
+   std::vector<std::pair<int, unsigned long>> cancels;
+   std::vector<PasswdResult> results;
+   {
+      std::lock_guard<std::mutex> guard(_post_lock);
+      cancels.swap(_cancels);
+      results.swap(_passwd_results);
+   }
+
+   for (auto &cancel : cancels) {
+      auto found = _conns.find(cancel.first);
+      if (found == _conns.end())
+         continue;
+
+      found->second->cancelJob(cancel.second);
+      dropIfDisconnected(found);
+   }
+
+   for (PasswdResult &result : results) {
+      _stats.record(h_auth_wait_us, result.wait_us);
+      _stats.record(h_auth_hash_us, result.hash_us);
+
+      auto found = _conns.find(result.fd);
+      if (found == _conns.end())
+         continue;
+
+      found->second->passwdChecked(result.ticket, result.ok);
+      dropIfDisconnected(found);
+   }
+}
+
+/******************************************************************************************
+ * handleTimers - fires every timer that is due, handing each to the connection it belongs to
+ *                and dropping any connection that disconnected over it. A connection cancels
+ *                its timers when it goes, so one not found here was dropped earlier in this
+ *                same batch.
+ ******************************************************************************************/
+
+void Reactor::handleTimers() {
+   _timers.expire(std::chrono::steady_clock::now(), _fired);
+
+   for (TimerEvent &event : _fired) {
+      if (event.kind == reactor_timer_tick) {
+         handleTick();
+         continue;
+      }
+
+      auto found = _conns.find(event.fd);
+      if (found == _conns.end())
+         continue;
+
+      found->second->handleTimer(event.kind, event.arg);
+      dropIfDisconnected(found);
+   }
+}
+
+/******************************************************************************************
+ * handleTick - offers work to every connection with room for it, then sets the next tick.
+ *              Jobs normally go out when an answer comes back, so without this an idle client
+ *              would never pick up a twin of a job that started straggling after it went idle.
+ ******************************************************************************************/
+
+void Reactor::handleTick() {
+   TimerEvent tick = {-1, reactor_timer_tick, 0};
+   _timers.schedule(reactor_tick_ms, tick);
+
+   for (auto conn = _conns.begin(); conn != _conns.end(); ) {
+      auto next = std::next(conn);
+      conn->second->topUp();
+      dropIfDisconnected(conn);
+      conn = next;
+   }
+}
+
+/******************************************************************************************
+ * addFD - registers an FD for edge-triggered read and hangup events, and for connections,
+ *         write events too. Being edge-triggered, EPOLLOUT only comes when a full send
+ *         buffer gets room again, which is exactly when a connection has queued output to
+ *         finish sending, so it can stay registered without waking us otherwise.
+ *
+ *    Params:  writes - also report the FD becoming writable
+ *
+ *    Throws: socket_error if epoll rejects it
+ ******************************************************************************************/
+
+void Reactor::addFD(int fd, bool writes) {
+   struct epoll_event ev;
+   ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+   if (writes)
+      ev.events |= EPOLLOUT;
+   ev.data.fd = fd;
+
+   if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+      throw socket_error("Could not add FD to epoll.");
+}
+
+/******************************************************************************************
+ * run - starts listening and loops waiting on epoll, dispatching each ready FD. Nothing
+ *       sleeps; a quiet server simply blocks in epoll_wait until the next timer is due.
+ *
+ *    Throws: socket_error for unrecoverable epoll or socket issues
+ ******************************************************************************************/
+
+void Reactor::run() {
+   struct epoll_event events[max_epoll_events];
+
+   // Start the server socket listening
+   _listenfd.listenFD(_backlog);
+   addFD(_listenfd.getFD());
+   addFD(_wakefd);
+
+   TimerEvent tick = {-1, reactor_timer_tick, 0};
+   _timers.schedule(reactor_tick_ms, tick);
+
+   while (_online) {
+      int n = epoll_wait(_epfd, events, max_epoll_events, _timers.getWaitMs(std::chrono::steady_clock::now()));
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         throw socket_error("epoll_wait failed.");
+      }
+
+      for (int i=0; (i < n) && _online; i++) {
+         if (events[i].data.fd == _wakefd)
+            handleWake();
+         else if (events[i].data.fd == _listenfd.getFD())
+            acceptConnections();
+         else
+            handleEvent(events[i].data.fd, events[i].events);
+      }
+
+      if (_online)
+         handleTimers();
+   }
+
+   _listenfd.closeFD();
+}
+
+/******************************************************************************************
+ * acceptConnections - accepts every connection waiting on the listening socket. With
+ *                     edge-triggered events we won't hear about these again, so we keep
+ *                     going until accept runs dry. A client that gave up while it sat in the
+ *                     queue is skipped rather than ending the drain. Hosts that aren't on the
+ *                     whitelist, or are connecting faster than their rate limit allows, are
+ *                     hung up on before anything else is done.
+ ******************************************************************************************/
+
+void Reactor::acceptConnections() {
+   while (true) {
+      std::unique_ptr<TCPConn> new_conn(new TCPConn(_scheduler, *this, _timers, _stats, _auth, *this, _limiter));
+      if (!new_conn->accept(_listenfd)) {
+         if ((errno == EINTR) || (errno == ECONNABORTED))
+            continue;
+         if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            std::cout << "Data received on socket but failed to accept: " << strerror(errno) << "\n";
+         return;
+      }
+
+      // Get their IP Address string to use in logging
+      std::string ipaddr_str;
+      new_conn->getIPAddrStr(ipaddr_str);
+
+      std::cout << "Client IP: " << ipaddr_str << std::endl;//testing
+
+      //check is the client ip address on the whitelist
+      if (!_whitelist.isAllowed(new_conn->getIPAddr())) {
+         std::cout << "This IP address is not authorized" << std::endl;
+         new_conn->sendText("Not Authorized To Log into System\n");
+         new_conn->disconnect();
+         _stats.count(c_conns_refused);
+         continue;
+      }
+
+      if (!_limiter.admit(new_conn->getIPAddr(), l_connect)) {
+         new_conn->disconnect();
+         _stats.count(c_conns_limited);
+         continue;
+      }
+
+      std::cout << "***Got a connection***\n";
+      _stats.count(c_conns_accepted);
+
+      int fd = new_conn->getFD();
+      addFD(fd, true);
+
+      new_conn->startAuthentication();
+      _conns[fd] = std::move(new_conn);
+   }
+}
+
+/******************************************************************************************
+ * handleEvent - sends a writable connection whatever output it has queued and lets a readable
+ *               one process everything it has received, then drops it if it hung up or was
+ *               disconnected
+ ******************************************************************************************/
+
+void Reactor::handleEvent(int fd, uint32_t events) {
+   auto found = _conns.find(fd);
+   if (found == _conns.end())
+      return;
+
+   TCPConn *conn = found->second.get();
+
+   if (events & EPOLLOUT)
+      conn->flushOutput();
+
+   // Process any user inputs
+   if (conn->isConnected() && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+      conn->handleConnection();
+
+   if ((events & (EPOLLHUP | EPOLLERR)) && conn->isConnected())
+      conn->disconnect();
+
+   dropIfDisconnected(found);
+}
+
+/******************************************************************************************
+ * dropIfDisconnected - if the user lost connection, remove them (closing the FD also drops
+ *                      it from epoll)
+ ******************************************************************************************/
+
+void Reactor::dropIfDisconnected(std::unordered_map<int, std::unique_ptr<TCPConn>>::iterator conn) {
+   if (conn->second->isConnected())
+      return;
+
+   _conns.erase(conn);
+   _stats.count(c_conns_closed);
+   std::cout << "Connection disconnected.\n";
+}
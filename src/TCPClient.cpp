@@ -1,221 +1,514 @@
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#include <stdexcept>
-#include <strings.h>
-#include <stropts.h>
-#include <string.h>
-#include <sys/select.h>
-#include <stdio.h>
-#include <stdexcept>
-#include <iostream>
-#include <cstdlib>
-#include <algorithm>
-
-#include <boost/multiprecision/cpp_int.hpp>
-#include <boost/integer/common_factor.hpp>
-#include <thread>
-
-
-#include "TCPClient.h"
-#include "DivFinderServer.h"
-#include "strfuncts.h"
-
-
-/**********************************************************************************************
- * TCPClient (constructor) - Creates a Stdin file descriptor to simplify handling of user input. 
- *
- **********************************************************************************************/
-
-TCPClient::TCPClient() {
-}
-
-/**********************************************************************************************
- * TCPClient (destructor) - No cleanup right now
- *
- **********************************************************************************************/
-
-TCPClient::~TCPClient() {
-
-}
-
-/**********************************************************************************************
- * connectTo - Opens a File Descriptor socket to the IP address and port given in the
- *             parameters using a TCP connection.
- *
- *    Throws: socket_error exception if failed. socket_error is a child class of runtime_error
- **********************************************************************************************/
-
-void TCPClient::connectTo(const char *ip_addr, unsigned short port) {
-   if (!_sockfd.connectTo(ip_addr, port))
-      throw socket_error("TCP Connection failed!");
-
-}
-
-/**********************************************************************************************
- * handleConnection - Performs a loop that checks if the connection is still open, then 
- *                    looks for user input and sends it if available. Finally, looks for data
- *                    on the socket and sends it.
- * 
- *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
- **********************************************************************************************/
-
-void TCPClient::handleConnection() {
-   
-   bool connected = true;
-   int sin_bufsize = 0;
-   ssize_t rsize = 0;
-
-   timespec sleeptime;
-   sleeptime.tv_sec = 0;
-   sleeptime.tv_nsec = 1000000;
-
-
-   // Loop while we have a valid connection
-   while (connected) {
-
-      // If the connection was closed, exit
-      if (!_sockfd.isOpen())
-         break;
-
-      // Send any user input
-      if ((sin_bufsize = readStdin()) > 0)  {
-         std::string subbuf = _in_buf.substr(0, sin_bufsize+1);
-         _sockfd.writeFD(subbuf);
-         _in_buf.erase(0, sin_bufsize+1);
-      }
-
-      // Read any data from the socket and display to the screen and handle errors
-      std::string buf;
-      if (_sockfd.hasData()) {
-         if ((rsize = _sockfd.readFD(buf)) == -1) {
-            throw std::runtime_error("Read on client socket failed.");
-         }
-
-         // Select indicates data, but 0 bytes...usually because it's disconnected
-         if (rsize == 0) {
-            closeConn();
-            break;
-         }
-
-         // Display to the screen
-         if (rsize > 0) {
-            std::string subbuf2 = buf.substr(0, 3);
-            std::cout << "subBuf2: " << subbuf2 << std::endl;
-            if (subbuf2 == "NUM"){
-               std::cout << "1st Message" << std::endl;
-               std::string left;
-               std::string right;
-               split(buf, left, right, ' ');
-               std::cout << "right: " << right << std::endl;
-
-               this->inputNum = right;
-               this->initMessage = false;
-
-               	//Used 563, 197, 197, 163, 163, 41, 41, 
-               uint128_t num = static_cast<uint128_t>(this->inputNum);
-               
-               //auto d = DivFinderServer(num);
-               this->d = DivFinderServer(num);
-               this->d.setVerbose(3);
-
-               
-               //std::thread th(&DivFinderServer::simple, &d);
-               //std::thread th(&DivFinderServer::factorThread, &this->d, num);
-               this->th = new std::thread(&DivFinderServer::factorThread, &this->d, num);
-               //d.factorThread(num);
-
-               //std::this_thread::sleep_for(std::chrono::seconds(15));
-               //std::cout << "Ended Process" << std::endl;
-               //d.setEndProcess(true);
-               this->activeThread = true;
-               
-	            //th.join();
-               /*
-	            auto primeFound = d.getPrimeDivFound();
-
-               std::cout << "Prime Divisor Found : " << primeFound << std::endl;
-               
-               std::string mesg = static_cast<std::string>(d.getPrimeDivFound());
-               mesg = mesg + "\n"; 
-               std::cout << "Sending: " << mesg << std::endl;
-               std::this_thread::sleep_for(std::chrono::seconds(1));
-
-               
-               _sockfd.writeFD(mesg);*/
-
-            }
-            //std::cout << "Recieved string: " << this->inputNum << std::endl;
-            else{
-               printf("In else: %s\n", buf.c_str());
-               if (buf == "QuitCalc")
-                  this->d.setEndProcess(true);
-               fflush(stdout);
-            }
-         }
-      }
-
-      if (this->activeThread){
-         if(this->d.getPrimeDivFound() != 0){
-            std::cout << "Prime Divisor Found: " << this->d.getPrimeDivFound() << std::endl;
-            this->activeThread = false;
-               
-            std::string mesg = static_cast<std::string>(d.getPrimeDivFound());
-            mesg = mesg + "\n"; 
-            std::cout << "Sending: " << mesg << std::endl;
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-
-               
-            _sockfd.writeFD(mesg);
-         }
-      }
-
-      nanosleep(&sleeptime, NULL);
-   }
-}
-
-/**********************************************************************************************
- * closeConnection - Your comments here
- *
- *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
- **********************************************************************************************/
-
-void TCPClient::closeConn() {
-    _sockfd.closeFD(); 
-}
-
-/******************************************************************************
- * readStdin - takes input from the user and stores it in a buffer. We only send
- *             the buffer after a carriage return
- *
- *    Return: 0 if not ready to send, buffer length if ready
- *****************************************************************************/
-int TCPClient::readStdin() {
-
-   if (!_stdin.hasData()) {
-      return 0;
-   }
-
-   // More input, get it and concat it to the buffer
-   std::string readbuf;
-   int amt_read;
-   if ((amt_read = _stdin.readFD(readbuf)) < 0) {
-      throw std::runtime_error("Read on stdin failed unexpectedly.");
-   }
-   
-   _in_buf += readbuf;
-
-   // Did we either fill up the buffer or is there a newline/carriage return?
-   int sendto;
-   if (_in_buf.length() >= stdin_bufsize)
-      sendto = _in_buf.length();
-   else if ((sendto = _in_buf.find("\n")) == std::string::npos) {
-      return 0;
-   }
-   
-   return sendto;
-}
-
-
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <strings.h>
+#include <stropts.h>
+#include <string.h>
+#include <sys/select.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+#include <boost/multiprecision/cpp_int.hpp>
+#include <boost/integer/common_factor.hpp>
+#include <thread>
+
+
+#include "TCPClient.h"
+#include "DivFinderServer.h"
+#include "strfuncts.h"
+
+
+/**********************************************************************************************
+ * TCPClient (constructor) - Creates a Stdin file descriptor to simplify handling of user input
+ *                           and starts the factoring workers.
+ *
+ *    Params:  workers - number of jobs to factor at once, 0 for one per CPU in cpus
+ *             cpus - CPUs to pin the workers to, empty to leave them unpinned
+ *             cache - known primes to check jobs against, NULL for none
+ **********************************************************************************************/
+
+TCPClient::TCPClient(unsigned int workers, const std::vector<int> &cpus, PrimeCache *cache):
+                                             _pool(workers, false, cpus), _rng(std::random_device{}()) {
+   _pool.setCache(cache);
+   _caps.frames = true;
+}
+
+/**********************************************************************************************
+ * TCPClient (destructor) - No cleanup right now
+ *
+ **********************************************************************************************/
+
+TCPClient::~TCPClient() {
+
+}
+
+/**********************************************************************************************
+ * setLogin - sets the username and password used to answer the server's login prompts,
+ *            including when we log back in after a reconnect
+ **********************************************************************************************/
+
+void TCPClient::setLogin(const char *username, const char *passwd) {
+   _username = username;
+   _passwd = passwd;
+}
+
+/**********************************************************************************************
+ * connectTo - Opens a File Descriptor socket to the IP address and port given in the
+ *             parameters using a TCP connection.
+ *
+ *    Throws: socket_error exception if failed. socket_error is a child class of runtime_error
+ **********************************************************************************************/
+
+void TCPClient::connectTo(const char *ip_addr, unsigned short port) {
+   _ip_addr = ip_addr;
+   _port = port;
+
+   if (!_sockfd.connectTo(ip_addr, port))
+      throw socket_error("TCP Connection failed!");
+   _connected = true;
+
+   // Calibrate now so we have our numbers ready when the server asks for them
+   if (!_caps.isValid()) {
+      _caps.calibrate(_pool.getNumWorkers());
+      std::string capstr;
+      _caps.toString(capstr);
+      std::cout << "Calibrated: " << capstr << std::endl;
+   }
+}
+
+/**********************************************************************************************
+ * handleConnection - Performs a loop that checks if the connection is still open, then 
+ *                    looks for user input and sends it if available. Finally, looks for data
+ *                    on the socket and sends it.
+ *
+ *                    If the connection drops, the workers keep going and we keep trying to
+ *                    reconnect with exponential backoff. Anything that finishes in the meantime
+ *                    is held and reported once the server has logged us back in. Only returns
+ *                    if reconnecting is turned off.
+ * 
+ *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPClient::handleConnection() {
+   
+   bool connected = true;
+   int sin_bufsize = 0;
+   ssize_t rsize = 0;
+
+   timespec sleeptime;
+   sleeptime.tv_sec = 0;
+   sleeptime.tv_nsec = 1000000;
+
+
+   // Loop while we have a valid connection
+   while (connected) {
+
+      // If the connection was closed, try to get it back
+      if (!_connected || !_sockfd.isOpen()) {
+         if (_max_backoff_ms == 0)
+            break;
+
+         sendResults();
+         if (!reconnect()) {
+            nanosleep(&sleeptime, NULL);
+            continue;
+         }
+      }
+
+      // Send any user input
+      if ((sin_bufsize = readStdin()) > 0)  {
+         std::string subbuf = _in_buf.substr(0, sin_bufsize+1);
+         sendMsg(subbuf);
+         _in_buf.erase(0, sin_bufsize+1);
+      }
+
+      // Read any data from the socket and handle errors
+      if (_connected && _sockfd.hasData()) {
+         // Select indicates data, but 0 bytes...usually because it's disconnected
+         char readbuf[socket_bufsize];
+         if ((rsize = _sockfd.readFD(readbuf, socket_bufsize)) <= 0) {
+            lostConnection();
+            continue;
+         }
+
+         _sock_buf.append(readbuf, rsize);
+         handleServerData();
+      }
+
+      // Report back on anything the workers have finished
+      sendResults();
+
+      nanosleep(&sleeptime, NULL);
+   }
+}
+
+/**********************************************************************************************
+ * lostConnection - tears down a dropped connection and schedules the first reconnect attempt
+ **********************************************************************************************/
+
+void TCPClient::lostConnection() {
+   closeConn();
+   _connected = false;
+   _session = false;
+   _frames = false;
+   _sock_buf.clear();
+
+   std::cout << "Lost connection to server, " << _pool.inFlight() << " jobs still in progress" << std::endl;
+   _next_attempt = std::chrono::steady_clock::now() + std::chrono::milliseconds(_backoff_ms);
+}
+
+/**********************************************************************************************
+ * reconnect - tries to connect again once the backoff delay has passed. Each failure doubles
+ *             the delay, up to the max, with some jitter so a whole fleet that lost the same
+ *             server doesn't come back in lockstep.
+ *
+ *    Returns: true if we are connected again
+ **********************************************************************************************/
+
+bool TCPClient::reconnect() {
+   auto now = std::chrono::steady_clock::now();
+   if (now < _next_attempt)
+      return false;
+
+   if (_sockfd.connectTo(_ip_addr.c_str(), _port)) {
+      std::cout << "Reconnected to " << _ip_addr << " port " << _port << std::endl;
+      _connected = true;
+      return true;
+   }
+   _sockfd.closeFD();
+
+   _backoff_ms = std::min(_backoff_ms * 2, _max_backoff_ms);
+   std::uniform_int_distribution<unsigned int> jitter(_backoff_ms * 3 / 4, _backoff_ms * 5 / 4);
+   _next_attempt = now + std::chrono::milliseconds(jitter(_rng));
+   return false;
+}
+
+/**********************************************************************************************
+ * sendMsg - writes a message to the server, treating a failed write as a lost connection
+ **********************************************************************************************/
+
+void TCPClient::sendMsg(const std::string &msg) {
+   if (!_connected)
+      return;
+
+   if (_sockfd.writeFD(msg.c_str(), msg.size()) < 0)
+      lostConnection();
+}
+
+/**********************************************************************************************
+ * handleServerData - handles every complete message in the socket buffer. Messages are text
+ *                    lines until the server starts sending frames, and one read may hold
+ *                    several or only part of one. A run of frames is taken in one pass and
+ *                    trimmed off the buffer once. A malformed frame means we've lost our
+ *                    place in the stream, so we drop the connection and log back in.
+ **********************************************************************************************/
+
+void TCPClient::handleServerData() {
+   std::string msg;
+   while (_connected && !_sock_buf.empty()) {
+      if (!isFrameStart(_sock_buf[0])) {
+         if (!getServerLine(msg))
+            return;
+         handleServerMsg(msg);
+         continue;
+      }
+
+      Frame frame;
+      size_t used = 0;
+      int len = 0;
+      while (_connected && (used < _sock_buf.size()) && isFrameStart(_sock_buf[used]) &&
+             ((len = decodeFrame(_sock_buf.data() + used, _sock_buf.size() - used, frame)) > 0)) {
+         used += len;
+         handleServerFrame(frame);
+      }
+      _sock_buf.erase(0, used);
+
+      if (len < 0) {
+         std::cout << "Malformed frame from server, reconnecting" << std::endl;
+         lostConnection();
+         return;
+      }
+      if (used == 0)
+         return;
+   }
+}
+
+/**********************************************************************************************
+ * getServerLine - pulls the next complete, newline-terminated message out of the socket buffer
+ *
+ *    Params: line - populated with the message (newline removed) if one was found
+ *
+ *    Returns: true if a complete message was found, false otherwise
+ **********************************************************************************************/
+
+bool TCPClient::getServerLine(std::string &line) {
+   size_t crpos;
+   if ((crpos = _sock_buf.find("\n")) == std::string::npos) {
+      // Login prompts ("Username: ") are the one thing sent without a newline
+      if ((_sock_buf.size() >= 2) && (_sock_buf.compare(_sock_buf.size() - 2, 2, ": ") == 0)) {
+         line = _sock_buf;
+         _sock_buf.clear();
+         return true;
+      }
+      return false;
+   }
+
+   line = _sock_buf.substr(0, crpos);
+   _sock_buf.erase(0, crpos+1);
+   clrNewlines(line);
+   return true;
+}
+
+/**********************************************************************************************
+ * handleServerMsg - acts on a single message from the server:
+ *                      Username: / Password: - answer with our login, if we were given one.
+ *                             If we hold a session ticket from our last login, it goes in place
+ *                             of the username, and is used up whether it works or not
+ *                      TICKET <ticket> - a session ticket to log back in with next time
+ *                      CAPS - reply with our calibrated capabilities. The server only asks once
+ *                             we're logged in, so this also starts the session
+ *                      NUM <jobid> <number> [<seed> [<c> <dp_bits>]] - queue up a number to
+ *                             factor. A slice of a split number comes with the seed for our
+ *                             rho walk, and the polynomial constant shared by every walk on
+ *                             it plus how often to report points if the server is looking
+ *                             for collisions between walks
+ *                      QuitCalc [<jobid>] - stop working on a job (all jobs if no id given)
+ *                      PING - the server hasn't heard from us in a while; answer "PONG"
+ *
+ *    Throws: runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPClient::handleServerMsg(std::string &msg) {
+   std::string left, right;
+   if (!split(msg, left, right, ' ')) {
+      left = msg;
+      lower(left);
+   }
+
+   if ((msg == "Username: ") || (msg == "Password: ")) {
+      std::cout << msg;
+      if (_username.empty()) {
+         fflush(stdout);
+         return;
+      }
+      std::cout << std::endl;
+      if ((msg == "Username: ") && !_ticket.empty()) {
+         sendMsg("TICKET " + _ticket + "\n");
+         _ticket.clear();
+         return;
+      }
+      sendMsg(((msg == "Username: ") ? _username : _passwd) + "\n");
+
+   } else if (left == "ticket") {
+      _ticket = right;
+
+   } else if (left == "caps") {
+      std::string capstr;
+      _caps.toString(capstr);
+      capstr = "CAPS " + capstr + "\n";
+      sendMsg(capstr);
+
+      _session = true;
+      _backoff_ms = min_backoff_ms;
+      flushResults();
+
+   } else if (left == "num") {
+      // Older servers send just the number with no job id
+      std::string idstr, numstr, seedstr, cstr, dpstr, rest;
+      if (!split(right, idstr, numstr, ' ')) {
+         idstr = "0";
+         numstr = right;
+      }
+      if (split(numstr, rest, seedstr, ' '))
+         numstr = rest;
+      if (split(seedstr, rest, cstr, ' '))
+         seedstr = rest;
+      if (split(cstr, rest, dpstr, ' '))
+         cstr = rest;
+      std::cout << "Job " << idstr << ": " << numstr << std::endl;
+
+      FactorJob job;
+      job.jobid = strtoul(idstr.c_str(), NULL, 10);
+      job.seed = strtoull(seedstr.c_str(), NULL, 10);
+      try {
+         job.num = LARGEINT(numstr);
+         if (!cstr.empty() && !dpstr.empty()) {
+            job.dp_c = LARGEINT(cstr);
+            job.dp_bits = strtoul(dpstr.c_str(), NULL, 10);
+         }
+      } catch (std::runtime_error &e) {
+         std::cout << "Bad job from server, skipping it: " << msg << std::endl;
+         return;
+      }
+      _pool.submit(job);
+
+   } else if (left == "ping") {
+      sendMsg("PONG\n");
+
+   } else if (left == "quitcalc") {
+      if (right.empty())
+         _pool.cancelAll();
+      else
+         _pool.cancel(strtoul(right.c_str(), NULL, 10));
+
+   } else {
+      std::cout << "Server: " << msg << std::endl;
+   }
+}
+
+/**********************************************************************************************
+ * handleServerFrame - acts on a single frame from the server, the binary form of NUM,
+ *                     QuitCalc and PING (see Frame.h)
+ **********************************************************************************************/
+
+void TCPClient::handleServerFrame(const Frame &frame) {
+   _frames = true;
+
+   switch (frame.type) {
+      case f_num: {
+         std::cout << "Job " << frame.jobid << ": " << frame.num << std::endl;
+
+         FactorJob job;
+         job.jobid = frame.jobid;
+         job.num = frame.num;
+         job.seed = frame.seed;
+         if (frame.dp_c != 0) {
+            job.dp_c = frame.dp_c;
+            job.dp_bits = frame.dp_bits;
+         }
+         _pool.submit(job);
+         break;
+      }
+
+      case f_quit:
+         if (frame.jobid == 0)
+            _pool.cancelAll();
+         else
+            _pool.cancel(frame.jobid);
+         break;
+
+      case f_ping: {
+         Frame pong;
+         pong.type = f_pong;
+         std::string msg;
+         encodeFrame(pong, msg);
+         sendMsg(msg);
+         break;
+      }
+   }
+}
+
+/**********************************************************************************************
+ * sendResults - queues a divisor answer for every job the workers have finished and sends
+ *               them if we have a session. Distinguished points the walks reported go out in
+ *               one write; they are only useful while the walk is live, so they are dropped
+ *               rather than held if we have no session. Both go as frames once the server has
+ *               shown it takes them, otherwise as "DIV <jobid> <divisor>" and
+ *               "DP <jobid> <value>" lines.
+ **********************************************************************************************/
+
+void TCPClient::sendResults() {
+   FactorPoint point;
+   std::string points;
+   while (_pool.getPoint(point)) {
+      if (_frames) {
+         Frame frame;
+         frame.type = f_dp;
+         frame.jobid = point.jobid;
+         frame.num = point.value;
+         encodeFrame(frame, points);
+      } else {
+         points += "DP " + std::to_string(point.jobid) + " " + point.value.str() + "\n";
+      }
+   }
+
+   if (_session && !points.empty())
+      sendMsg(points);
+
+   FactorResult result;
+   while (_pool.getResult(result)) {
+      Frame answer;
+      answer.type = f_div;
+      answer.jobid = result.jobid;
+      answer.num = result.primes.empty() ? LARGEINT(0) : result.primes.front();
+      std::cout << "Prime Divisor Found: " << answer.num << std::endl;
+
+      _unsent.push_back(answer);
+   }
+
+   flushResults();
+}
+
+/**********************************************************************************************
+ * flushResults - sends held results, oldest first, keeping any we fail to send. Each goes in
+ *                whichever form the current connection takes.
+ **********************************************************************************************/
+
+void TCPClient::flushResults() {
+   while (_session && !_unsent.empty()) {
+      const Frame &answer = _unsent.front();
+      std::cout << "Sending: DIV " << answer.jobid << " " << answer.num << std::endl;
+
+      std::string msg;
+      if (_frames)
+         encodeFrame(answer, msg);
+      else
+         msg = "DIV " + std::to_string(answer.jobid) + " " + answer.num.str() + "\n";
+
+      if (_sockfd.writeFD(msg) < 0) {
+         lostConnection();
+         return;
+      }
+      _unsent.pop_front();
+   }
+}
+
+/**********************************************************************************************
+ * closeConnection - Your comments here
+ *
+ *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPClient::closeConn() {
+    _sockfd.closeFD(); 
+}
+
+/******************************************************************************
+ * readStdin - takes input from the user and stores it in a buffer. We only send
+ *             the buffer after a carriage return
+ *
+ *    Return: 0 if not ready to send, buffer length if ready
+ *****************************************************************************/
+int TCPClient::readStdin() {
+
+   if (!_stdin.hasData()) {
+      return 0;
+   }
+
+   // More input, get it and concat it to the buffer
+   std::string readbuf;
+   int amt_read;
+   if ((amt_read = _stdin.readFD(readbuf)) < 0) {
+      throw std::runtime_error("Read on stdin failed unexpectedly.");
+   }
+   
+   _in_buf += readbuf;
+
+   // Did we either fill up the buffer or is there a newline/carriage return?
+   int sendto;
+   if (_in_buf.length() >= stdin_bufsize)
+      sendto = _in_buf.length();
+   else if ((sendto = _in_buf.find("\n")) == std::string::npos) {
+      return 0;
+   }
+   
+   return sendto;
+}
+
+
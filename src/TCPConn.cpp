@@ -1,414 +1,889 @@
-#include <stdexcept>
-#include <strings.h>
-#include <unistd.h>
-#include <cstring>
-#include <algorithm>
-#include <iostream>
-#include <fstream>
-#include <memory>
-#include "TCPConn.h"
-#include "strfuncts.h"
-#include "PasswdMgr.h"
-
-// The filename/path of the password file
-const char pwdfilename[] = "passwd";
-
-TCPConn::TCPConn(){ // LogMgr &server_log):_server_log(server_log) {
-   this->PWMgr = std::make_unique<PasswdMgr>(pwdfilename);
-
-}
-
-
-TCPConn::~TCPConn() {
-
-}
-
-/**********************************************************************************************
- * accept - simply calls the acceptFD FileDesc method to accept a connection on a server socket.
- *
- *    Params: server - an open/bound server file descriptor with an available connection
- *
- *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
- **********************************************************************************************/
-
-bool TCPConn::accept(SocketFD &server) {
-   return _connfd.acceptFD(server);
-}
-
-/**********************************************************************************************
- * sendText - simply calls the sendText FileDesc method to send a string to this FD
- *
- *    Params:  msg - the string to be sent
- *             size - if we know how much data we should expect to send, this should be populated
- *
- *    Throws: runtime_error for unrecoverable errors
- **********************************************************************************************/
-
-int TCPConn::sendText(const char *msg) {
-   return sendText(msg, strlen(msg));
-}
-
-int TCPConn::sendText(const char *msg, int size) {
-   if (_connfd.writeFD(msg, size) < 0) {
-      return -1;  
-   }
-   return 0;
-}
-
-/**********************************************************************************************
- * startAuthentication - Sets the status to request username
- *
- *    Throws: runtime_error for unrecoverable types
- **********************************************************************************************/
-
-void TCPConn::startAuthentication() {
-
-   // Skipping this for now
-   //_status = s_username;
-
-   _status = s_sendNumber;
-
-   //_connfd.writeFD("Username: "); 
-
-}
-
-/**********************************************************************************************
- * handleConnection - performs a check of the connection, looking for data on the socket and
- *                    handling it based on the _status, or stage, of the connection
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-
-void TCPConn::handleConnection() {
-
-   timespec sleeptime;
-   sleeptime.tv_sec = 0;
-   sleeptime.tv_nsec = 100000000;
-
-   //std::cout << "_status: " << _status << std::endl;
-
-   try {
-      switch (_status) {
-         case s_username:
-            getUsername();
-            break;
-
-         case s_passwd:
-            getPasswd();
-            break;
-   
-         case s_changepwd:
-         case s_confirmpwd:
-            changePassword();
-            break;
-
-         case s_menu:
-            getMenuChoice();
-
-            break;
-
-         case s_sendNumber:
-            sendNumber();
-            break;
-
-         case s_waitForReply:
-            waitForDivisor();
-            break;
-
-         default:
-            throw std::runtime_error("Invalid connection status!");
-            break;
-      }
-   } catch (socket_error &e) {
-      std::cout << "Socket error, disconnecting.";
-      disconnect();
-      return;
-   }
-
-   nanosleep(&sleeptime, NULL);
-}
-
-/**********************************************************************************************
- * getUsername - called from handleConnection when status is s_username--if it finds user data,
- *               it expects a username and compares it against the password database
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-
-void TCPConn::getUsername() {
-   // Insert your mind-blowing code here
-   //std::cout << "In useName()" << std::endl; //testing
-   //Check if user has inputed name
-   if (!_connfd.hasData())
-      return;
-   std::string userNameInput;
-   if (!getUserInput(userNameInput))
-      return;
-   //lower(userNameInput);
-
-   //store name in object
-   this->_username = userNameInput;   
-   std::cout << "Got User Name: " << _username << std::endl;//testing
-
-   if (!PWMgr->checkUser(this->_username.c_str()) )
-   {
-      sendText("Username not recognized\n");
-      disconnect();
-      std::cout << "Username not found" << std::endl;
-   }
-   else{
-
-      std::cout << "Username found" << std::endl;
-   }
-   //transitions to password state
-   _connfd.writeFD("Password: "); 
-   this->_status = s_passwd;
-
-}
-
-/**********************************************************************************************
- * getPasswd - called from handleConnection when status is s_passwd--if it finds user data,
- *             it assumes it's a password and hashes it, comparing to the database hash. Users
- *             get two tries before they are disconnected
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-
-void TCPConn::getPasswd() {
-   // Insert your mind-blowing code here
-   std::cout << "In getPasswd()" << std::endl; //testing
-   //Check if user has inputed passwd
-   if (!_connfd.hasData())
-      return;
-   std::string userPasswdInput;
-   if (!getUserInput(userPasswdInput))
-      return;
-   //lower(userNameInput);
-
-   //store passwd in object
-   //this->_ = userPasswdInput; 
-   std::cout << "Got User passwd: " << userPasswdInput << std::endl;//testing
-
-   this->PWMgr->checkPasswd(this->_username.c_str(), userPasswdInput.c_str());
-}
-
-/**********************************************************************************************
- * changePassword - called from handleConnection when status is s_changepwd or s_confirmpwd--
- *                  if it finds user data, with status s_changepwd, it saves the user-entered
- *                  password. If s_confirmpwd, it checks to ensure the saved password from
- *                  the s_changepwd phase is equal, then saves the new pwd to the database
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-
-void TCPConn::changePassword() {
-   // Insert your amazing code here
-}
-
-
-/**********************************************************************************************
- * getUserInput - Gets user data and includes a buffer to look for a carriage return before it is
- *                considered a complete user input. Performs some post-processing on it, removing
- *                the newlines
- *
- *    Params: cmd - the buffer to store commands - contents left alone if no command found
- *
- *    Returns: true if a carriage return was found and cmd was populated, false otherwise.
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-
-bool TCPConn::getUserInput(std::string &cmd) {
-   std::string readbuf;
-
-   // read the data on the socket
-   _connfd.readFD(readbuf);
-
-   // concat the data onto anything we've read before
-   _inputbuf += readbuf;
-
-   // If it doesn't have a carriage return, then it's not a command
-   int crpos;
-   if ((crpos = _inputbuf.find("\n")) == std::string::npos)
-      return false;
-
-   cmd = _inputbuf.substr(0, crpos);
-   _inputbuf.erase(0, crpos+1);
-
-   // Remove \r if it is there
-   clrNewlines(cmd);
-
-   return true;
-}
-
-/**********************************************************************************************
- * getMenuChoice - Gets the user's command and interprets it, calling the appropriate function
- *                 if required.
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-
-void TCPConn::getMenuChoice() {
-   if (!_connfd.hasData())
-      return;
-   std::string cmd;
-   if (!getUserInput(cmd))
-      return;
-   lower(cmd);      
-
-   // Don't be lazy and use my outputs--make your own!
-   std::string msg;
-   if (cmd.compare("hello") == 0) {
-      _connfd.writeFD("Hello back!\n");
-   } else if (cmd.compare("menu") == 0) {
-      sendMenu();
-   } else if (cmd.compare("exit") == 0) {
-      _connfd.writeFD("Disconnecting...goodbye!\n");
-      disconnect();
-   } else if (cmd.compare("passwd") == 0) {
-      _connfd.writeFD("New Password: ");
-      _status = s_changepwd;
-   } else if (cmd.compare("1") == 0) {
-      msg += "You want a prediction about the weather? You're asking the wrong Phil.\n";
-      msg += "I'm going to give you a prediction about this winter. It's going to be\n";
-      msg += "cold, it's going to be dark and it's going to last you for the rest of\n";
-      msg += "your lives!\n";
-      _connfd.writeFD(msg);
-   } else if (cmd.compare("2") == 0) {
-      _connfd.writeFD("42\n");
-   } else if (cmd.compare("3") == 0) {
-      _connfd.writeFD("That seems like a terrible idea.\n");
-   } else if (cmd.compare("4") == 0) {
-
-   } else if (cmd.compare("5") == 0) {
-      _connfd.writeFD("I'm singing, I'm in a computer and I'm siiiingiiiing! I'm in a\n");
-      _connfd.writeFD("computer and I'm siiiiiiinnnggiiinnggg!\n");
-   } else {
-      msg = "Unrecognized command: ";
-      msg += cmd;
-      msg += "\n";
-      _connfd.writeFD(msg);
-   }
-
-}
-
-/**********************************************************************************************
- * sendMenu - sends the menu to the user via their socket
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-void TCPConn::sendMenu() {
-   std::string menustr;
-
-   // Make this your own!
-   menustr += "Available choices: \n";
-   menustr += "  1). Provide weather report.\n";
-   menustr += "  2). Learn the secret of the universe.\n";
-   menustr += "  3). Play global thermonuclear war\n";
-   menustr += "  4). Do nothing.\n";
-   menustr += "  5). Sing. Sing a song. Make it simple, to last the whole day long.\n\n";
-   menustr += "Other commands: \n";
-   menustr += "  Hello - self-explanatory\n";
-   menustr += "  Passwd - change your password\n";
-   menustr += "  Menu - display this menu\n";
-   menustr += "  Exit - disconnect.\n\n";
-
-   _connfd.writeFD(menustr);
-}
-
-
-/**********************************************************************************************
- * disconnect - cleans up the socket as required and closes the FD
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-void TCPConn::disconnect() {
-   _connfd.closeFD();
-}
-
-
-/**********************************************************************************************
- * isConnected - performs a simple check on the socket to see if it is still open 
- *
- *    Throws: runtime_error for unrecoverable issues
- **********************************************************************************************/
-bool TCPConn::isConnected() {
-   return _connfd.isOpen();
-}
-
-/**********************************************************************************************
- * getIPAddrStr - gets a string format of the IP address and loads it in buf
- *
- **********************************************************************************************/
-void TCPConn::getIPAddrStr(std::string &buf) {
-   return _connfd.getIPAddrStr(buf);
-}
-
-bool TCPConn::isNewIPAllowed(std::string inputIP){
-   std::ifstream whitelistFile("whitelist");
-   if(!whitelistFile){
-      std::cout << "whitelist file not found" << std::endl;
-      return false;
-   }
-   
-   if (whitelistFile.is_open()){
-      std::string line;
-      while(whitelistFile >> line){
-         //std::cout << "IP: " << inputIP << ", line: " << line << std::endl;//
-         if (inputIP == line){
-            std::cout << "New connection IP: "<< inputIP << " , authorized from whitelist" << std::endl;
-            return true;
-         }
-      }
-   }
-
-   std::cout << "Match NOT FOUND!" << std::endl;
-   return false;
-
-}
-
-void TCPConn::sendNumber(){
-   //unsigned int num = 975851579543363;
-
-   std::string numStr;
-
-   numStr = "NUM 975851579543363";
-
-   _connfd.writeFD(numStr);
-
-   _status = s_waitForReply;
-}
-
-void TCPConn::waitForDivisor(){
-   this->dbNum++;
-   
-   if(this->dbNum == 20){
-      std::string Str("QuitCalc");
-      _connfd.writeFD(Str);
-   }
-
-   if(this->dbNum == 30){
-      std::string Str("NUM 975851579543363");
-      _connfd.writeFD(Str);
-   }
-
-   if (this->dbNum < 2){
-      std::cout << "Waiting for Divisor" << std::endl;
-   }
-
-   if (!_connfd.hasData())
-   {
-      //std::cout << "No Data" << std::endl;
-      return;
-   }
-   std::string cmd;
-   if (!getUserInput(cmd))
-      return;
-   //lower(cmd);
-
-   std::cout << "returned: " << cmd << std::endl;
-
-   _status = s_menu;
-
-}
-
+#include <stdexcept>
+#include <errno.h>
+#include <strings.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include "TCPConn.h"
+#include "Frame.h"
+#include "strfuncts.h"
+
+TCPConn::TCPConn(JobScheduler &scheduler, JobCanceller &canceller, TimerWheel &timers,
+                 MetricShard &stats, AuthService &auth, AuthWaiter &auth_waiter, RateLimiter &limiter):
+                                     _auth(auth),_auth_waiter(auth_waiter),_limiter(limiter),_scheduler(scheduler),
+                                     _canceller(canceller),_timers(timers),_stats(stats) { // LogMgr &server_log):_server_log(server_log) {
+
+}
+
+
+/**********************************************************************************************
+ * TCPConn (destructor) - any jobs the client still had go back to the scheduler for someone
+ *                        else to pick up, and our timers are cancelled so none fire for an FD
+ *                        that gets reused
+ **********************************************************************************************/
+
+TCPConn::~TCPConn() {
+   _timers.cancel(_auth_timer);
+   _timers.cancel(_heartbeat_timer);
+
+   for (auto &sent : _assigned) {
+      _timers.cancel(sent.second.deadline);
+      _scheduler.requeue(sent.first);
+   }
+}
+
+/**********************************************************************************************
+ * accept - simply calls the acceptFD FileDesc method to accept a connection on a server socket.
+ *
+ *    Params: server - an open/bound server file descriptor with an available connection
+ *
+ *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+bool TCPConn::accept(SocketFD &server) {
+   // Comes back nonblocking: the reactor only tells us once when data arrives, so reads must
+   // never block
+   if (!_connfd.acceptFD(server))
+      return false;
+
+   _accepted = std::chrono::steady_clock::now();
+   return true;
+}
+
+/**********************************************************************************************
+ * sendText - queues data for the client behind anything still waiting to go out and sends as
+ *            much as the socket will take. Whatever doesn't fit is sent by flushOutput when the
+ *            reactor sees the socket writable again, so a message (or frame) is never cut
+ *            short. A client that lets more than conn_max_outbuf pile up isn't reading and is
+ *            dropped.
+ *
+ *    Params:  msg - the string to be sent
+ *             size - if we know how much data we should expect to send, this should be populated
+ *
+ *    Returns: 0 if the data was sent or queued, -1 if the connection is gone
+ **********************************************************************************************/
+
+int TCPConn::sendText(const char *msg) {
+   return sendText(msg, strlen(msg));
+}
+
+int TCPConn::sendText(const std::string &msg) {
+   return sendText(msg.data(), msg.size());
+}
+
+int TCPConn::sendText(const char *msg, int size) {
+   if (!isConnected())
+      return -1;
+
+   if (_outbuf.size() + size > conn_max_outbuf) {
+      std::cout << "Client is not reading its data, disconnecting." << std::endl;
+      disconnect();
+      return -1;
+   }
+
+   _outbuf.append(msg, size);
+   return flushOutput() ? 0 : -1;
+}
+
+/**********************************************************************************************
+ * flushOutput - writes queued data until it is all gone or the socket is full. Called by
+ *               sendText, and by the reactor once the socket has room again. A write that
+ *               fails for any other reason disconnects the client.
+ *
+ *    Returns: false if the connection is gone, true otherwise
+ **********************************************************************************************/
+
+bool TCPConn::flushOutput() {
+   size_t written = 0;
+   while (written < _outbuf.size()) {
+      ssize_t results = _connfd.writeFD(_outbuf.data() + written, _outbuf.size() - written);
+      if (results > 0) {
+         written += results;
+         continue;
+      }
+
+      if ((results < 0) && (errno == EINTR))
+         continue;
+      if ((results < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+         break;
+
+      std::cout << "Write to client failed, disconnecting." << std::endl;
+      _outbuf.clear();
+      disconnect();
+      return false;
+   }
+
+   _outbuf.erase(0, written);
+   return true;
+}
+
+/**********************************************************************************************
+ * startAuthentication - Sets the status to request username and starts the clock on logging in
+ *
+ *    Throws: runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPConn::startAuthentication() {
+
+   _status = s_username;
+   _auth_timer = setTimer(auth_timeout_secs * 1000, t_auth);
+
+   sendText("Username: ");
+
+}
+
+/**********************************************************************************************
+ * handleConnection - called by the reactor when the socket is ready. Reads everything that is
+ *                    waiting, then keeps running the handler for the current _status, or stage,
+ *                    of the connection until it stops making progress, since one read can
+ *                    hold several commands
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::handleConnection() {
+
+   // A client can send its last answers and hang up in one go, so what it sent before the
+   // hangup is still handled
+   if (!readInput()) {
+      if (!_inputbuf.empty())
+         runStatus();
+      disconnect();
+      return;
+   }
+
+   // Anything from a logged in client shows it's still there
+   if (_heartbeat_timer != 0)
+      resetHeartbeat();
+
+   runStatus();
+}
+
+/**********************************************************************************************
+ * runStatus - keeps running the handler for the current _status until it stops making
+ *             progress, since one read can hold several commands
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::runStatus() {
+   statustype last_status;
+   size_t last_buflen;
+   do {
+      last_status = _status;
+      last_buflen = _inputbuf.size();
+
+      handleStatus();
+   } while (isConnected() && ((_status != last_status) || (_inputbuf.size() != last_buflen)));
+}
+
+/**********************************************************************************************
+ * readInput - reads everything available on the (nonblocking) socket into the input buffer
+ *
+ *    Returns: false if the client hung up or the socket failed, true otherwise
+ **********************************************************************************************/
+
+bool TCPConn::readInput() {
+   char readbuf[conn_readsize];
+
+   while (true) {
+      ssize_t amt_read = _connfd.readFD(readbuf, conn_readsize);
+      if (amt_read > 0) {
+         _inputbuf.append(readbuf, amt_read);
+         continue;
+      }
+
+      if (amt_read == 0)
+         return false;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+         return true;
+      if (errno != EINTR)
+         return false;
+   }
+}
+
+/**********************************************************************************************
+ * handleStatus - runs the handler for the connection's current _status
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::handleStatus() {
+
+   //std::cout << "_status: " << _status << std::endl;
+
+   switch (_status) {
+      case s_username:
+         getUsername();
+         break;
+
+      case s_passwd:
+         getPasswd();
+         break;
+
+      // Anything more the client sends waits until its password has been checked
+      case s_checkPasswd:
+         break;
+
+      case s_changepwd:
+      case s_confirmpwd:
+         changePassword();
+         break;
+
+      case s_menu:
+         getMenuChoice();
+
+         break;
+
+      case s_getCaps:
+         getCaps();
+         break;
+
+      case s_sendNumber:
+         sendNumber();
+         break;
+
+      case s_waitForReply:
+         waitForDivisor();
+         break;
+
+      default:
+         throw std::runtime_error("Invalid connection status!");
+         break;
+   }
+}
+
+/**********************************************************************************************
+ * getUsername - called from handleConnection when status is s_username--if it finds user data,
+ *               it expects a username and compares it against the password database. A client
+ *               that logged in before may instead send "TICKET <ticket>" with the session
+ *               ticket it was given, which logs it straight in if the ticket checks out. A bad
+ *               or expired ticket just gets the username prompt again.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::getUsername() {
+   // Insert your mind-blowing code here
+   //std::cout << "In useName()" << std::endl; //testing
+   //Check if user has inputed name
+   std::string userNameInput;
+   if (!getUserInput(userNameInput))
+      return;
+   //lower(userNameInput);
+
+   if (userNameInput.compare(0, 7, "TICKET ") == 0) {
+      bool ok = _auth.checkTicket(userNameInput.substr(7), _username);
+      std::fill(userNameInput.begin(), userNameInput.end(), '\0');
+      if (ok) {
+         _stats.count(c_auth_ticket);
+         loggedIn();
+      } else {
+         std::cout << "Session ticket rejected" << std::endl;
+         _stats.count(c_ticket_rejected);
+         sendText("Session ticket rejected\nUsername: ");
+      }
+      return;
+   }
+
+   //store name in object
+   this->_username = userNameInput;   
+   std::cout << "Got User Name: " << _username << std::endl;//testing
+
+   if (!_auth.checkUser(this->_username) )
+   {
+      sendText("Username not recognized\n");
+      disconnect();
+      std::cout << "Username not found" << std::endl;
+      return;
+   }
+   else{
+
+      std::cout << "Username found" << std::endl;
+   }
+   //transitions to password state
+   sendText("Password: ");
+   this->_status = s_passwd;
+
+}
+
+/**********************************************************************************************
+ * getPasswd - called from handleConnection when status is s_passwd--if it finds user data,
+ *             it assumes it's a password and queues it to be hashed and compared to the
+ *             database hash off the event loop. passwdChecked picks up from there. If too many
+ *             logins are already waiting, or this host has used up its password attempts for
+ *             now, the client is told to come back later without anything being hashed.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::getPasswd() {
+   // Insert your mind-blowing code here
+   std::cout << "In getPasswd()" << std::endl; //testing
+   //Check if user has inputed passwd
+   std::string userPasswdInput;
+   if (!getUserInput(userPasswdInput))
+      return;
+   //lower(userNameInput);
+
+   if (!_limiter.admit(getIPAddr(), l_auth)) {
+      std::fill(userPasswdInput.begin(), userPasswdInput.end(), '\0');
+      std::cout << "Too many password attempts from this host, turning away user " << _username << std::endl;
+      _stats.count(c_auth_limited);
+      sendText("Too many login attempts, try again later.\n");
+      disconnect();
+      return;
+   }
+
+   _auth_ticket = _auth.queuePasswd(_username, userPasswdInput, _auth_waiter, getFD());
+   std::fill(userPasswdInput.begin(), userPasswdInput.end(), '\0');
+   if (_auth_ticket == 0) {
+      std::cout << "Too many logins waiting, turning away user " << _username << std::endl;
+      _stats.count(c_auth_busy);
+      sendText("Server busy, try again later.\n");
+      disconnect();
+      return;
+   }
+
+   _status = s_checkPasswd;
+}
+
+/**********************************************************************************************
+ * passwdChecked - called by the reactor with the result of the password check getPasswd
+ *                 queued. On a match the client is logged in; otherwise it gets another try,
+ *                 up to max_attempts. Then carries on with anything the client sent meanwhile.
+ *
+ *    Params:  ticket - which check this is; results for any other are ignored
+ *             ok - whether the password matched
+ **********************************************************************************************/
+
+void TCPConn::passwdChecked(uint64_t ticket, bool ok) {
+   if ((_status != s_checkPasswd) || (ticket != _auth_ticket))
+      return;
+   _auth_ticket = 0;
+
+   if (ok) {
+      _stats.count(c_auth_ok);
+      loggedIn();
+   } else {
+      std::cout << "Bad password for user " << _username << std::endl;
+      _stats.count(c_auth_failed);
+      if (++_pwd_attempts >= max_attempts) {
+         sendText("Too many failed attempts, disconnecting.\n");
+         disconnect();
+         return;
+      }
+      sendText("Password incorrect.\nPassword: ");
+      _status = s_passwd;
+   }
+
+   runStatus();
+}
+
+/**********************************************************************************************
+ * loggedIn - finishes a login, by password or by session ticket: stops the login clock, hands
+ *            the client a fresh session ticket for next time and asks for its capabilities
+ **********************************************************************************************/
+
+void TCPConn::loggedIn() {
+   std::cout << "User " << _username << " logged in" << std::endl;
+   _stats.record(h_auth_latency_us, std::chrono::duration_cast<std::chrono::microseconds>(
+                                       std::chrono::steady_clock::now() - _accepted).count());
+
+   _timers.cancel(_auth_timer);
+   _auth_timer = 0;
+   resetHeartbeat();
+
+   std::string ticket;
+   if (_auth.issueTicket(_username, ticket)) {
+      ticket = "TICKET " + ticket + "\n";
+      sendText(ticket);
+   }
+
+   // Ask the client what it can do before we hand it any work
+   sendText("CAPS\n");
+   _status = s_getCaps;
+}
+
+/**********************************************************************************************
+ * changePassword - called from handleConnection when status is s_changepwd or s_confirmpwd--
+ *                  if it finds user data, with status s_changepwd, it saves the user-entered
+ *                  password. If s_confirmpwd, it checks to ensure the saved password from
+ *                  the s_changepwd phase is equal, then saves the new pwd to the database
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::changePassword() {
+   // Insert your amazing code here
+}
+
+
+/**********************************************************************************************
+ * getUserInput - Gets the next command out of the data read so far, looking for a carriage
+ *                return before it is considered a complete user input. Performs some
+ *                post-processing on it, removing the newlines
+ *
+ *    Params: cmd - the buffer to store commands - contents left alone if no command found
+ *
+ *    Returns: true if a carriage return was found and cmd was populated, false otherwise.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+bool TCPConn::getUserInput(std::string &cmd) {
+   // If it doesn't have a carriage return, then it's not a command
+   int crpos;
+   if ((crpos = _inputbuf.find("\n")) == std::string::npos)
+      return false;
+
+   cmd = _inputbuf.substr(0, crpos);
+   _inputbuf.erase(0, crpos+1);
+
+   // Remove \r if it is there
+   clrNewlines(cmd);
+
+   return true;
+}
+
+/**********************************************************************************************
+ * getMenuChoice - Gets the user's command and interprets it, calling the appropriate function
+ *                 if required.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::getMenuChoice() {
+   std::string cmd;
+   if (!getUserInput(cmd))
+      return;
+   lower(cmd);      
+
+   // Don't be lazy and use my outputs--make your own!
+   std::string msg;
+   if (cmd.compare("hello") == 0) {
+      sendText("Hello back!\n");
+   } else if (cmd.compare("menu") == 0) {
+      sendMenu();
+   } else if (cmd.compare("exit") == 0) {
+      sendText("Disconnecting...goodbye!\n");
+      disconnect();
+   } else if (cmd.compare("passwd") == 0) {
+      sendText("New Password: ");
+      _status = s_changepwd;
+   } else if (cmd.compare("1") == 0) {
+      msg += "You want a prediction about the weather? You're asking the wrong Phil.\n";
+      msg += "I'm going to give you a prediction about this winter. It's going to be\n";
+      msg += "cold, it's going to be dark and it's going to last you for the rest of\n";
+      msg += "your lives!\n";
+      sendText(msg);
+   } else if (cmd.compare("2") == 0) {
+      sendText("42\n");
+   } else if (cmd.compare("3") == 0) {
+      sendText("That seems like a terrible idea.\n");
+   } else if (cmd.compare("4") == 0) {
+
+   } else if (cmd.compare("5") == 0) {
+      sendText("I'm singing, I'm in a computer and I'm siiiingiiiing! I'm in a\n");
+      sendText("computer and I'm siiiiiiinnnggiiinnggg!\n");
+   } else {
+      msg = "Unrecognized command: ";
+      msg += cmd;
+      msg += "\n";
+      sendText(msg);
+   }
+
+}
+
+/**********************************************************************************************
+ * sendMenu - sends the menu to the user via their socket
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+void TCPConn::sendMenu() {
+   std::string menustr;
+
+   // Make this your own!
+   menustr += "Available choices: \n";
+   menustr += "  1). Provide weather report.\n";
+   menustr += "  2). Learn the secret of the universe.\n";
+   menustr += "  3). Play global thermonuclear war\n";
+   menustr += "  4). Do nothing.\n";
+   menustr += "  5). Sing. Sing a song. Make it simple, to last the whole day long.\n\n";
+   menustr += "Other commands: \n";
+   menustr += "  Hello - self-explanatory\n";
+   menustr += "  Passwd - change your password\n";
+   menustr += "  Menu - display this menu\n";
+   menustr += "  Exit - disconnect.\n\n";
+
+   sendText(menustr);
+}
+
+
+/**********************************************************************************************
+ * disconnect - cleans up the socket as required and closes the FD
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+void TCPConn::disconnect() {
+   _connfd.closeFD();
+}
+
+
+/**********************************************************************************************
+ * isConnected - performs a simple check on the socket to see if it is still open 
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+bool TCPConn::isConnected() {
+   return _connfd.isOpen();
+}
+
+/**********************************************************************************************
+ * getIPAddrStr - gets a string format of the IP address and loads it in buf
+ *
+ **********************************************************************************************/
+void TCPConn::getIPAddrStr(std::string &buf) {
+   return _connfd.getIPAddrStr(buf);
+}
+
+/**********************************************************************************************
+ * getCaps - called from handleConnection when status is s_getCaps--waits for the client's
+ *           "CAPS key=value ..." reply, which sizes this client's prefetch depth. Clients that
+ *           send something unparseable are still given work, just one job at a time.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::getCaps() {
+   std::string cmd;
+   if (!getUserInput(cmd))
+      return;
+
+   std::string left, right;
+   if (!split(cmd, left, right, ' ') || (left != "caps") || !_caps.fromString(right)) {
+      std::cout << "Client did not advertise capabilities: " << cmd << std::endl;
+   } else {
+      std::cout << "Client caps: " << right << " (max bits: " << _caps.getMaxJobBits(sched_target_secs)
+                << ")" << std::endl;
+   }
+
+   _status = s_sendNumber;
+}
+
+/**********************************************************************************************
+ * sendNumber - tops the client up to its prefetch depth with jobs from the shared scheduler,
+ *              sized to what the client said it can handle, and sends them in one write.
+ *              Every job is tagged with a job id the client sends back with its answer.
+ *              Clients that take frames get f_num frames, the rest "NUM" lines.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::sendNumber(){
+   unsigned int max_bits = _caps.isValid() ? _caps.getMaxJobBits(sched_target_secs) : 0;
+
+   std::string numStr;
+   ServerJob job;
+   JobOwner owner = {&_canceller, getFD()};
+   auto now = std::chrono::steady_clock::now();
+   while ((_assigned.size() < _prefetch) && _scheduler.nextJob(max_bits, owner, job)) {
+      _prefetch = _caps.getPrefetchDepth(job.bits);
+
+      // Time whole jobs (not slices or twins, which are already racing) from now, allowing
+      // for the jobs queued ahead of this one on the client
+      SentJob &sent = _assigned[job.jobid];
+      sent = {now, job.bits, _caps.getJobSecs(job.bits), 0};
+      if ((job.parent == 0) && (job.twin == 0)) {
+         double secs = (sent.expected_secs > 0.0) ? sent.expected_secs * _slowness : sched_unknown_job_secs;
+         secs *= sched_straggle_factor * _assigned.size();
+         secs = std::max(secs, sched_min_straggle_secs);
+         sent.deadline = setTimer(static_cast<unsigned int>(secs * 1000), t_deadline, job.jobid);
+      }
+
+      // Slices of a split number also get the seed for their rho walk, and the shared
+      // polynomial constant and point interval for collision detection
+      if (_caps.frames) {
+         Frame frame;
+         frame.type = f_num;
+         frame.jobid = job.jobid;
+         frame.num = job.value;
+         frame.seed = job.seed;
+         if (job.dp_c != 0) {
+            frame.dp_c = job.dp_c;
+            frame.dp_bits = dp_bits;
+         }
+         encodeFrame(frame, numStr);
+      } else {
+         numStr += "NUM " + std::to_string(job.jobid) + " " + job.num;
+         if (job.seed != 0)
+            numStr += " " + std::to_string(job.seed);
+         if (job.dp_c != 0)
+            numStr += " " + std::to_string(job.dp_c) + " " + std::to_string(dp_bits);
+         numStr += "\n";
+      }
+
+      _stats.count(c_jobs_sent);
+      _stats.record(h_queue_wait_us, std::chrono::duration_cast<std::chrono::microseconds>(
+                                        now - job.queued).count());
+   }
+
+   if (!numStr.empty())
+      sendText(numStr);
+
+   _status = s_waitForReply;
+}
+
+/**********************************************************************************************
+ * waitForDivisor - called from handleConnection when status is s_waitForReply--takes the
+ *                  client's "DIV <jobid> <divisor>" answers, hands them to the scheduler and
+ *                  goes back to topping the client up. "DP <jobid> <value>" points from
+ *                  the walks on split numbers go to the scheduler too. A client that takes
+ *                  frames sends the same as frames once it has had one from us, which
+ *                  readFrames handles.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::waitForDivisor(){
+   if (!_inputbuf.empty() && isFrameStart(_inputbuf[0])) {
+      readFrames();
+      return;
+   }
+
+   std::string cmd;
+   if (!getUserInput(cmd))
+      return;
+   //lower(cmd);
+
+   // Answers to our pings only matter for resetting the heartbeat, which is already done
+   if (cmd == "PONG")
+      return;
+
+   // Replies are "DIV <jobid> <divisor>" or "DP <jobid> <value>"
+   std::string left, right, jobidstr, divisor;
+   if (!split(cmd, left, right, ' ') || ((left != "div") && (left != "dp")) ||
+       !split(right, jobidstr, divisor, ' ')) {
+      std::cout << "Unexpected reply from client: " << cmd << std::endl;
+      return;
+   }
+
+   unsigned long jobid = strtoul(jobidstr.c_str(), NULL, 10);
+   LARGEINT value = 0;
+   try {
+      value = LARGEINT(divisor);
+   } catch (std::runtime_error &e) {
+      if (left == "dp") {
+         std::cout << "Bad point from client: " << cmd << std::endl;
+         return;
+      }
+   }
+
+   // Points for jobs we don't hold may be from before the client reconnected, and the
+   // scheduler still wants them if the slice is live
+   if (left == "dp") {
+      _scheduler.reportPoint(jobid, value);
+      return;
+   }
+
+   answerJob(jobid, value);
+}
+
+/**********************************************************************************************
+ * readFrames - takes every complete frame at the front of the input buffer: f_div answers and
+ *              f_dp points go to the scheduler as in waitForDivisor, and f_pong (or anything
+ *              we don't know) only mattered for the heartbeat. The buffer is trimmed once for
+ *              the whole batch. A malformed frame means we've lost our place in the stream,
+ *              so the client is dropped.
+ *
+ *    Throws: runtime_error for unrecoverable issues
+ **********************************************************************************************/
+
+void TCPConn::readFrames() {
+   Frame frame;
+   size_t used = 0;
+   int len = 0;
+   while ((used < _inputbuf.size()) && isFrameStart(_inputbuf[used]) &&
+          ((len = decodeFrame(_inputbuf.data() + used, _inputbuf.size() - used, frame)) > 0)) {
+      used += len;
+
+      if (frame.type == f_div)
+         answerJob(frame.jobid, frame.num);
+      else if (frame.type == f_dp)
+         _scheduler.reportPoint(frame.jobid, frame.num);
+   }
+   _inputbuf.erase(0, used);
+
+   if (len < 0) {
+      std::cout << "Malformed frame from client, disconnecting." << std::endl;
+      disconnect();
+   }
+}
+
+/**********************************************************************************************
+ * answerJob - hands a client's divisor for a job (0 if it found none) to the scheduler and
+ *             goes back to topping the client up. A job we never sent is one the client held
+ *             across a reconnect, on the connection it had before; the scheduler takes the
+ *             answer as long as the job is still live.
+ **********************************************************************************************/
+
+void TCPConn::answerJob(unsigned long jobid, const LARGEINT &divisor) {
+   _status = s_sendNumber;
+
+   auto sent = _assigned.find(jobid);
+   if (sent == _assigned.end()) {
+      if (_scheduler.reportResult(jobid, divisor, true))
+         std::cout << "Took answer for job " << jobid << " from before reconnect: " << divisor << std::endl;
+      else
+         std::cout << "Job " << jobid << " was not outstanding, ignoring: " << divisor << std::endl;
+      return;
+   }
+   recordAnswer(sent->second);
+   _timers.cancel(sent->second.deadline);
+   _assigned.erase(sent);
+
+   if (!_scheduler.reportResult(jobid, divisor))
+      std::cout << "Job " << jobid << " was not outstanding, ignoring: " << divisor << std::endl;
+}
+
+/**********************************************************************************************
+ * cancelJob - tells the client to stop working on a job the scheduler no longer needs, if we
+ *             still hold it, and refills the freed slot
+ **********************************************************************************************/
+
+void TCPConn::cancelJob(unsigned long jobid) {
+   auto sent = _assigned.find(jobid);
+   if (sent == _assigned.end())
+      return;
+   _timers.cancel(sent->second.deadline);
+   _assigned.erase(sent);
+   _stats.count(c_jobs_cancelled);
+
+   if (_caps.frames)
+      sendFrame(f_quit, jobid);
+   else
+      sendText("QuitCalc " + std::to_string(jobid) + "\n");
+
+   if (_status == s_waitForReply)
+      sendNumber();
+}
+
+/**********************************************************************************************
+ * topUp - sends more jobs if the client is waiting on us and has room for them
+ **********************************************************************************************/
+
+void TCPConn::topUp() {
+   if ((_status != s_waitForReply) || (_assigned.size() >= _prefetch))
+      return;
+
+   sendNumber();
+}
+
+/**********************************************************************************************
+ * recordAnswer - records how long an answered job took and how fast the client must have been
+ *                iterating, and folds the time against what the caps said it should take into
+ *                the client's running slowness. Prefetched jobs queue behind each other on the
+ *                client, so a job's clock starts at the later of when it was sent and when the
+ *                previous answer came in.
+ **********************************************************************************************/
+
+void TCPConn::recordAnswer(const SentJob &sent) {
+   auto now = std::chrono::steady_clock::now();
+   auto start = std::max(sent.sent, _last_answer);
+   _last_answer = now;
+
+   _stats.count(c_jobs_answered);
+   _stats.record(h_job_latency_us, std::chrono::duration_cast<std::chrono::microseconds>(
+                                      now - sent.sent).count());
+
+   double secs = std::chrono::duration<double>(now - start).count();
+   if (secs > 0.0)
+      _stats.record(h_iter_rate, static_cast<uint64_t>(ClientCaps::getJobIters(sent.bits) / secs));
+
+   if (sent.expected_secs <= 0.0)
+      return;
+
+   double ratio = secs / sent.expected_secs;
+   ratio = std::min(std::max(ratio, min_slowness), max_slowness);
+   _slowness = (1.0 - slowness_weight) * _slowness + slowness_weight * ratio;
+}
+
+/**********************************************************************************************
+ * handleTimer - called by the reactor when one of our timers fires:
+ *                  t_auth - the client took too long to log in, so it's dropped
+ *                  t_heartbeat - the client has been silent a while. The first time it gets a
+ *                                "PING" to answer; if it's still silent it's dropped and its
+ *                                jobs go to other clients
+ *                  t_deadline - job arg has taken too long, so the scheduler is told
+ **********************************************************************************************/
+
+void TCPConn::handleTimer(int kind, unsigned long arg) {
+   switch (kind) {
+      case t_auth:
+         _auth_timer = 0;
+         std::cout << "Client did not log in in time, disconnecting." << std::endl;
+         sendText("Login timed out, disconnecting.\n");
+         disconnect();
+         break;
+
+      case t_heartbeat:
+         _heartbeat_timer = 0;
+         if (_ping_sent) {
+            std::cout << "User " << _username << " stopped responding, disconnecting." << std::endl;
+            disconnect();
+            break;
+         }
+         if (_caps.frames)
+            sendFrame(f_ping);
+         else
+            sendText("PING\n");
+         _ping_sent = true;
+         _heartbeat_timer = setTimer(heartbeat_secs * 1000, t_heartbeat);
+         break;
+
+      case t_deadline: {
+         auto sent = _assigned.find(arg);
+         if (sent != _assigned.end()) {
+            sent->second.deadline = 0;
+            _scheduler.markStraggling(arg);
+         }
+         break;
+      }
+   }
+}
+
+/**********************************************************************************************
+ * sendFrame - sends a frame that carries nothing but its type and job id
+ **********************************************************************************************/
+
+void TCPConn::sendFrame(uint8_t type, unsigned long jobid) {
+   Frame frame;
+   frame.type = type;
+   frame.jobid = jobid;
+
+   std::string msg;
+   encodeFrame(frame, msg);
+   sendText(msg);
+}
+
+/**********************************************************************************************
+ * setTimer - sets a timer on the reactor's wheel, tagged with our FD so it comes back to us
+ **********************************************************************************************/
+
+TimerId TCPConn::setTimer(unsigned int delay_ms, timertype kind, unsigned long arg) {
+   TimerEvent event = {getFD(), kind, arg};
+   return _timers.schedule(delay_ms, event);
+}
+
+/**********************************************************************************************
+ * resetHeartbeat - restarts the silence clock after hearing from the client
+ **********************************************************************************************/
+
+void TCPConn::resetHeartbeat() {
+   _timers.cancel(_heartbeat_timer);
+   _ping_sent = false;
+   _heartbeat_timer = setTimer(heartbeat_secs * 1000, t_heartbeat);
+}
@@ -1,141 +1,151 @@
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <stdexcept>
-#include <strings.h>
-#include <vector>
-#include <iostream>
-#include <memory>
-#include <sstream>
-#include "TCPServer.h"
-
-TCPServer::TCPServer(){ // :_server_log("server.log", 0) {
-}
-
-
-TCPServer::~TCPServer() {
-
-}
-
-/**********************************************************************************************
- * bindSvr - Creates a network socket and sets it nonblocking so we can loop through looking for
- *           data. Then binds it to the ip address and port
- *
- *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
- **********************************************************************************************/
-
-void TCPServer::bindSvr(const char *ip_addr, short unsigned int port) {
-
-   struct sockaddr_in servaddr;
-
-   // _server_log.writeLog("Server started.");
-
-   // Set the socket to nonblocking
-   _sockfd.setNonBlocking();
-
-   // Load the socket information to prep for binding
-   _sockfd.bindFD(ip_addr, port);
- 
-}
-
-/**********************************************************************************************
- * listenSvr - Performs a loop to look for connections and create TCPConn objects to handle
- *             them. Also loops through the list of connections and handles data received and
- *             sending of data. 
- *
- *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
- **********************************************************************************************/
-
-void TCPServer::listenSvr() {
-
-   bool online = true;
-   timespec sleeptime;
-   sleeptime.tv_sec = 0;
-   sleeptime.tv_nsec = 100000000;
-   int num_read = 0;
-
-   // Start the server socket listening
-   _sockfd.listenFD(5);
-
-    
-   while (online) {
-      struct sockaddr_in cliaddr;
-      socklen_t len = sizeof(cliaddr);
-
-      if (_sockfd.hasData()) {
-         TCPConn *new_conn = new TCPConn();
-         if (!new_conn->accept(_sockfd)) {
-            // _server_log.strerrLog("Data received on socket but failed to accept.");
-            continue;
-         }
-         
-         // Get their IP Address string to use in logging
-         std::string ipaddr_str;
-         new_conn->getIPAddrStr(ipaddr_str);
-
-         std::cout << "Client IP: " << ipaddr_str << std::endl;//testing
-
-         //check is the client ip address on the whitelist
-         if ( !new_conn->isNewIPAllowed(ipaddr_str) ){
-            std::cout << "This IP address is not authorized" << std::endl;
-            new_conn->sendText("Not Authorized To Log into System\n");
-            new_conn->disconnect();
-            continue;  
-         }
-
-         std::cout << "***Got a connection***\n";
-
-         _connlist.push_back(std::unique_ptr<TCPConn>(new_conn));
-
-         
-         //new_conn->sendText("Welcome to the CSCE 689 Server!\n");
-
-         // Change this later
-         new_conn->startAuthentication();
-      }
-
-      // Loop through our connections, handling them
-      std::list<std::unique_ptr<TCPConn>>::iterator tptr = _connlist.begin();
-      while (tptr != _connlist.end())
-      {
-         // If the user lost connection
-         if (!(*tptr)->isConnected()) {
-            // Log it
-
-            // Remove them from the connect list
-            tptr = _connlist.erase(tptr);
-            std::cout << "Connection disconnected.\n";
-            continue;
-         }
-
-         // Process any user inputs
-         (*tptr)->handleConnection();
-
-         // Increment our iterator
-         tptr++;
-      }
-
-      // So we're not chewing up CPU cycles unnecessarily
-      nanosleep(&sleeptime, NULL);
-   } 
-
-
-   
-}
-
-
-/**********************************************************************************************
- * shutdown - Cleanly closes the socket FD.
- *
- *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
- **********************************************************************************************/
-
-void TCPServer::shutdown() {
-
-   _sockfd.closeFD();
-}
-
-
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <strings.h>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "TCPServer.h"
+
+// The filename/path of the password file, of the key session tickets are signed with and of
+// the addresses allowed to connect
+const char pwdfilename[] = "passwd";
+const char ticketkeyfilename[] = "ticket.key";
+const char whitelistfilename[] = "whitelist";
+
+TCPServer::TCPServer():_auth(pwdfilename, ticketkeyfilename),_whitelist(whitelistfilename) { // :_server_log("server.log", 0) {
+   _metrics.setScheduler(&_scheduler);
+   _metrics.setAuth(&_auth);
+   _metrics.setLimiter(&_limiter);
+}
+
+
+TCPServer::~TCPServer() {
+   // The hashing threads and the scheduler's point checker report to the reactors, so they
+   // have to stop first
+   _auth.stop();
+   _scheduler.stop();
+}
+
+/**********************************************************************************************
+ * setNumThreads - sets how many event loop threads to run. Must be called before bindSvr.
+ **********************************************************************************************/
+
+void TCPServer::setNumThreads(unsigned int num_threads) {
+   _num_threads = (num_threads > 0) ? num_threads : 1;
+}
+
+/**********************************************************************************************
+ * setBacklog - sets how many pending connections each listening socket queues. Must be called
+ *              before bindSvr.
+ **********************************************************************************************/
+
+void TCPServer::setBacklog(int backlog) {
+   _backlog = (backlog > 0) ? backlog : default_listen_backlog;
+}
+
+/**********************************************************************************************
+ * setMetricsOutput - sets where listenSvr reports the server's metrics: a unix socket that
+ *                    sends them to whoever connects and a file they are dumped to every few
+ *                    seconds. Either can be empty to leave it out; with neither the metrics are
+ *                    still kept but nothing reports them.
+ **********************************************************************************************/
+
+void TCPServer::setMetricsOutput(const std::string &admin_path, const std::string &dump_path) {
+   _admin_path = admin_path;
+   _dump_path = dump_path;
+}
+
+/**********************************************************************************************
+ * bindSvr - Creates a network socket for each event loop thread and sets it nonblocking so the
+ *           event loop can drain it. Then binds them all to the ip address and port. With more
+ *           than one thread the sockets use SO_REUSEPORT and the kernel spreads incoming
+ *           connections across them.
+ *
+ *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPServer::bindSvr(const char *ip_addr, short unsigned int port) {
+
+   // _server_log.writeLog("Server started.");
+
+   _reactors.clear();
+   for (unsigned int i=0; i < _num_threads; i++) {
+      _reactors.emplace_back(new Reactor(_scheduler, _metrics.addShard(), _auth, _limiter, _whitelist));
+      _reactors.back()->bindListener(ip_addr, port, (_num_threads > 1), _backlog);
+   }
+}
+
+/**********************************************************************************************
+ * listenSvr - Runs the event loops, which accept connections, create TCPConn objects to handle
+ *             them and hand each connection the data it receives as it arrives. The first
+ *             loop runs on the calling thread and the rest get a thread each. If any loop
+ *             fails they are all stopped and the error is rethrown here. The password file
+ *             and the whitelist are loaded first, and their watchers and the metrics reporter
+ *             run alongside them.
+ *
+ *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPServer::listenSvr() {
+
+   _auth.start();
+   _whitelist.start();
+   if (!_admin_path.empty() || !_dump_path.empty())
+      _metrics.start(_admin_path, _dump_path);
+
+   std::vector<std::thread> threads;
+   for (unsigned int i=1; i < _reactors.size(); i++)
+      threads.emplace_back(&TCPServer::runReactor, this, std::ref(*_reactors[i]));
+
+   runReactor(*_reactors[0]);
+
+   shutdown();
+   for (std::thread &th : threads)
+      th.join();
+   _scheduler.stop();
+   _metrics.stop();
+   _whitelist.stop();
+   _auth.stop();
+
+   if (_reactor_error)
+      std::rethrow_exception(_reactor_error);
+}
+
+/**********************************************************************************************
+ * runReactor - runs one event loop, recording its error and stopping the others if it fails
+ **********************************************************************************************/
+
+void TCPServer::runReactor(Reactor &reactor) {
+   try {
+      reactor.run();
+   } catch (...) {
+      {
+         std::lock_guard<std::mutex> guard(_error_lock);
+         if (!_reactor_error)
+            _reactor_error = std::current_exception();
+      }
+      shutdown();
+   }
+}
+
+
+/**********************************************************************************************
+ * shutdown - Stops every event loop, each closing its server socket on its way out.
+ *
+ *    Throws: socket_error for recoverable errors, runtime_error for unrecoverable types
+ **********************************************************************************************/
+
+void TCPServer::shutdown() {
+
+   for (std::unique_ptr<Reactor> &reactor : _reactors)
+      reactor->stop();
+}
+
+
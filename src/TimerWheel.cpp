@@ -0,0 +1,187 @@
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel():_start(std::chrono::steady_clock::now()) {
+   for (unsigned int i=0; i < wheel_levels * wheel_slots; i++)
+      _slots[i] = nil;
+}
+
+TimerWheel::~TimerWheel() {
+
+}
+
+/******************************************************************************************
+ * schedule - sets a timer to fire after delay_ms, rounded up to whole ticks
+ *
+ *    Params:  event - handed back by expire when the timer fires
+ *
+ *    Returns: a handle to cancel the timer with
+ ******************************************************************************************/
+
+TimerId TimerWheel::schedule(unsigned int delay_ms, const TimerEvent &event) {
+   uint32_t idx;
+   if (_free != nil) {
+      idx = _free;
+      _free = _nodes[idx].next;
+   } else {
+      idx = _nodes.size();
+      _nodes.emplace_back();
+      _nodes[idx].generation = 0;
+   }
+
+   uint64_t ticks = (delay_ms + wheel_tick_ms - 1) / wheel_tick_ms;
+   if (ticks == 0)
+      ticks = 1;
+
+   Node &node = _nodes[idx];
+   node.expires = getTick(std::chrono::steady_clock::now()) + ticks;
+   node.event = event;
+   node.generation++;
+   place(idx);
+   _num_timers++;
+
+   return ((uint64_t) node.generation << 32) | idx;
+}
+
+/******************************************************************************************
+ * cancel - stops a timer before it fires
+ *
+ *    Returns: true if the timer was still pending, false if it already fired or was
+ *             cancelled
+ ******************************************************************************************/
+
+bool TimerWheel::cancel(TimerId id) {
+   uint32_t idx = id & 0xffffffff;
+   uint32_t generation = id >> 32;
+   if ((idx >= _nodes.size()) || (_nodes[idx].slot == nil) || (_nodes[idx].generation != generation))
+      return false;
+
+   unlink(idx);
+   _nodes[idx].next = _free;
+   _free = idx;
+   _num_timers--;
+   return true;
+}
+
+/******************************************************************************************
+ * expire - steps the wheel up to the current tick. At each tick, any level whose slot
+ *          boundary we just crossed is cascaded down (highest first, so timers can fall more
+ *          than one level), then everything in the level 0 slot fires.
+ *
+ *    Params:  fired - populated with the events of every timer that came due, in order
+ ******************************************************************************************/
+
+void TimerWheel::expire(std::chrono::steady_clock::time_point now, std::vector<TimerEvent> &fired) {
+   fired.clear();
+   uint64_t target = getTick(now);
+
+   while (_cur_tick < target) {
+      // Nothing to fire or cascade, so skip ahead
+      if (_num_timers == 0) {
+         _cur_tick = target;
+         break;
+      }
+
+      _cur_tick++;
+
+      unsigned int levels = 1;
+      while ((levels < wheel_levels) && ((_cur_tick & ((1ULL << (wheel_bits * levels)) - 1)) == 0))
+         levels++;
+      for (unsigned int level = levels - 1; level > 0; level--)
+         cascade(level);
+
+      uint32_t idx = _slots[_cur_tick & (wheel_slots - 1)];
+      while (idx != nil) {
+         uint32_t next = _nodes[idx].next;
+         fired.push_back(_nodes[idx].event);
+
+         _nodes[idx].slot = nil;
+         _nodes[idx].next = _free;
+         _free = idx;
+         _num_timers--;
+         idx = next;
+      }
+      _slots[_cur_tick & (wheel_slots - 1)] = nil;
+   }
+}
+
+/******************************************************************************************
+ * getWaitMs - works out how long until the next level 0 slot with timers in it, or the next
+ *             cascade, whichever is sooner. Only looks as far as one turn of level 0.
+ *
+ *    Returns: milliseconds to wait, or -1 if there are no timers at all
+ ******************************************************************************************/
+
+int TimerWheel::getWaitMs(std::chrono::steady_clock::time_point now) {
+   if (_num_timers == 0)
+      return -1;
+
+   uint64_t tick = _cur_tick + 1;
+   while (((tick & (wheel_slots - 1)) != 0) && (_slots[tick & (wheel_slots - 1)] == nil))
+      tick++;
+
+   auto due = _start + std::chrono::milliseconds(tick * wheel_tick_ms);
+   if (due <= now)
+      return 0;
+   return std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+}
+
+uint64_t TimerWheel::getTick(std::chrono::steady_clock::time_point now) {
+   return std::chrono::duration_cast<std::chrono::milliseconds>(now - _start).count() / wheel_tick_ms;
+}
+
+/******************************************************************************************
+ * place - links a node into the lowest level whose span covers the time until it expires.
+ *         Delays past the top level's span are clamped to it.
+ ******************************************************************************************/
+
+void TimerWheel::place(uint32_t idx) {
+   Node &node = _nodes[idx];
+   if (node.expires < _cur_tick)
+      node.expires = _cur_tick;
+
+   uint64_t delta = node.expires - _cur_tick;
+   uint64_t max_delta = (1ULL << (wheel_bits * wheel_levels)) - 1;
+   if (delta > max_delta) {
+      node.expires = _cur_tick + max_delta;
+      delta = max_delta;
+   }
+
+   unsigned int level = 0;
+   while ((level < wheel_levels - 1) && (delta >= (1ULL << (wheel_bits * (level + 1)))))
+      level++;
+
+   node.slot = level * wheel_slots + ((node.expires >> (wheel_bits * level)) & (wheel_slots - 1));
+   node.prev = nil;
+   node.next = _slots[node.slot];
+   if (node.next != nil)
+      _nodes[node.next].prev = idx;
+   _slots[node.slot] = idx;
+}
+
+void TimerWheel::unlink(uint32_t idx) {
+   Node &node = _nodes[idx];
+   if (node.prev != nil)
+      _nodes[node.prev].next = node.next;
+   else
+      _slots[node.slot] = node.next;
+   if (node.next != nil)
+      _nodes[node.next].prev = node.prev;
+   node.slot = nil;
+}
+
+/******************************************************************************************
+ * cascade - empties the current slot of a level and places its timers again, which puts
+ *           them in lower levels now that they are closer
+ ******************************************************************************************/
+
+void TimerWheel::cascade(unsigned int level) {
+   uint32_t slot = level * wheel_slots + ((_cur_tick >> (wheel_bits * level)) & (wheel_slots - 1));
+   uint32_t idx = _slots[slot];
+   _slots[slot] = nil;
+
+   while (idx != nil) {
+      uint32_t next = _nodes[idx].next;
+      place(idx);
+      idx = next;
+   }
+}
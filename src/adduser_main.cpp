@@ -1,81 +1,170 @@
-/****************************************************************************************
- * my_adduser_main - creates a user account and password from the command prompt
- *
- *              **Students should not modify this code! Or at least you can to test your
- *                code, but your code should work with the unmodified version
- *
- ****************************************************************************************/  
-
-#include <stdexcept>
-#include <iostream>
-#include "PasswdMgr.h"
-#include "FileDesc.h"
-#include "strfuncts.h"
-
-using namespace std; 
-
-void displayHelp(const char *execname) {
-   std::cout << execname << " <username>\n";
-//   std::cout << "   t: maximum number of threads to use\n";
-//   std::cout << "   n: calculate primes up to the given range\n";
-//   std::cout << "   s: only run in single process mode\n";
-//   std::cout << "   m: only run in multithreaded mode\n";
-//   std::cout << "   w: skip writing to disk\n";
-}
-
-
-int main(int argc, char *argv[]) {
-
-   // Check the command line input
-   if (argc < 2) {
-      displayHelp(argv[0]);
-      exit(0);
-   }
-
-   // Read in the username to add to the password file
-   std::string username(argv[1]);
-
-   // Check if the user already exists
-   std::vector<uint8_t> hash, salt;
-   PasswdMgr pwm("passwd");
-   
-   if (pwm.checkUser(username.c_str()))
-   {
-      cerr << "That user already has an account.\n";
-      exit(-1); 
-   }
-
-   TermFD stdinFD;
-
-   stdinFD.setEchoFD(false);
-   std::string passwd1, passwd2;
-
-   bool valid_passwd = false;
-   while (!valid_passwd) {
-      cout << "\nAdding user\nNew Password: ";
-      fflush(stdout);
-
-      stdinFD.readStr(passwd1);
-      clrNewlines(passwd1);      
-
-      cout << "\nEnter the password again: ";
-      fflush(stdout);      
-
-      stdinFD.readStr(passwd2);
-      clrNewlines(passwd2);
-
-      if (passwd2.compare(passwd1) == 0)
-         valid_passwd = true;
-      else{
-         cout << "Passwords must match. Try again.\n";
-      } 
-   }
-
-   stdinFD.setEchoFD(true);
-
-   pwm.addUser(username.c_str(), passwd2.c_str());
-   cout << "\nUser added.\n";
-   
-
-   return 0;
-}
+/****************************************************************************************
+ * my_adduser_main - creates a user account and password from the command prompt
+ *
+ *              **Students should not modify this code! Or at least you can to test your
+ *                code, but your code should work with the unmodified version
+ *
+ ****************************************************************************************/  
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <getopt.h>
+#include <unistd.h>
+#include "PasswdMgr.h"
+#include "FileDesc.h"
+#include "strfuncts.h"
+#include "exceptions.h"
+
+using namespace std; 
+
+void displayHelp(const char *execname) {
+   std::cout << execname << " <username>\n";
+   std::cout << execname << " -f <manifest> [-t <threads>]\n";
+   std::cout << "   f: add every user in the manifest, one \"username:password\" per line, and write\n";
+   std::cout << "      the password file once at the end\n";
+   std::cout << "   t: passwords to hash at once in bulk mode, each taking 64 MiB (default: one per core)\n";
+//   std::cout << "   n: calculate primes up to the given range\n";
+//   std::cout << "   s: only run in single process mode\n";
+//   std::cout << "   m: only run in multithreaded mode\n";
+//   std::cout << "   w: skip writing to disk\n";
+}
+
+/****************************************************************************************
+ * bulkAdd - reads a manifest of "username:password" lines and adds them all. Blank lines
+ *           and lines starting with # are skipped.
+ *
+ *    Returns: the exit code
+ ****************************************************************************************/
+
+int bulkAdd(const char *manifest, unsigned int num_threads) {
+   std::ifstream infile(manifest);
+   if (!infile) {
+      cerr << "Could not open manifest " << manifest << endl;
+      return -1;
+   }
+
+   std::vector<std::pair<std::string, std::string>> accounts;
+   std::string line;
+   unsigned long lineno = 0;
+   while (std::getline(infile, line)) {
+      lineno++;
+      clrNewlines(line);
+      if (line.empty() || (line[0] == '#'))
+         continue;
+
+      size_t colon = line.find(':');
+      if (colon == std::string::npos) {
+         cerr << "Manifest line " << lineno << " has no password, skipping it\n";
+         continue;
+      }
+      accounts.emplace_back(line.substr(0, colon), line.substr(colon + 1));
+      std::fill(line.begin(), line.end(), '\0');
+   }
+
+   try {
+      PasswdMgr pwm("passwd");
+      unsigned int added = pwm.addUsers(accounts, num_threads);
+      cout << "Added " << added << " of " << accounts.size() << " users.\n";
+   } catch (std::runtime_error &e) {
+      cerr << "Bulk add failed: " << e.what() << endl;
+      return -1;
+   }
+   return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+   std::string manifest;
+   unsigned int num_threads = std::max(1U, std::thread::hardware_concurrency());
+
+   int c = 0;
+   long threadval;
+   while ((c = getopt(argc, argv, "f:t:")) != -1) {
+      switch (c) {
+      case 'f':
+         manifest = optarg;
+         break;
+
+      case 't':
+         threadval = strtol(optarg, NULL, 10);
+         if ((threadval < 1) || (threadval > 1024)) {
+            std::cout << "Invalid thread count. Value must be between 1 and 1024\n";
+            exit(0);
+         }
+         num_threads = (unsigned int) threadval;
+         break;
+
+      default:
+         displayHelp(argv[0]);
+         exit(0);
+      }
+   }
+
+   if (!manifest.empty())
+      return bulkAdd(manifest.c_str(), num_threads);
+
+   // Check the command line input
+   if (optind >= argc) {
+      displayHelp(argv[0]);
+      exit(0);
+   }
+
+   // Read in the username to add to the password file
+   std::string username(argv[optind]);
+
+   // Check if the user already exists (a missing password file gets created when we add them)
+   std::vector<uint8_t> hash, salt;
+   PasswdMgr pwm("passwd");
+   
+   try {
+      if ((access("passwd", F_OK) == 0) && pwm.checkUser(username.c_str()))
+      {
+         cerr << "That user already has an account.\n";
+         exit(-1); 
+      }
+   } catch (pwfile_error &e) {
+      cerr << "Error with the password file: " << e.what() << endl;
+      exit(-1);
+   }
+
+   TermFD stdinFD;
+
+   stdinFD.setEchoFD(false);
+   std::string passwd1, passwd2;
+
+   bool valid_passwd = false;
+   while (!valid_passwd) {
+      cout << "\nAdding user\nNew Password: ";
+      fflush(stdout);
+
+      stdinFD.readStr(passwd1);
+      clrNewlines(passwd1);      
+
+      cout << "\nEnter the password again: ";
+      fflush(stdout);      
+
+      stdinFD.readStr(passwd2);
+      clrNewlines(passwd2);
+
+      if (passwd2.compare(passwd1) == 0)
+         valid_passwd = true;
+      else{
+         cout << "Passwords must match. Try again.\n";
+      } 
+   }
+
+   stdinFD.setEchoFD(true);
+
+   try {
+      pwm.addUser(username.c_str(), passwd2.c_str());
+   } catch (std::runtime_error &e) {
+      cerr << "\nCould not add user: " << e.what() << endl;
+      exit(-1);
+   }
+   cout << "\nUser added.\n";
+   
+
+   return 0;
+}
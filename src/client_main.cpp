@@ -1,70 +1,214 @@
-/****************************************************************************************
- * tcp_client - connects to a TCP server for two-way comms
- *
- *              **Students should not modify this code! Or at least you can to test your
- *                code, but your code should work with the unmodified version
- *
- ****************************************************************************************/  
-
-#include <stdexcept>
-#include <iostream>
-#include <getopt.h>
-#include "TCPClient.h"
-
-using namespace std; 
-
-void displayHelp(const char *execname) {
-   std::cout << execname << " <ip_addr> <port>\n";
-}
-
-
-int main(int argc, char *argv[]) {
-
-   // Check the command line input
-   if (argc < 3) {
-      displayHelp(argv[0]);
-      exit(0);
-   }
-
-   // Read in the IP address from the command line
-   std::string ip_addr(argv[1]);
-
-   // Read in the port
-   long portval = strtol(argv[2], NULL, 10);
-   if ((portval < 1) || (portval > 65535)) {
-      std::cout << "Invalid port. Value must be between 1 and 65535";
-      std::cout << "Format: " << argv[0] << " [<max_range>] [<max_threads>]\n";
-       exit(0);
-   }
-   unsigned short port = (unsigned short) portval;
- 
-
-   // Get the command line arguments and set params appropriately
-
-   // Try to set up the server for listening
-   TCPClient client;
-   try {
-      cout << "Connecting to " << ip_addr << " port " << port << endl;
-      client.connectTo(ip_addr.c_str(), port);
-
-   } catch (socket_error &e)
-   {
-      cerr << "Connection failed: " << e.what() << endl;
-      return -1;
-   }	   
-
-   cout << "Connection established.\n";
-
-   try {
-      client.handleConnection();
-
-      client.closeConn();
-      cout << "Client disconnected\n";
-
-   } catch (runtime_error &e) {
-      cerr << "Client error received: " << e.what() << endl;
-      return -1;      
-   }
-
-   return 0;
-}
+/****************************************************************************************
+ * tcp_client - connects to a TCP server for two-way comms
+ *
+ *              **Students should not modify this code! Or at least you can to test your
+ *                code, but your code should work with the unmodified version
+ *
+ ****************************************************************************************/  
+
+#include <stdexcept>
+#include <iostream>
+#include <memory>
+#include <getopt.h>
+#include <signal.h>
+#include "TCPClient.h"
+#include "BatchFactor.h"
+#include "CpuTopology.h"
+#include "PrimeCache.h"
+#include "strfuncts.h"
+
+using namespace std; 
+
+void displayHelp(const char *execname) {
+   std::cout << execname << " [-t <threads>] [-s] [-c <cpulist>] [-u] [-p <cachefile>] [-m <MiB>]\n";
+   std::cout << "      [-l <username>] [-r <secs>] <ip_addr> <port>\n";
+   std::cout << execname << " [-t <threads>] [-s] [-c <cpulist>] [-u] [-p <cachefile>] [-m <MiB>] -b <infile>\n";
+   std::cout << "      [-o <outfile>]\n";
+   std::cout << "   t: number of factoring threads (default: one per physical core)\n";
+   std::cout << "   s: also place threads on hyperthread siblings\n";
+   std::cout << "   c: only run threads on these CPUs, e.g. 0-3,8\n";
+   std::cout << "   u: leave threads unpinned\n";
+   std::cout << "   p: known-primes cache file (default: " << default_cachefile << ", \"\" to disable)\n";
+   std::cout << "   m: cache size cap in MiB (default: " << default_cache_mb << ")\n";
+   std::cout << "   l: log in as username (password from $TCPCLIENT_PASSWD, or prompted for)\n";
+   std::cout << "   r: max seconds between reconnect attempts (default: " << default_max_backoff_ms / 1000
+             << ", 0 to exit when disconnected)\n";
+   std::cout << "   b: batch mode - factor the numbers in infile (\"-\" for stdin) with no server\n";
+   std::cout << "   o: batch mode output file (default: stdout)\n";
+}
+
+
+int main(int argc, char *argv[]) {
+
+   unsigned int workers = 0;
+   std::string batch_in, batch_out("-");
+   bool use_smt = false, pin = true;
+   std::vector<int> allowed;
+   std::string cachefile(default_cachefile);
+   unsigned int cache_mb = default_cache_mb;
+   std::string username;
+   unsigned int max_backoff_ms = default_max_backoff_ms;
+
+   // Get the command line arguments and set params appropriately
+   int c = 0;
+   while ((c = getopt(argc, argv, "t:b:o:sc:up:m:l:r:")) != -1) {
+      switch (c) {
+
+      // Number of factoring threads
+      case 't':
+         workers = strtoul(optarg, NULL, 10);
+         break;
+
+      // Thread placement
+      case 's':
+         use_smt = true;
+         break;
+
+      case 'c':
+         if (!CpuTopology::parseCpuList(optarg, allowed)) {
+            std::cout << "Invalid CPU list: " << optarg << "\n";
+            exit(0);
+         }
+         break;
+
+      case 'u':
+         pin = false;
+         break;
+
+      // Known-primes cache
+      case 'p':
+         cachefile = optarg;
+         break;
+
+      case 'm':
+         cache_mb = strtoul(optarg, NULL, 10);
+         break;
+
+      // Login and reconnect behavior
+      case 'l':
+         username = optarg;
+         break;
+
+      case 'r':
+         max_backoff_ms = strtoul(optarg, NULL, 10) * 1000;
+         break;
+
+      // Batch mode input and output
+      case 'b':
+         batch_in = optarg;
+         break;
+
+      case 'o':
+         batch_out = optarg;
+         break;
+
+      default:
+         displayHelp(argv[0]);
+         exit(0);
+      }
+   }
+
+   // One worker per physical core unless told otherwise
+   std::vector<int> cpus;
+   if (pin) {
+      CpuTopology topo;
+      topo.load();
+      topo.getPlacement(cpus, use_smt, allowed.empty() ? NULL : &allowed);
+      if (cpus.empty()) {
+         std::cout << "None of the requested CPUs are available\n";
+         exit(0);
+      }
+   }
+
+   std::unique_ptr<PrimeCache> cache;
+   if (!cachefile.empty()) {
+      cache = std::make_unique<PrimeCache>(cachefile.c_str(), cache_mb);
+      try {
+         cache->load();
+      } catch (runtime_error &e) {
+         cerr << "Not using the prime cache: " << e.what() << endl;
+         cache.reset();
+      }
+   }
+
+   if (!batch_in.empty()) {
+      try {
+         BatchFactor batch(batch_in.c_str(), batch_out.c_str(), workers, cpus, cache.get());
+         batch.run();
+         cerr << "Batch complete: " << batch.getJobsDone() << " numbers factored\n";
+      } catch (runtime_error &e) {
+         cerr << "Batch error: " << e.what() << endl;
+         return -1;
+      }
+      return 0;
+   }
+
+   // Check the command line input
+   if (argc - optind < 2) {
+      displayHelp(argv[0]);
+      exit(0);
+   }
+
+   // Read in the IP address from the command line
+   std::string ip_addr(argv[optind]);
+
+   // Read in the port
+   long portval = strtol(argv[optind + 1], NULL, 10);
+   if ((portval < 1) || (portval > 65535)) {
+      std::cout << "Invalid port. Value must be between 1 and 65535";
+      std::cout << "Format: " << argv[0] << " [<max_range>] [<max_threads>]\n";
+       exit(0);
+   }
+   unsigned short port = (unsigned short) portval;
+ 
+
+   // Try to set up the server for listening
+   TCPClient client(workers, cpus, cache.get());
+   client.setMaxBackoff(max_backoff_ms);
+
+   if (!username.empty()) {
+      std::string passwd;
+      const char *envpwd = getenv("TCPCLIENT_PASSWD");
+      if (envpwd != NULL) {
+         passwd = envpwd;
+      } else {
+         TermFD stdinFD;
+         cout << "Password for " << username << ": ";
+         fflush(stdout);
+         stdinFD.setEchoFD(false);
+         stdinFD.readStr(passwd);
+         stdinFD.setEchoFD(true);
+         clrNewlines(passwd);
+         cout << endl;
+      }
+      client.setLogin(username.c_str(), passwd.c_str());
+   }
+
+   // A write to a dropped connection should fail and trigger a reconnect, not kill us
+   signal(SIGPIPE, SIG_IGN);
+
+   try {
+      cout << "Connecting to " << ip_addr << " port " << port << endl;
+      client.connectTo(ip_addr.c_str(), port);
+
+   } catch (socket_error &e)
+   {
+      cerr << "Connection failed: " << e.what() << endl;
+      return -1;
+   }	   
+
+   cout << "Connection established.\n";
+
+   try {
+      client.handleConnection();
+
+      client.closeConn();
+      cout << "Client disconnected\n";
+
+   } catch (runtime_error &e) {
+      cerr << "Client error received: " << e.what() << endl;
+      return -1;      
+   }
+
+   return 0;
+}
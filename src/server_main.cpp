@@ -1,100 +1,192 @@
-/****************************************************************************************
- * tcp_server - program that sets up a basic TCP server
- *
- *              **Students should not modify this code! Or at least you can to test your
- *                code, but your code should work with the unmodified version
- *
- ****************************************************************************************/  
-
-#include <stdexcept>
-#include <iostream>
-#include <getopt.h>
-#include "TCPServer.h"
-#include "exceptions.h"
-
-using namespace std; 
-
-void displayHelp(const char *execname) {
-   std::cout << execname << " [-p <portnum>] [-a <ip_addr>]\n";
-   std::cout << "   p: the port to bind the server to\n";
-   std::cout << "   a: the IP address to bind the server\n";
-
-}
-
-// global default values
-const unsigned short default_port = 9999;
-const char default_IP[] = "127.0.0.1";
-
-int main(int argc, char *argv[]) {
-
-
-   unsigned short port = default_port;
-   std::string ip_addr(default_IP);
-
-   // Get the command line arguments and set params appropriately
-   int c = 0;
-   long portval;
-   while ((c = getopt(argc, argv, "p:a:smw")) != -1) {
-      switch (c) {
-  
-      // Set the max number to count up to	    
-      case 'p':
-	      portval = strtol(optarg, NULL, 10);
-	      if ((portval < 1) || (portval > 65535)) {
-            std::cout << "Invalid port. Value must be between 1 and 65535";
-            std::cout << "Format: " << argv[0] << " [<max_range>] [<max_threads>]\n";
-            exit(0);
-	      }
-	      port = (unsigned short) portval;
-	      break;
-
-      // IP address to attempt to bind to
-      case 'a':
-         ip_addr = optarg; 
-         break;
-
-      case '?':
-	      displayHelp(argv[0]);
-	      break;
-
-      default:
-	      std::cout << "Unknown command line option '" << c << "'\n";
-	      displayHelp(argv[0]);
-	      break;
-      }
-
-   }
-
-   // Try to set up the server for listening
-   TCPServer server;
-   try {
-      cout << "Binding server to " << ip_addr << " port " << port << endl;
-      server.bindSvr(ip_addr.c_str(), port);
-
-   } catch (invalid_argument &e) 
-   {
-      cerr << "Server initialization failed: " << e.what() << endl;
-      return -1;
-   }	   
-
-   cout << "Server established.\n";
-
-   try {
-      cout << "Listening.\n";	   
-      server.listenSvr();
-   } catch (pwfile_error &e) {
-      cerr << "Error with the password file. Make sure it exists and is readable/writeable by the server.\n";
-      cerr << "Error is: " << e.what() << endl;
-      return -1;
-   } catch (socket_error &e) {
-      cerr << "Unrecoverable socket error. Exiting.\n";
-      cerr << "Error is: " << e.what() << endl;
-      return -1;
-   }
-
-
-   server.shutdown();
-
-   cout << "Server shut down\n";
-   return 0;
-}
+/****************************************************************************************
+ * tcp_server - program that sets up a basic TCP server
+ *
+ *              **Students should not modify this code! Or at least you can to test your
+ *                code, but your code should work with the unmodified version
+ *
+ ****************************************************************************************/  
+
+#include <stdexcept>
+#include <iostream>
+#include <getopt.h>
+#include <signal.h>
+#include "TCPServer.h"
+#include "exceptions.h"
+
+using namespace std; 
+
+// global default values
+const unsigned short default_port = 9999;
+const char default_IP[] = "127.0.0.1";
+const char default_results[] = "results.txt";
+
+// Handed out when no job file is given
+const char default_number[] = "975851579543363";
+
+void displayHelp(const char *execname) {
+   std::cout << execname << " [-p <portnum>] [-a <ip_addr>] [-t <threads>] [-b <backlog>] [-n <jobfile>] [-o <resultsfile>]"
+             << " [-j <journal>] [-u <admin_socket>] [-d <metrics_file>]\n";
+   std::cout << "   p: the port to bind the server to\n";
+   std::cout << "   a: the IP address to bind the server\n";
+   std::cout << "   t: number of event loop threads, each with its own listening socket (default "
+             << default_server_threads << ")\n";
+   std::cout << "   b: connections each listening socket queues before they are accepted (default "
+             << default_listen_backlog << ")\n";
+   std::cout << "   n: file of numbers to factor, one per line (default: a single demo number)\n";
+   std::cout << "   o: file to write results to (default " << default_results << ")\n";
+   std::cout << "   j: job journal to log progress to, so a restart picks up where the server left\n";
+   std::cout << "      off (the job file is only loaded if the journal is new)\n";
+   std::cout << "   u: unix socket that sends the server's metrics to anyone who connects\n";
+   std::cout << "   d: file to rewrite with the server's metrics every " << default_metrics_secs << " seconds\n";
+
+}
+
+int main(int argc, char *argv[]) {
+
+
+   unsigned short port = default_port;
+   std::string ip_addr(default_IP);
+   unsigned int num_threads = default_server_threads;
+   int backlog = default_listen_backlog;
+   std::string jobfile;
+   std::string resultsfile(default_results);
+   std::string journalfile;
+   std::string adminsock;
+   std::string metricsfile;
+
+   // Get the command line arguments and set params appropriately
+   int c = 0;
+   long portval, threadval, backlogval;
+   while ((c = getopt(argc, argv, "p:a:t:b:n:o:j:u:d:smw")) != -1) {
+      switch (c) {
+  
+      // Set the max number to count up to	    
+      case 'p':
+	      portval = strtol(optarg, NULL, 10);
+	      if ((portval < 1) || (portval > 65535)) {
+            std::cout << "Invalid port. Value must be between 1 and 65535";
+            std::cout << "Format: " << argv[0] << " [<max_range>] [<max_threads>]\n";
+            exit(0);
+	      }
+	      port = (unsigned short) portval;
+	      break;
+
+      // IP address to attempt to bind to
+      case 'a':
+         ip_addr = optarg; 
+         break;
+
+      // Number of event loop threads
+      case 't':
+         threadval = strtol(optarg, NULL, 10);
+         if ((threadval < 1) || (threadval > 1024)) {
+            std::cout << "Invalid thread count. Value must be between 1 and 1024\n";
+            exit(0);
+         }
+         num_threads = (unsigned int) threadval;
+         break;
+
+      // Listen queue length
+      case 'b':
+         backlogval = strtol(optarg, NULL, 10);
+         if ((backlogval < 1) || (backlogval > 65535)) {
+            std::cout << "Invalid backlog. Value must be between 1 and 65535\n";
+            exit(0);
+         }
+         backlog = (int) backlogval;
+         break;
+
+      // Numbers to hand out to the clients
+      case 'n':
+         jobfile = optarg;
+         break;
+
+      // Where the results go
+      case 'o':
+         resultsfile = optarg;
+         break;
+
+      // Crash-safe log of the work
+      case 'j':
+         journalfile = optarg;
+         break;
+
+      // Where to report metrics
+      case 'u':
+         adminsock = optarg;
+         break;
+
+      case 'd':
+         metricsfile = optarg;
+         break;
+
+      case '?':
+	      displayHelp(argv[0]);
+	      break;
+
+      default:
+	      std::cout << "Unknown command line option '" << c << "'\n";
+	      displayHelp(argv[0]);
+	      break;
+      }
+
+   }
+
+   // Every connection is served from this one process, so a write to a client that reset must
+   // fail with EPIPE and drop that client, not kill the server
+   signal(SIGPIPE, SIG_IGN);
+
+   // Try to set up the server for listening
+   TCPServer server;
+   server.setNumThreads(num_threads);
+   server.setBacklog(backlog);
+   server.setMetricsOutput(adminsock, metricsfile);
+
+   // Load up the work before any clients can connect
+   JobScheduler &scheduler = server.getScheduler();
+   try {
+      bool resumed = !journalfile.empty() && scheduler.openJournal(journalfile.c_str());
+      scheduler.setOutput(resultsfile.c_str(), resumed);
+      if (resumed)
+         cout << "Resumed from " << journalfile << " with " << scheduler.getNumPending() << " jobs pending" << endl;
+      else if (jobfile.empty())
+         scheduler.addJob(default_number);
+      else {
+         unsigned long num_jobs = scheduler.loadJobs(jobfile.c_str());
+         cout << "Loaded " << num_jobs << " jobs from " << jobfile << endl;
+      }
+   } catch (runtime_error &e) {
+      cerr << "Job setup failed: " << e.what() << endl;
+      return -1;
+   }
+   try {
+      cout << "Binding server to " << ip_addr << " port " << port << endl;
+      server.bindSvr(ip_addr.c_str(), port);
+
+   } catch (invalid_argument &e) 
+   {
+      cerr << "Server initialization failed: " << e.what() << endl;
+      return -1;
+   }	   
+
+   cout << "Server established.\n";
+
+   try {
+      cout << "Listening.\n";	   
+      server.listenSvr();
+   } catch (pwfile_error &e) {
+      cerr << "Error with the password file. Make sure it exists and is readable/writeable by the server.\n";
+      cerr << "Error is: " << e.what() << endl;
+      return -1;
+   } catch (socket_error &e) {
+      cerr << "Unrecoverable socket error. Exiting.\n";
+      cerr << "Error is: " << e.what() << endl;
+      return -1;
+   }
+
+
+   server.shutdown();
+
+   cout << "Server shut down\n";
+   return 0;
+}